@@ -0,0 +1,88 @@
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "IrateConfig.h"
+#include "capture.h"
+
+#if CAPTURE_ENABLE
+
+static bool capturing = false;
+static CapturePacket packet = {.reportId = CAPTURE_REPORT_ID};  // being filled
+static uint8_t lost = 0;        // entries dropped since the last one added
+static bool mark = false;       // the detector output after the last entry
+static bool known = false;      // whether the time of the last entry is...
+static uint16_t lastTicks;      // ...this
+
+static inline void countLost(void) {
+  if (lost != 0xFF) {
+    ++lost;
+  }
+}
+
+// Add an entry to the packet, unless it's full (when the host hasn't collected
+// the last ones yet). A dropped entry's time is added to the next one's.
+static void add(const uint16_t ticks) {
+  if (packet.count == CAPTURE_ENTRIES) {
+    countLost();
+    return;
+  }
+  if (packet.count == 0) {
+    packet.lost = lost;
+    packet.levels = 0;
+    lost = 0;
+  }
+  if (mark) {
+    packet.levels |= 1U << packet.count;
+  }
+  const uint16_t elapsed = ticks - lastTicks;
+  packet.ticks[packet.count++] = !known ? 0 : elapsed ? elapsed : 1;
+  lastTicks = ticks;
+  known = true;
+}
+
+void captureEdge(const uint16_t ticks, const bool asserted) {
+  if (capturing) {
+    mark = asserted;
+    add(ticks);
+  }
+}
+
+void captureTimeout(const uint16_t ticks, const bool final) {
+  if (capturing) {
+    add(ticks);
+    if (final) {
+      known = false;
+    }
+  }
+}
+
+void captureOverrun(void) {
+  if (capturing) {
+    countLost();
+  }
+}
+
+const CapturePacket* capturePending(void) {
+  return packet.count ? &packet : NULL;
+}
+
+void captureSent(void) {
+  ++packet.sequence;
+  packet.count = 0;
+}
+
+void captureSetReport(const CaptureControl* const report) {
+  if (report->enabled && !capturing) {
+    packet.count = 0;
+    lost = 0;
+    known = false;
+  }
+  capturing = report->enabled;
+}
+
+void captureGetReport(CaptureControl* const report) {
+  report->reportId = CAPTURE_REPORT_ID;
+  report->enabled = capturing;
+}
+
+#endif
@@ -0,0 +1,69 @@
+#ifndef CAPTURE_H
+#define CAPTURE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "IrateConfig.h"
+
+// Raw edge capture, for remotes which don't decode (and for learning new
+// ones). While it is switched on, every entry of the decoder's edge ring is
+// also streamed to the host, in input reports on the vendor interface's IN
+// endpoint (see host/ircapture.c); the decoder carries on as usual.
+//
+// Each entry is the time since the entry before it, in Timer1 ticks (0.5us),
+// and the detector output after it: an entry which doesn't change the output
+// is not an edge, just a timeout while it stays the same. After the last
+// of the timeouts, the time until the next edge is unknown, and is given as 0
+// (as is the time before the first entry).
+//
+// Only the first receiver's edges are captured (see IR_RECEIVERS), but the
+// timeouts are shared by all of them: with more than one, a timeout comes 26ms
+// after the last edge from any receiver, so where they fall in the first
+// receiver's spaces depends on the others. Its edges' times are unaffected.
+//
+// Entries are batched into packets, each sent as soon as the endpoint has a
+// bank free (it is polled every 1ms), so capture keeps up with at most 13
+// entries per ms on average: any remote's (RC6's half-bits, the shortest, are
+// 444us), but not noise with pulses under 77us or so, for longer than the
+// banks take to fill. If the host doesn't collect them fast enough, entries
+// are dropped, and counted in the next packet; and if the edge ring
+// overflows, that is counted too. Packets have sequence numbers, so the
+// host can also tell if it has missed any.
+//
+// Capture is switched on and off by setting the feature report of the same ID,
+// and getting it says whether it's on.
+#define CAPTURE_REPORT_ID 4
+#define CAPTURE_ENTRIES   13
+
+typedef struct {
+  uint8_t  reportId;  // CAPTURE_REPORT_ID
+  uint8_t  sequence;  // one more than the last packet's
+  uint8_t  count;     // entries in this packet
+  uint8_t  lost;      // entries dropped just before the first (saturating)
+  uint16_t levels;    // bit n: whether the detector is asserted after entry n
+  uint16_t ticks[CAPTURE_ENTRIES];  // time since the entry before, or 0
+} __attribute__((packed)) CapturePacket;
+
+typedef struct {
+  uint8_t reportId;   // CAPTURE_REPORT_ID
+  uint8_t enabled;
+} __attribute__((packed)) CaptureControl;
+
+#if CAPTURE_ENABLE
+void captureSetReport(const CaptureControl* report);
+void captureGetReport(CaptureControl* report);
+
+// Called by irPoll() for each entry of the edge ring: an edge (after which the
+// detector is asserted if mark is true), a timeout (the last, if final), or
+// edges dropped because the ring was full.
+void captureEdge(uint16_t ticks, bool mark);
+void captureTimeout(uint16_t ticks, bool final);
+void captureOverrun(void);
+
+// The packet of entries so far, if there are any, for the USB side to send;
+// and once it has been, start the next one.
+const CapturePacket* capturePending(void);
+void captureSent(void);
+#endif
+
+#endif
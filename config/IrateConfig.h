@@ -0,0 +1,259 @@
+#ifndef IRATE_CONFIG_H
+#define IRATE_CONFIG_H
+
+// Build-time options for the Irate firmware. Each of these may be overridden
+// on the command line, e.g "make CC_FLAGS+=-DIR_FRONTEND=IR_FRONTEND_INT4".
+
+// How IR edges are timestamped:
+//   IR_FRONTEND_ICP1: Timer1's input-capture unit latches TCNT1 into ICR1 in
+//                     hardware when PC7 (ICP1) changes, so the measurement is
+//                     unaffected by however long the ISR takes to dispatch.
+//   IR_FRONTEND_INT4: INT4 fires on each edge of PC7 and the ISR reads TCNT1
+//                     itself (the original approach; kept for comparison).
+#define IR_FRONTEND_ICP1 1
+#define IR_FRONTEND_INT4 2
+#ifndef IR_FRONTEND
+  #define IR_FRONTEND IR_FRONTEND_ICP1
+#endif
+
+// Enable Timer1's input-capture noise canceller (ICP1 front-end only). Edges
+// are then only accepted if PC7 is stable for four CPU cycles.
+#ifndef IR_NOISE_CANCEL
+  #define IR_NOISE_CANCEL 0
+#endif
+
+// The number of IR receivers (1 to 4), for covering a room from several places.
+// The first is on PC7, as above; the others are on PD0, PD1 and PD2 (INT0 to
+// INT2), and timestamped by their ISRs. Each has its own glitch filter and
+// decoders, and a frame decoded by more than one is only acted on once, when
+// the first of them decodes it. Each receiver after the first costs 46 bytes
+// of RAM (84 with IR_CALIBRATE on), and its edges are decoded as
+// theirs are, so the main loop's work grows with the number in use. The
+// AT90USB162 hasn't the RAM for more than one with IR_CALIBRATE on, so it's
+// off by default with more, and an error to turn on when building for it.
+#ifndef IR_RECEIVERS
+  #define IR_RECEIVERS 1
+#endif
+
+// Pulses shorter than this (in us) are taken to be noise (e.g from fluorescent
+// lighting), and merged into the pulses either side. The shortest genuine
+// pulse, RC6's half-bit, is 444us. The cost is that each pulse is only decoded
+// once the next edge arrives, or twice this long has passed. 0 disables it.
+#ifndef IR_GLITCH_FILTER
+  #define IR_GLITCH_FILTER 100
+#endif
+
+// IR protocols to decode. The decoders all run in parallel on the same edge
+// stream. SIRC-12, -15 and -20 share their timings, so when more than one of
+// them is enabled the shorter ones must wait for the end of the frame (i.e the
+// next frame, or the 26ms timeout) before they can be sure of the length.
+#ifndef IR_USE_SIRC12
+  #define IR_USE_SIRC12 0
+#endif
+#ifndef IR_USE_SIRC15
+  #define IR_USE_SIRC15 1
+#endif
+#ifndef IR_USE_SIRC20
+  #define IR_USE_SIRC20 0
+#endif
+#ifndef IR_USE_NEC
+  #define IR_USE_NEC 1
+#endif
+#ifndef IR_USE_RC5
+  #define IR_USE_RC5 1
+#endif
+#ifndef IR_USE_RC6
+  #define IR_USE_RC6 1
+#endif
+
+// Learn the timing of the frames decoded, and classify pulses accordingly: each
+// remote's clock, since cheap remotes run on RC oscillators which may be 10% or
+// more out (applied to a frame only if its header agrees, so that one protocol
+// isn't stretched to look like another); and how much the receiver stretches
+// marks, and so shortens spaces. A pulse which doesn't fit once corrected is
+// still tried as it came. It costs 9 bytes of RAM per protocol per receiver
+// (39 with the protocols above, and one receiver), and a multiply per pulse
+// per protocol.
+#ifndef IR_CALIBRATE
+  #define IR_CALIBRATE (IR_RECEIVERS == 1)
+#endif
+#if defined(__AVR_AT90USB162__) && IR_RECEIVERS > 1 && IR_CALIBRATE
+  #error "the AT90USB162 hasn't the RAM for IR_CALIBRATE with more than one receiver"
+#endif
+
+// Release a held button as soon as its next repeat frame is overdue: that is,
+// when the protocol's frame period, plus IR_RELEASE_MARGIN microseconds, has
+// passed since the last frame started, and no new frame has started. With this
+// off, a button is only released after a number of 26ms timeouts with no
+// frames (just one for SIRC, but four or five for the slower protocols).
+#ifndef IR_FAST_RELEASE
+  #define IR_FAST_RELEASE 1
+#endif
+#ifndef IR_RELEASE_MARGIN
+  #define IR_RELEASE_MARGIN 3000
+#endif
+
+// The number of agreeing frames an IR_CONFIRM_MAJORITY button-code needs (out
+// of at most twice that, less one).
+#ifndef IR_CONFIRM_VOTES
+  #define IR_CONFIRM_VOTES 2
+#endif
+
+// The IrConfirm mode (see ir.h) for each class of button. Navigation buttons
+// are pressed and held a lot, so they need to respond quickly; toggles (e.g
+// play/pause) are costly to get wrong, but can be undone quickly; and system
+// buttons (power, menu) must not be pressed by mistake. The class of each
+// button-code is given in the keymap (IrateKeymap.h); button-codes not in it
+// get CONFIRM_UNKNOWN, so a corrupted frame while a button is held does not
+// release it.
+#ifndef CONFIRM_NAVIGATION
+  #define CONFIRM_NAVIGATION IR_CONFIRM_NONE
+#endif
+#ifndef CONFIRM_TOGGLE
+  #define CONFIRM_TOGGLE IR_CONFIRM_VETO
+#endif
+#ifndef CONFIRM_SYSTEM
+  #define CONFIRM_SYSTEM IR_CONFIRM_MAJORITY
+#endif
+#ifndef CONFIRM_UNKNOWN
+  #define CONFIRM_UNKNOWN IR_CONFIRM_MAJORITY
+#endif
+
+// The number of entries a keymap programmed over USB (see keymap.h) may have.
+// It is kept in EEPROM, twice (5 bytes of header and 16 per entry, each), so
+// the AT90USB162's 512 bytes hold at most 15. It is loaded into RAM at boot,
+// which costs 16 bytes per entry, a slot or two each for the hash table, and
+// 35 more: 51 bytes for one entry, 171 for 8, of the AT90USB162's 512. A
+// programmed keymap replaces the one built in from IrateKeymap.h. 0 (the
+// default) leaves out the programmable keymap altogether: the default build
+// is within 6 bytes of the Makefile's RAM_BUDGET, and even with IR_CALIBRATE,
+// USB_MEDIA_KEYS, KEY_REPEAT and MACRO_ENABLE all off, there's only room for
+// 4 entries.
+#ifndef KEYMAP_CAPACITY
+  #define KEYMAP_CAPACITY 0
+#endif
+
+// Build in raw edge capture (capture.h): when switched on from the host, the
+// timing of every edge is streamed from the vendor-defined HID interface's IN
+// endpoint (see host/ircapture.c), for diagnosing and learning remotes. It
+// costs about 40 bytes of RAM, the vendor endpoint grows to 32 bytes and is
+// polled every 1ms, and the main loop checks for captured edges on every pass.
+// Off for release builds, like the profiler. On the AT90USB162 it needs
+// IR_CALIBRATE off, to fit.
+#ifndef CAPTURE_ENABLE
+  #define CAPTURE_ENABLE 0
+#endif
+
+// The interval (in ms) at which the host is asked to poll the HID endpoints;
+// each report may wait this long for the host to collect it. With
+// USB_FAST_ALT, the keyboard and mouse interfaces also have an alternate
+// setting 1, identical but for asking for 1ms, which the host may select at
+// run time (SET_INTERFACE).
+#ifndef USB_POLL_INTERVAL
+  #define USB_POLL_INTERVAL 5
+#endif
+#ifndef USB_FAST_ALT
+  #define USB_FAST_ALT 1
+#endif
+
+// Add Consumer Control (media keys: play/pause, next, previous, volume, mute)
+// and System Control (power down, sleep, wake up) reports to the mouse
+// interface, which then numbers its reports (with report IDs), so they share
+// its IN endpoint. They carry the keymap entries' consumer usages (see
+// IrateKeymap.h), and are only sent in the report protocol: in the boot
+// protocol (e.g to a BIOS), the mouse sends plain boot reports as before, and
+// the keyboard does either way. It costs 42 bytes of RAM, for the two reports'
+// state and idle timers, and flash for their descriptors and code.
+#ifndef USB_MEDIA_KEYS
+  #define USB_MEDIA_KEYS 1
+#endif
+
+// Repeat held buttons' keys on the device, rather than holding them down for
+// the host to repeat after its own delay, at its own rate: a button whose
+// keymap entry has a repeat curve (see IRATE_REPEATS in IrateKeymap.h) has its
+// keys released and pressed again, sooner and sooner the longer it's held. A
+// repeat is at most one release and press per two polls of the keyboard
+// endpoint; one which comes due before the last has been collected waits. It
+// costs 19 bytes of RAM. With this off, the keymap's repeat curves are ignored,
+// and keys held down for the host to repeat.
+#ifndef KEY_REPEAT
+  #define KEY_REPEAT 1
+#endif
+
+// Send keystroke macros: a button whose keymap entry names one (see
+// IRATE_MACROS in IrateKeymap.h) sends its steps, one keyboard report per poll
+// (or after the step's delay), instead of holding down keys. A button pressed
+// while a macro is being sent is:
+//   MACRO_OVERFLOW_QUEUE:  acted on once it has finished; its events wait in
+//                          the decoder's queue, and once that's full, any more
+//                          presses are dropped (and counted in its stats).
+//   MACRO_OVERFLOW_CANCEL: acted on at once, and the rest of the macro is
+//                          dropped, with anything it was holding released.
+// It costs 13 bytes of RAM. With this off, the keymap's macros are ignored.
+#ifndef MACRO_ENABLE
+  #define MACRO_ENABLE 1
+#endif
+#define MACRO_OVERFLOW_QUEUE 1
+#define MACRO_OVERFLOW_CANCEL 2
+#ifndef MACRO_OVERFLOW
+  #define MACRO_OVERFLOW MACRO_OVERFLOW_QUEUE
+#endif
+
+// Sleep (in idle mode) whenever the main loop has nothing to do, rather than
+// spinning. Once configured, the CPU wakes for every SOF, so each endpoint is
+// still serviced within a millisecond of being polled.
+#ifndef SLEEP_ENABLE
+  #define SLEEP_ENABLE 1
+#endif
+
+// While the host has suspended the bus, power down (once the receivers have
+// gone quiet), with the timers stopped and the LEDs off; and if the host has
+// enabled remote wakeup, wake it when a button is decoded, which is then sent
+// once it has resumed. Power-down stops Timer1, so only the first receiver
+// (PC7, with INT4 as a low-level interrupt) can wake the CPU, and only with a
+// mark which lasts until the clock has started again, as noise doesn't. The
+// edge starting it is dated IR_WAKE_STARTUP us earlier than that, so the frame
+// still decodes: it should be the start-up time set by the CKSEL/SUT fuses
+// (16K clock cycles, i.e 1ms at 16MHz, for a crystal).
+#ifndef SUSPEND_ENABLE
+  #define SUSPEND_ENABLE 1
+#endif
+#ifndef IR_WAKE_STARTUP
+  #define IR_WAKE_STARTUP 1000
+#endif
+
+// Build in the profiler (profile.c): ISR and main-loop timings, readable as a
+// feature report on an extra vendor-defined HID interface (see host/irprof.c).
+// Leave this off for release builds: it compiles out completely. It costs
+// about 300 bytes of RAM (its report, and the stats below), more than the
+// AT90USB162 has to spare, so it's built for the Minimus 32's ATmega32U2.
+#ifndef PROFILE_ENABLE
+  #define PROFILE_ENABLE 0
+#endif
+#if defined(__AVR_AT90USB162__) && PROFILE_ENABLE
+  #error "the AT90USB162 hasn't the RAM for the profiler: build it with MCU=atmega32u2"
+#endif
+
+// Keep the decoder's and USB stats (see irGetStats(), irprotoTiming() and
+// usbGetStats()): edges dropped, frames confirmed and vetoed, decode errors,
+// each protocol's margins, and reports sent. They cost 69 bytes of RAM (77
+// with IR_CALIBRATE and USB_MEDIA_KEYS), and only the profiler's report and the
+// simulator read them, so by default they're built in with the profiler.
+#ifndef STATS_ENABLE
+  #define STATS_ENABLE PROFILE_ENABLE
+#endif
+#if PROFILE_ENABLE && !STATS_ENABLE
+  #error "the profiler's report includes the stats, so PROFILE_ENABLE needs STATS_ENABLE"
+#endif
+
+// Build in latency tracing (trace.c): a record of each keyboard report's
+// journey from the first IR edge to the host collecting it, streamed from the
+// vendor-defined HID interface's IN endpoint (see host/irtrace.c). It costs
+// about 100 bytes of RAM, and the Timer1 overflow interrupt. Off for release
+// builds. The AT90USB162 hasn't the RAM for it alongside the features on by
+// default above; with them all off, it fits.
+#ifndef TRACE_ENABLE
+  #define TRACE_ENABLE 0
+#endif
+
+#endif
@@ -0,0 +1,150 @@
+#ifndef IRATE_KEYMAP_H
+#define IRATE_KEYMAP_H
+
+// What each IR button-code does. Every entry is:
+//
+//   KEY(name, protocol, address, command, confirm, repeat, macro, consumer, modifier, keys...)
+//
+// where confirm is the IrConfirm mode (one of the CONFIRM_* classes in
+// IrateConfig.h), repeat is how its keys repeat while it's held (one of the
+// REPEAT_* curves below, or REPEAT_HOLD to hold them down for the host to
+// repeat), macro is one of the MACRO_* macros below to send instead of keys
+// (or MACRO_NONE), consumer is a CONSUMER_* or SYSTEM_* usage (zero for none;
+// see USB_MEDIA_KEYS), modifier is a set of HID_KEYBOARD_MODIFIER_* bits, and
+// then come up to six HID_KEYBOARD_SC_* keycodes. Button-codes not listed here
+// send nothing, and get CONFIRM_UNKNOWN. For a remote routed to the mouse (see
+// IRATE_ROUTES below), modifier is instead a set of MOUSE_* buttons, and the
+// keycodes are replaced by MOUSE_MOVE(x, y): how far the pointer moves in each
+// mouse report while the button is held.
+//
+// The Sony RMT-CM15iP sends SIRC-15 frames: most buttons go to device address
+// 0x64, and the soundbar buttons go to device address 0x44. Several buttons
+// (e.g the volume buttons) send no keys, because they are interpreted directly
+// by the soundbar (i.e the computer doesn't need to do anything). The track
+// and play/pause buttons send media keys, or with USB_MEDIA_KEYS off, VLC's
+// hotkeys for them. A spare NEC remote (device address 0x80) drives the
+// mouse-pointer.
+#define MOUSE_LEFT   _BV(0)
+#define MOUSE_RIGHT  _BV(1)
+#define MOUSE_MIDDLE _BV(2)
+#define MOUSE_MOVE(x, y) (uint8_t)(int8_t)(x), (uint8_t)(int8_t)(y)
+
+#define CONSUMER_NEXT_TRACK     0x00B5
+#define CONSUMER_PREVIOUS_TRACK 0x00B6
+#define CONSUMER_PLAY_PAUSE     0x00CD
+#define CONSUMER_MUTE           0x00E2
+#define CONSUMER_VOLUME_UP      0x00E9
+#define CONSUMER_VOLUME_DOWN    0x00EA
+#define SYSTEM_POWER_DOWN       (KEYMAP_SYSTEM | 0x81)
+#define SYSTEM_SLEEP            (KEYMAP_SYSTEM | 0x82)
+#define SYSTEM_WAKE_UP          (KEYMAP_SYSTEM | 0x83)
+
+#define IRATE_KEYMAP(KEY) \
+  KEY(ON_OFF,         IR_PROTO_SIRC15, 0x44, 0x15, CONFIRM_SYSTEM,     REPEAT_HOLD,   MACRO_NONE, 0, 0) \
+  KEY(VOLUME_UP,      IR_PROTO_SIRC15, 0x44, 0x12, CONFIRM_NAVIGATION, REPEAT_HOLD,   MACRO_NONE, 0, 0) \
+  KEY(VOLUME_DOWN,    IR_PROTO_SIRC15, 0x44, 0x13, CONFIRM_NAVIGATION, REPEAT_HOLD,   MACRO_NONE, 0, 0) \
+  KEY(SOUND,          IR_PROTO_SIRC15, 0x44, 0x30, CONFIRM_TOGGLE,     REPEAT_HOLD,   MACRO_NONE, 0, 0) \
+  KEY(ENTER,          IR_PROTO_SIRC15, 0x64, 0x10, CONFIRM_NAVIGATION, REPEAT_HOLD,   MACRO_NONE, 0, 0, HID_KEYBOARD_SC_ENTER) \
+  KEY(MENU,           IR_PROTO_SIRC15, 0x64, 0x11, CONFIRM_SYSTEM,     REPEAT_HOLD,   MACRO_NONE, 0, HID_KEYBOARD_MODIFIER_LEFTSHIFT, HID_KEYBOARD_SC_M) \
+  KEY(UP_ARROW,       IR_PROTO_SIRC15, 0x64, 0x12, CONFIRM_NAVIGATION, REPEAT_SCROLL, MACRO_NONE, 0, 0, HID_KEYBOARD_SC_UP_ARROW) \
+  KEY(DOWN_ARROW,     IR_PROTO_SIRC15, 0x64, 0x13, CONFIRM_NAVIGATION, REPEAT_SCROLL, MACRO_NONE, 0, 0, HID_KEYBOARD_SC_DOWN_ARROW) \
+  IRATE_MEDIA_KEYS(KEY) \
+  KEY(POINTER_UP,     IR_PROTO_NEC,    0x80, 0x05, CONFIRM_NAVIGATION, REPEAT_HOLD,   MACRO_NONE, 0, 0, MOUSE_MOVE(0, -4)) \
+  KEY(POINTER_DOWN,   IR_PROTO_NEC,    0x80, 0x0D, CONFIRM_NAVIGATION, REPEAT_HOLD,   MACRO_NONE, 0, 0, MOUSE_MOVE(0, 4)) \
+  KEY(POINTER_LEFT,   IR_PROTO_NEC,    0x80, 0x08, CONFIRM_NAVIGATION, REPEAT_HOLD,   MACRO_NONE, 0, 0, MOUSE_MOVE(-4, 0)) \
+  KEY(POINTER_RIGHT,  IR_PROTO_NEC,    0x80, 0x0A, CONFIRM_NAVIGATION, REPEAT_HOLD,   MACRO_NONE, 0, 0, MOUSE_MOVE(4, 0)) \
+  KEY(CLICK,          IR_PROTO_NEC,    0x80, 0x09, CONFIRM_TOGGLE,     REPEAT_HOLD,   MACRO_NONE, 0, MOUSE_LEFT)
+
+#if USB_MEDIA_KEYS
+#define IRATE_MEDIA_KEYS(KEY) \
+  KEY(PREVIOUS_TRACK, IR_PROTO_SIRC15, 0x64, 0x30, CONFIRM_NAVIGATION, REPEAT_HOLD,   MACRO_NONE, CONSUMER_PREVIOUS_TRACK, 0) \
+  KEY(NEXT_TRACK,     IR_PROTO_SIRC15, 0x64, 0x31, CONFIRM_NAVIGATION, REPEAT_HOLD,   MACRO_NONE, CONSUMER_NEXT_TRACK,     0) \
+  KEY(PLAY_PAUSE,     IR_PROTO_SIRC15, 0x64, 0x33, CONFIRM_TOGGLE,     REPEAT_HOLD,   MACRO_NONE, CONSUMER_PLAY_PAUSE,     0)
+#else
+#define IRATE_MEDIA_KEYS(KEY) \
+  KEY(PREVIOUS_TRACK, IR_PROTO_SIRC15, 0x64, 0x30, CONFIRM_NAVIGATION, REPEAT_HOLD,   MACRO_NONE, 0, HID_KEYBOARD_MODIFIER_LEFTSHIFT, HID_KEYBOARD_SC_LEFT_ARROW) \
+  KEY(NEXT_TRACK,     IR_PROTO_SIRC15, 0x64, 0x31, CONFIRM_NAVIGATION, REPEAT_HOLD,   MACRO_NONE, 0, HID_KEYBOARD_MODIFIER_LEFTSHIFT, HID_KEYBOARD_SC_RIGHT_ARROW) \
+  KEY(PLAY_PAUSE,     IR_PROTO_SIRC15, 0x64, 0x33, CONFIRM_TOGGLE,     REPEAT_HOLD,   MACRO_NONE, 0, 0, HID_KEYBOARD_SC_SPACE)
+#endif
+
+// How held buttons' keys repeat (see KEY_REPEAT). Every curve is:
+//
+//   REPEAT(name, delay, first, last, step)
+//
+// and an entry with REPEAT_<name> has its keys released and pressed again
+// delay ms after the press, then every interval ms, which starts at first and
+// shortens by step each time, down to last. They are numbered from one, in the
+// order listed, which is how a keymap programmed over USB gives them.
+//
+// Here, the arrows scroll through a long list ten times a second to begin
+// with, and forty after a second or so: faster, and more predictable, than a
+// host's typical typematic delay of 500ms and rate of 30 a second.
+#define IRATE_REPEATS(REPEAT) \
+  REPEAT(SCROLL, 300, 100, 25, 10)
+
+// Keystroke macros (see MACRO_ENABLE). Every macro is:
+//
+//   MACRO(name, steps...)
+//
+// where each step is MACRO_TAP(modifier, key), which presses and releases the
+// key; MACRO_PRESS(modifier, key), which leaves it pressed until the next step;
+// or MACRO_WAIT(ms), which waits up to 255ms, then releases anything pressed.
+// Each report a macro sends takes a poll of the keyboard endpoint. An entry
+// with MACRO_<name> sends its steps once, when it's pressed. They are numbered
+// from one, in the order listed, which is how a keymap programmed over USB
+// gives them.
+//
+// Here, as an example (no button sends it), VLC's DVD menu is opened afresh
+// and its third item chosen.
+#define MACRO_PRESS(modifier, key) {0, modifier, key}
+#define MACRO_TAP(modifier, key)   MACRO_PRESS(modifier, key), {0, 0, 0}
+#define MACRO_WAIT(ms)             {ms, 0, 0}
+
+#define IRATE_MACROS(MACRO) \
+  MACRO(DVD_ITEM_3, \
+    MACRO_TAP(0, HID_KEYBOARD_SC_ESCAPE), \
+    MACRO_TAP(HID_KEYBOARD_MODIFIER_LEFTSHIFT, HID_KEYBOARD_SC_M), \
+    MACRO_TAP(0, HID_KEYBOARD_SC_DOWN_ARROW), \
+    MACRO_TAP(0, HID_KEYBOARD_SC_DOWN_ARROW), \
+    MACRO_TAP(0, HID_KEYBOARD_SC_ENTER))
+
+// Where each remote's button-codes go, by protocol and device address. Every
+// entry is:
+//
+//   ROUTE(protocol, address, route)
+//
+// where route is ROUTE_KEYBOARD, ROUTE_MOUSE, ROUTE_CONSUMER (media keys only)
+// or ROUTE_IGNORE; remotes not listed get ROUTE_DEFAULT. An ignored remote's
+// frames are dropped as soon as they decode, so in a room shared with other
+// devices' remotes, theirs can neither press nor release a button, nor outvote
+// one of ours which needs confirming. The routes are built in, and also apply
+// to a keymap programmed over USB.
+//
+// Here, as an example, another Sony device's remote in the room (SIRC-15
+// device address 0x10) is ignored.
+#define IRATE_ROUTES(ROUTE) \
+  ROUTE(IR_PROTO_SIRC15, 0x64, ROUTE_KEYBOARD) \
+  ROUTE(IR_PROTO_SIRC15, 0x44, ROUTE_KEYBOARD) \
+  ROUTE(IR_PROTO_SIRC15, 0x10, ROUTE_IGNORE) \
+  ROUTE(IR_PROTO_NEC,    0x80, ROUTE_MOUSE)
+
+#ifndef ROUTE_DEFAULT
+  #define ROUTE_DEFAULT ROUTE_KEYBOARD
+#endif
+
+// The keymap is looked up through a hash table of 2^KEYMAP_SLOT_BITS one-byte
+// slots, which is built at compile time, and the routes likewise through one of
+// 2^ROUTE_SLOT_BITS. If two button-codes (or remotes) hash to the same slot,
+// the build fails (an "initialized field overwritten" error in keymap.c);
+// change KEYMAP_SEED (any odd number) until it builds, or add a slot bit.
+#ifndef KEYMAP_SLOT_BITS
+  #define KEYMAP_SLOT_BITS 5
+#endif
+#ifndef ROUTE_SLOT_BITS
+  #define ROUTE_SLOT_BITS 3
+#endif
+#ifndef KEYMAP_SEED
+  #define KEYMAP_SEED 0x9E3D79F1
+#endif
+
+#endif
@@ -1,4 +1,8 @@
 #include "desc.h"
+#include "capture.h"
+#include "keymap.h"
+#include "profile.h"
+#include "trace.h"
 
 static const USB_Descriptor_HIDReport_Datatype_t PROGMEM kbdReport[] = {
   HID_RI_USAGE_PAGE(8, 0x01),      // generic desktop
@@ -39,6 +43,9 @@ static const USB_Descriptor_HIDReport_Datatype_t PROGMEM mouseReport[] = {
   HID_RI_USAGE_PAGE(8, 0x01), /* Generic Desktop */
   HID_RI_USAGE(8, 0x02), /* Mouse */
   HID_RI_COLLECTION(8, 0x01), /* Application */
+#if USB_MEDIA_KEYS
+    HID_RI_REPORT_ID(8, MOUSE_REPORT_ID),
+#endif
     HID_RI_USAGE(8, 0x01), /* Pointer */
     HID_RI_COLLECTION(8, 0x00), /* Physical */
       HID_RI_USAGE_PAGE(8, 0x09), /* Button */
@@ -55,16 +62,81 @@ static const USB_Descriptor_HIDReport_Datatype_t PROGMEM mouseReport[] = {
       HID_RI_USAGE_PAGE(8, 0x01), /* Generic Desktop */
       HID_RI_USAGE(8, 0x30), /* Usage X */
       HID_RI_USAGE(8, 0x31), /* Usage Y */
-      HID_RI_LOGICAL_MINIMUM(8, -1),
-      HID_RI_LOGICAL_MAXIMUM(8, 1),
-      HID_RI_PHYSICAL_MINIMUM(8, -1),
-      HID_RI_PHYSICAL_MAXIMUM(8, 1),
+      HID_RI_LOGICAL_MINIMUM(8, -127),
+      HID_RI_LOGICAL_MAXIMUM(8, 127),
       HID_RI_REPORT_COUNT(8, 0x02),
       HID_RI_REPORT_SIZE(8, 0x08),
       HID_RI_INPUT(8, HID_IOF_DATA | HID_IOF_VARIABLE | HID_IOF_RELATIVE),
     HID_RI_END_COLLECTION(0),
   HID_RI_END_COLLECTION(0),
+#if USB_MEDIA_KEYS
+  HID_RI_USAGE_PAGE(8, 0x0C), /* Consumer */
+  HID_RI_USAGE(8, 0x01), /* Consumer Control */
+  HID_RI_COLLECTION(8, 0x01), /* Application */
+    HID_RI_REPORT_ID(8, CONSUMER_REPORT_ID),
+    HID_RI_USAGE_MINIMUM(8, 0x00),
+    HID_RI_USAGE_MAXIMUM(16, 0x03FF),
+    HID_RI_LOGICAL_MINIMUM(8, 0x00),
+    HID_RI_LOGICAL_MAXIMUM(16, 0x03FF),
+    HID_RI_REPORT_COUNT(8, 0x01),
+    HID_RI_REPORT_SIZE(8, 0x10),
+    HID_RI_INPUT(8, HID_IOF_DATA | HID_IOF_ARRAY | HID_IOF_ABSOLUTE),
+  HID_RI_END_COLLECTION(0),
+  HID_RI_USAGE_PAGE(8, 0x01), /* Generic Desktop */
+  HID_RI_USAGE(8, 0x80), /* System Control */
+  HID_RI_COLLECTION(8, 0x01), /* Application */
+    HID_RI_REPORT_ID(8, SYSTEM_REPORT_ID),
+    HID_RI_USAGE_MINIMUM(8, 0x81), /* System Power Down */
+    HID_RI_USAGE_MAXIMUM(8, 0x83), /* System Wake Up */
+    HID_RI_LOGICAL_MINIMUM(8, 0x01),
+    HID_RI_LOGICAL_MAXIMUM(8, 0x03),
+    HID_RI_REPORT_COUNT(8, 0x01),
+    HID_RI_REPORT_SIZE(8, 0x02),
+    HID_RI_INPUT(8, HID_IOF_DATA | HID_IOF_ARRAY | HID_IOF_ABSOLUTE),
+    HID_RI_REPORT_SIZE(8, 0x06),
+    HID_RI_INPUT(8, HID_IOF_CONSTANT),
+  HID_RI_END_COLLECTION(0),
+#endif
+};
+
+#if VENDOR_INTERFACE
+static const USB_Descriptor_HIDReport_Datatype_t PROGMEM vendorReport[] = {
+  HID_RI_USAGE_PAGE(16, 0xFF00),   // vendor-defined
+  HID_RI_USAGE(8, 0x01),
+  HID_RI_COLLECTION(8, 0x01),      // application
+    HID_RI_LOGICAL_MINIMUM(8, 0x00),
+    HID_RI_LOGICAL_MAXIMUM(16, 0x00FF),
+    HID_RI_REPORT_SIZE(8, 0x08),
+#if PROFILE_ENABLE
+    HID_RI_REPORT_ID(8, PROFILE_REPORT_ID),
+    HID_RI_USAGE(8, 0x02),         // profile (see profile.h)
+    HID_RI_REPORT_COUNT(8, sizeof(ProfileReport) - 1),
+    HID_RI_FEATURE(8, HID_IOF_DATA | HID_IOF_VARIABLE | HID_IOF_ABSOLUTE),
+#endif
+#if KEYMAP_CAPACITY
+    HID_RI_REPORT_ID(8, KEYMAP_REPORT_ID),
+    HID_RI_USAGE(8, 0x03),         // keymap (see keymap.h)
+    HID_RI_REPORT_COUNT(8, sizeof(KeymapReport) - 1),
+    HID_RI_FEATURE(8, HID_IOF_DATA | HID_IOF_VARIABLE | HID_IOF_ABSOLUTE),
+#endif
+#if TRACE_ENABLE
+    HID_RI_REPORT_ID(8, TRACE_REPORT_ID),
+    HID_RI_USAGE(8, 0x04),         // trace record (see trace.h)
+    HID_RI_REPORT_COUNT(8, sizeof(TraceRecord) - 1),
+    HID_RI_INPUT(8, HID_IOF_DATA | HID_IOF_VARIABLE | HID_IOF_ABSOLUTE),
+#endif
+#if CAPTURE_ENABLE
+    HID_RI_REPORT_ID(8, CAPTURE_REPORT_ID),
+    HID_RI_USAGE(8, 0x05),         // capture packet (see capture.h)
+    HID_RI_REPORT_COUNT(8, sizeof(CapturePacket) - 1),
+    HID_RI_INPUT(8, HID_IOF_DATA | HID_IOF_VARIABLE | HID_IOF_ABSOLUTE),
+    HID_RI_USAGE(8, 0x06),         // ...and switching capture on and off
+    HID_RI_REPORT_COUNT(8, sizeof(CaptureControl) - 1),
+    HID_RI_FEATURE(8, HID_IOF_DATA | HID_IOF_VARIABLE | HID_IOF_ABSOLUTE),
+#endif
+  HID_RI_END_COLLECTION(0)
 };
+#endif
 
 static const USB_Descriptor_Device_t PROGMEM devDescriptor = {
   .Header                 = {
@@ -85,6 +157,60 @@ static const USB_Descriptor_Device_t PROGMEM devDescriptor = {
   .NumberOfConfigurations = FIXED_NUM_CONFIGURATIONS
 };
 
+// The keyboard and mouse interfaces each have alternate settings which differ
+// only in their endpoints' polling intervals (see USB_FAST_ALT), so the parts
+// of the descriptors which are repeated are made by these.
+#define KBD_INTERFACE(alt) { \
+  .Header = { \
+    .Size = sizeof(USB_Descriptor_Interface_t), \
+    .Type = DTYPE_Interface \
+  }, \
+  .InterfaceNumber        = ifKeyboard, \
+  .AlternateSetting       = (alt), \
+  .TotalEndpoints         = 2, \
+  .Class                  = HID_CSCP_HIDClass, \
+  .SubClass               = HID_CSCP_BootSubclass, \
+  .Protocol               = HID_CSCP_KeyboardBootProtocol, \
+  .InterfaceStrIndex      = NO_DESCRIPTOR \
+}
+
+#define MOUSE_INTERFACE(alt) { \
+  .Header = { \
+    .Size = sizeof(USB_Descriptor_Interface_t), \
+    .Type = DTYPE_Interface \
+  }, \
+  .InterfaceNumber        = ifMouse, \
+  .AlternateSetting       = (alt), \
+  .TotalEndpoints         = 1, \
+  .Class                  = HID_CSCP_HIDClass, \
+  .SubClass               = HID_CSCP_BootSubclass, \
+  .Protocol               = HID_CSCP_MouseBootProtocol, \
+  .InterfaceStrIndex      = NO_DESCRIPTOR \
+}
+
+#define HID_DESCRIPTOR(report) { \
+  .Header = { \
+    .Size = sizeof(USB_HID_Descriptor_HID_t), \
+    .Type = HID_DTYPE_HID \
+  }, \
+  .HIDSpec                = VERSION_BCD(1,1,1), \
+  .CountryCode            = 0x00, \
+  .TotalReportDescriptors = 1, \
+  .HIDReportType          = HID_DTYPE_Report, \
+  .HIDReportLength        = sizeof(report) \
+}
+
+#define HID_ENDPOINT(address, size, interval) { \
+  .Header = { \
+    .Size = sizeof(USB_Descriptor_Endpoint_t), \
+    .Type = DTYPE_Endpoint \
+  }, \
+  .EndpointAddress        = (address), \
+  .Attributes             = (EP_TYPE_INTERRUPT | ENDPOINT_ATTR_NO_SYNC | ENDPOINT_USAGE_DATA), \
+  .EndpointSize           = (size), \
+  .PollingIntervalMS      = (interval) \
+}
+
 static const ConfigDescriptor PROGMEM configDescriptor = {
   .config = {
     .Header = {
@@ -92,97 +218,52 @@ static const ConfigDescriptor PROGMEM configDescriptor = {
       .Type = DTYPE_Configuration
     },
     .TotalConfigurationSize = sizeof(ConfigDescriptor),
-    .TotalInterfaces        = 2,
+    .TotalInterfaces        = 2 + VENDOR_INTERFACE,
     .ConfigurationNumber    = 1,
     .ConfigurationStrIndex  = NO_DESCRIPTOR,
-    .ConfigAttributes       = (USB_CONFIG_ATTR_RESERVED | USB_CONFIG_ATTR_SELFPOWERED),
+    .ConfigAttributes       = (USB_CONFIG_ATTR_RESERVED | USB_CONFIG_ATTR_SELFPOWERED |
+                               (SUSPEND_ENABLE ? USB_CONFIG_ATTR_REMOTEWAKEUP : 0)),
     .MaxPowerConsumption    = USB_CONFIG_POWER_MA(100)
   },
   
-  .kbdInterface = {
-    .Header = {
-      .Size = sizeof(USB_Descriptor_Interface_t),
-      .Type = DTYPE_Interface
-    },
-    .InterfaceNumber        = ifKeyboard,
-    .AlternateSetting       = 0x00,
-    .TotalEndpoints         = 2,
-    .Class                  = HID_CSCP_HIDClass,
-    .SubClass               = HID_CSCP_BootSubclass,
-    .Protocol               = HID_CSCP_KeyboardBootProtocol,
-    .InterfaceStrIndex      = NO_DESCRIPTOR
-  },
-  
-  .kbdHID = {
-    .Header = {
-      .Size = sizeof(USB_HID_Descriptor_HID_t),
-      .Type = HID_DTYPE_HID
-    },
-    .HIDSpec                = VERSION_BCD(1,1,1),
-    .CountryCode            = 0x00,
-    .TotalReportDescriptors = 1,
-    .HIDReportType          = HID_DTYPE_Report,
-    .HIDReportLength        = sizeof(kbdReport)
-  },
-  
-  .kbdReportIN = {
-    .Header = {
-      .Size = sizeof(USB_Descriptor_Endpoint_t),
-      .Type = DTYPE_Endpoint
-    },
-    .EndpointAddress        = KEYBOARD_IN_EPADDR,
-    .Attributes             = (EP_TYPE_INTERRUPT | ENDPOINT_ATTR_NO_SYNC | ENDPOINT_USAGE_DATA),
-    .EndpointSize           = HID_EPSIZE,
-    .PollingIntervalMS      = 0x05
-  },
-  
-  .kbdReportOUT = {
-    .Header = {
-      .Size = sizeof(USB_Descriptor_Endpoint_t),
-      .Type = DTYPE_Endpoint
-    },
-    .EndpointAddress        = KEYBOARD_OUT_EPADDR,
-    .Attributes             = (EP_TYPE_INTERRUPT | ENDPOINT_ATTR_NO_SYNC | ENDPOINT_USAGE_DATA),
-    .EndpointSize           = HID_EPSIZE,
-    .PollingIntervalMS      = 0x05
-  },
+  .kbdInterface     = KBD_INTERFACE(0),
+  .kbdHID           = HID_DESCRIPTOR(kbdReport),
+  .kbdReportIN      = HID_ENDPOINT(KEYBOARD_IN_EPADDR,  HID_EPSIZE, USB_POLL_INTERVAL),
+  .kbdReportOUT     = HID_ENDPOINT(KEYBOARD_OUT_EPADDR, HID_EPSIZE, USB_POLL_INTERVAL),
+#if USB_FAST_ALT
+  .kbdFastInterface = KBD_INTERFACE(1),
+  .kbdFastHID       = HID_DESCRIPTOR(kbdReport),
+  .kbdFastReportIN  = HID_ENDPOINT(KEYBOARD_IN_EPADDR,  HID_EPSIZE, 1),
+  .kbdFastReportOUT = HID_ENDPOINT(KEYBOARD_OUT_EPADDR, HID_EPSIZE, 1),
+#endif
+
+  .mouseInterface     = MOUSE_INTERFACE(0),
+  .mouseHID           = HID_DESCRIPTOR(mouseReport),
+  .mouseReportIN      = HID_ENDPOINT(MOUSE_IN_EPADDR, HID_EPSIZE, USB_POLL_INTERVAL),
+#if USB_FAST_ALT
+  .mouseFastInterface = MOUSE_INTERFACE(1),
+  .mouseFastHID       = HID_DESCRIPTOR(mouseReport),
+  .mouseFastReportIN  = HID_ENDPOINT(MOUSE_IN_EPADDR, HID_EPSIZE, 1),
+#endif
 
-  .mouseInterface = {
+#if VENDOR_INTERFACE
+  .vendorInterface = {
     .Header = {
       .Size = sizeof(USB_Descriptor_Interface_t),
       .Type = DTYPE_Interface
     },
-    .InterfaceNumber        = ifMouse,
+    .InterfaceNumber        = ifVendor,
     .AlternateSetting       = 0x00,
     .TotalEndpoints         = 1,
     .Class                  = HID_CSCP_HIDClass,
-    .SubClass               = HID_CSCP_BootSubclass,
-    .Protocol               = HID_CSCP_MouseBootProtocol,
+    .SubClass               = HID_CSCP_NonBootSubclass,
+    .Protocol               = HID_CSCP_NonBootProtocol,
     .InterfaceStrIndex      = NO_DESCRIPTOR
   },
 
-  .mouseHID = {
-    .Header = {
-      .Size = sizeof(USB_HID_Descriptor_HID_t),
-      .Type = HID_DTYPE_HID
-    },
-    .HIDSpec                = VERSION_BCD(1,1,1),
-    .CountryCode            = 0x00,
-    .TotalReportDescriptors = 1,
-    .HIDReportType          = HID_DTYPE_Report,
-    .HIDReportLength        = sizeof(mouseReport)
-  },
-
-  .mouseReportIN = {
-    .Header = {
-      .Size = sizeof(USB_Descriptor_Endpoint_t),
-      .Type = DTYPE_Endpoint
-    },
-    .EndpointAddress        = MOUSE_IN_EPADDR,
-    .Attributes             = (EP_TYPE_INTERRUPT | ENDPOINT_ATTR_NO_SYNC | ENDPOINT_USAGE_DATA),
-    .EndpointSize           = HID_EPSIZE,
-    .PollingIntervalMS      = 0x05
-  }
+  .vendorHID       = HID_DESCRIPTOR(vendorReport),
+  .vendorReportIN  = HID_ENDPOINT(VENDOR_IN_EPADDR, VENDOR_EPSIZE, VENDOR_POLL_INTERVAL),
+#endif
 };
 
 static const USB_Descriptor_String_t PROGMEM languageString = USB_STRING_DESCRIPTOR_ARRAY(LANGUAGE_ID_ENG);
@@ -218,11 +299,15 @@ uint16_t CALLBACK_USB_GetDescriptor(
           *descAddress = &productString;
           return pgm_read_byte(&productString.Header.Size);
       }
+      break;
 
     case HID_DTYPE_HID:
       switch (wIndex) {
         case ifKeyboard: *descAddress = &configDescriptor.kbdHID;   break;
         case ifMouse:    *descAddress = &configDescriptor.mouseHID; break;
+#if VENDOR_INTERFACE
+        case ifVendor:   *descAddress = &configDescriptor.vendorHID; break;
+#endif
         default:         *descAddress = NULL; return NO_DESCRIPTOR;
       }
       return sizeof(USB_HID_Descriptor_HID_t);
@@ -231,6 +316,9 @@ uint16_t CALLBACK_USB_GetDescriptor(
       switch (wIndex) {
         case ifKeyboard: *descAddress = &kbdReport;   return sizeof(kbdReport);
         case ifMouse:    *descAddress = &mouseReport; return sizeof(mouseReport);
+#if VENDOR_INTERFACE
+        case ifVendor:   *descAddress = &vendorReport; return sizeof(vendorReport);
+#endif
         default:         *descAddress = NULL; return NO_DESCRIPTOR;
       }
   }
@@ -3,6 +3,14 @@
 
 #include <LUFA/Drivers/USB/USB.h>
 #include <avr/pgmspace.h>
+#include "IrateConfig.h"
+
+// The vendor-defined HID interface carries the diagnostic and keymap reports,
+// so it is only there when at least one of them is built in.
+#define VENDOR_INTERFACE (PROFILE_ENABLE || KEYMAP_CAPACITY > 0 || TRACE_ENABLE || CAPTURE_ENABLE)
+
+// GetReport/SetReport wValue: report type in the high byte, ID in the low byte
+#define FEATURE_REPORT(id) (((HID_REPORT_ITEM_Feature + 1) << 8) | (id))
 
 typedef struct {
   USB_Descriptor_Configuration_Header_t config;
@@ -12,16 +20,35 @@ typedef struct {
   USB_HID_Descriptor_HID_t              kbdHID;
   USB_Descriptor_Endpoint_t             kbdReportIN;
   USB_Descriptor_Endpoint_t             kbdReportOUT;
+#if USB_FAST_ALT
+  USB_Descriptor_Interface_t            kbdFastInterface;
+  USB_HID_Descriptor_HID_t              kbdFastHID;
+  USB_Descriptor_Endpoint_t             kbdFastReportIN;
+  USB_Descriptor_Endpoint_t             kbdFastReportOUT;
+#endif
 
   // Mouse
   USB_Descriptor_Interface_t            mouseInterface;
   USB_HID_Descriptor_HID_t              mouseHID;
   USB_Descriptor_Endpoint_t             mouseReportIN;
+#if USB_FAST_ALT
+  USB_Descriptor_Interface_t            mouseFastInterface;
+  USB_HID_Descriptor_HID_t              mouseFastHID;
+  USB_Descriptor_Endpoint_t             mouseFastReportIN;
+#endif
+
+#if VENDOR_INTERFACE
+  // Vendor-defined
+  USB_Descriptor_Interface_t            vendorInterface;
+  USB_HID_Descriptor_HID_t              vendorHID;
+  USB_Descriptor_Endpoint_t             vendorReportIN;
+#endif
 } ConfigDescriptor;
 
 enum InterfaceDescriptors_t {
   ifKeyboard = 0, /**< Keyboard interface descriptor ID */
-  ifMouse    = 1  /**< Mouse interface descriptor ID */
+  ifMouse    = 1, /**< Mouse interface descriptor ID */
+  ifVendor   = 2  /**< Vendor-defined interface descriptor ID */
 };
 
 enum StringDescriptors_t {
@@ -33,8 +60,29 @@ enum StringDescriptors_t {
 #define KEYBOARD_IN_EPADDR  (ENDPOINT_DIR_IN  | 1)
 #define KEYBOARD_OUT_EPADDR (ENDPOINT_DIR_OUT | 2)
 #define MOUSE_IN_EPADDR     (ENDPOINT_DIR_IN  | 3)
+#define VENDOR_IN_EPADDR    (ENDPOINT_DIR_IN  | 4)
 #define HID_EPSIZE 8
 
+#if USB_MEDIA_KEYS
+// The mouse interface's reports (see USB_MEDIA_KEYS)
+#define MOUSE_REPORT_ID    1
+#define CONSUMER_REPORT_ID 2  // a 16-bit consumer-page usage, or zero
+#define SYSTEM_REPORT_ID   3  // a system control usage, less 0x80, or zero
+#endif
+
+// The vendor interface's IN endpoint sends a whole trace record (see trace.h)
+// or capture packet (see capture.h) per packet. Captures need it polled every
+// frame: that streams up to 13 edges per ms, which host/traces/noise-capture.ir
+// checks loses nothing at 12.5 (noise of 80us pulses, five times RC6's rate).
+// Faster noise loses edges once the banks fill; they are counted.
+#if CAPTURE_ENABLE
+  #define VENDOR_EPSIZE 32
+  #define VENDOR_POLL_INTERVAL 1
+#else
+  #define VENDOR_EPSIZE 16
+  #define VENDOR_POLL_INTERVAL USB_POLL_INTERVAL
+#endif
+
 uint16_t CALLBACK_USB_GetDescriptor(
   const uint16_t wValue, const uint16_t wIndex, const void** const descAddress)
   ATTR_WARN_UNUSED_RESULT ATTR_NON_NULL_PTR_ARG(3);
@@ -0,0 +1,350 @@
+#ifndef HOST_LUFA_USB_H
+#define HOST_LUFA_USB_H
+
+// Host-side stand-in for the parts of LUFA's USB stack used by the firmware.
+// Descriptor types and HID report-item macros mirror LUFA's, so desc.c builds
+// unchanged. The endpoint calls operate on a software model of the USB
+// controller's FIFOs (see shim.c) which the simulation driver plays host to.
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <wchar.h>
+#include <avr/io.h>
+#include <avr/pgmspace.h>
+
+#define ATTR_PACKED               __attribute__((packed))
+#define ATTR_WARN_UNUSED_RESULT   __attribute__((warn_unused_result))
+#define ATTR_NON_NULL_PTR_ARG(...) __attribute__((nonnull(__VA_ARGS__)))
+#define CONCAT(x, y)              x ## y
+#define CONCAT_EXPANDED(x, y)     CONCAT(x, y)
+
+#define FIXED_CONTROL_ENDPOINT_SIZE 8
+#define FIXED_NUM_CONFIGURATIONS    1
+
+#define VERSION_BCD(Major, Minor, Revision) \
+  ((((Major) & 0xFF) << 8) | (((Minor) & 0x0F) << 4) | ((Revision) & 0x0F))
+
+// Standard descriptors
+typedef struct {
+  uint8_t Size;
+  uint8_t Type;
+} ATTR_PACKED USB_Descriptor_Header_t;
+
+typedef struct {
+  USB_Descriptor_Header_t Header;
+  uint16_t USBSpecification;
+  uint8_t  Class;
+  uint8_t  SubClass;
+  uint8_t  Protocol;
+  uint8_t  Endpoint0Size;
+  uint16_t VendorID;
+  uint16_t ProductID;
+  uint16_t ReleaseNumber;
+  uint8_t  ManufacturerStrIndex;
+  uint8_t  ProductStrIndex;
+  uint8_t  SerialNumStrIndex;
+  uint8_t  NumberOfConfigurations;
+} ATTR_PACKED USB_Descriptor_Device_t;
+
+typedef struct {
+  USB_Descriptor_Header_t Header;
+  uint16_t TotalConfigurationSize;
+  uint8_t  TotalInterfaces;
+  uint8_t  ConfigurationNumber;
+  uint8_t  ConfigurationStrIndex;
+  uint8_t  ConfigAttributes;
+  uint8_t  MaxPowerConsumption;
+} ATTR_PACKED USB_Descriptor_Configuration_Header_t;
+
+typedef struct {
+  USB_Descriptor_Header_t Header;
+  uint8_t InterfaceNumber;
+  uint8_t AlternateSetting;
+  uint8_t TotalEndpoints;
+  uint8_t Class;
+  uint8_t SubClass;
+  uint8_t Protocol;
+  uint8_t InterfaceStrIndex;
+} ATTR_PACKED USB_Descriptor_Interface_t;
+
+typedef struct {
+  USB_Descriptor_Header_t Header;
+  uint8_t  EndpointAddress;
+  uint8_t  Attributes;
+  uint16_t EndpointSize;
+  uint8_t  PollingIntervalMS;
+} ATTR_PACKED USB_Descriptor_Endpoint_t;
+
+typedef struct {
+  USB_Descriptor_Header_t Header;
+  wchar_t UnicodeString[];
+} ATTR_PACKED USB_Descriptor_String_t;
+
+#define USB_STRING_LEN(UnicodeChars) (sizeof(USB_Descriptor_Header_t) + ((UnicodeChars) << 1))
+#define USB_STRING_DESCRIPTOR(String) \
+  { .Header = {.Size = sizeof(USB_Descriptor_Header_t) + (sizeof(String) - 2), .Type = DTYPE_String}, .UnicodeString = String }
+#define USB_STRING_DESCRIPTOR_ARRAY(...) \
+  { .Header = {.Size = sizeof(USB_Descriptor_Header_t) + sizeof((uint16_t[]){__VA_ARGS__}), .Type = DTYPE_String}, .UnicodeString = {__VA_ARGS__} }
+
+#define NO_DESCRIPTOR   0
+#define LANGUAGE_ID_ENG 0x0409
+
+enum {
+  DTYPE_Device        = 0x01,
+  DTYPE_Configuration = 0x02,
+  DTYPE_String        = 0x03,
+  DTYPE_Interface     = 0x04,
+  DTYPE_Endpoint      = 0x05
+};
+
+#define USB_CONFIG_ATTR_RESERVED     0x80
+#define USB_CONFIG_ATTR_SELFPOWERED  0x40
+#define USB_CONFIG_ATTR_REMOTEWAKEUP 0x20
+#define USB_CONFIG_POWER_MA(mA)      ((mA) >> 1)
+
+#define USB_CSCP_NoDeviceClass          0x00
+#define USB_CSCP_NoDeviceSubclass       0x00
+#define USB_CSCP_NoDeviceProtocol       0x00
+#define USB_CSCP_VendorSpecificClass    0xFF
+#define USB_CSCP_VendorSpecificSubclass 0xFF
+#define USB_CSCP_VendorSpecificProtocol 0xFF
+
+#define ENDPOINT_DIR_IN        0x80
+#define ENDPOINT_DIR_OUT       0x00
+#define ENDPOINT_EPNUM_MASK    0x0F
+#define ENDPOINT_CONTROLEP     0
+#define ENDPOINT_ATTR_NO_SYNC  (0 << 2)
+#define ENDPOINT_USAGE_DATA    (0 << 4)
+#define EP_TYPE_CONTROL        0x00
+#define EP_TYPE_ISOCHRONOUS    0x01
+#define EP_TYPE_BULK           0x02
+#define EP_TYPE_INTERRUPT      0x03
+
+// HID class
+#define HID_CSCP_HIDClass             0x03
+#define HID_CSCP_NonBootSubclass      0x00
+#define HID_CSCP_BootSubclass         0x01
+#define HID_CSCP_NonBootProtocol      0x00
+#define HID_CSCP_KeyboardBootProtocol 0x01
+#define HID_CSCP_MouseBootProtocol    0x02
+
+enum {
+  HID_DTYPE_HID    = 0x21,
+  HID_DTYPE_Report = 0x22
+};
+
+typedef struct {
+  USB_Descriptor_Header_t Header;
+  uint16_t HIDSpec;
+  uint8_t  CountryCode;
+  uint8_t  TotalReportDescriptors;
+  uint8_t  HIDReportType;
+  uint16_t HIDReportLength;
+} ATTR_PACKED USB_HID_Descriptor_HID_t;
+
+typedef uint8_t USB_Descriptor_HIDReport_Datatype_t;
+
+typedef struct {
+  uint8_t Button;
+  int8_t  X;
+  int8_t  Y;
+} ATTR_PACKED USB_MouseReport_Data_t;
+
+typedef struct {
+  uint8_t Modifier;
+  uint8_t Reserved;
+  uint8_t KeyCode[6];
+} ATTR_PACKED USB_KeyboardReport_Data_t;
+
+enum {
+  HID_REQ_GetReport   = 0x01,
+  HID_REQ_GetIdle     = 0x02,
+  HID_REQ_GetProtocol = 0x03,
+  HID_REQ_SetReport   = 0x09,
+  HID_REQ_SetIdle     = 0x0A,
+  HID_REQ_SetProtocol = 0x0B
+};
+
+enum {
+  HID_REPORT_ITEM_In      = 0,
+  HID_REPORT_ITEM_Out     = 1,
+  HID_REPORT_ITEM_Feature = 2
+};
+
+// HID report items
+#define HID_RI_DATA_SIZE_MASK   0x03
+#define HID_RI_TYPE_MASK        0x0C
+#define HID_RI_TAG_MASK         0xF0
+#define HID_RI_TYPE_MAIN        0x00
+#define HID_RI_TYPE_GLOBAL      0x04
+#define HID_RI_TYPE_LOCAL       0x08
+#define HID_RI_DATA_BITS_0      0x00
+#define HID_RI_DATA_BITS_8      0x01
+#define HID_RI_DATA_BITS_16     0x02
+#define HID_RI_DATA_BITS_32     0x03
+#define HID_RI_DATA_BITS(DataBits) CONCAT_EXPANDED(HID_RI_DATA_BITS_, DataBits)
+#define _HID_RI_ENCODE_0(Data)
+#define _HID_RI_ENCODE_8(Data)  , ((Data) & 0xFF)
+#define _HID_RI_ENCODE_16(Data) _HID_RI_ENCODE_8(Data) _HID_RI_ENCODE_8((Data) >> 8)
+#define _HID_RI_ENCODE_32(Data) _HID_RI_ENCODE_16(Data) _HID_RI_ENCODE_16((Data) >> 16)
+#define _HID_RI_ENCODE(DataBits, ...) CONCAT_EXPANDED(_HID_RI_ENCODE_, DataBits)(__VA_ARGS__)
+#define _HID_RI_ENTRY(Type, Tag, DataBits, ...) \
+  ((Type) | (Tag) | HID_RI_DATA_BITS(DataBits)) _HID_RI_ENCODE(DataBits, (__VA_ARGS__))
+
+#define HID_RI_INPUT(DataBits, ...)            _HID_RI_ENTRY(HID_RI_TYPE_MAIN  , 0x80, DataBits, __VA_ARGS__)
+#define HID_RI_OUTPUT(DataBits, ...)           _HID_RI_ENTRY(HID_RI_TYPE_MAIN  , 0x90, DataBits, __VA_ARGS__)
+#define HID_RI_COLLECTION(DataBits, ...)       _HID_RI_ENTRY(HID_RI_TYPE_MAIN  , 0xA0, DataBits, __VA_ARGS__)
+#define HID_RI_FEATURE(DataBits, ...)          _HID_RI_ENTRY(HID_RI_TYPE_MAIN  , 0xB0, DataBits, __VA_ARGS__)
+#define HID_RI_END_COLLECTION(DataBits, ...)   _HID_RI_ENTRY(HID_RI_TYPE_MAIN  , 0xC0, DataBits, __VA_ARGS__)
+#define HID_RI_USAGE_PAGE(DataBits, ...)       _HID_RI_ENTRY(HID_RI_TYPE_GLOBAL, 0x00, DataBits, __VA_ARGS__)
+#define HID_RI_LOGICAL_MINIMUM(DataBits, ...)  _HID_RI_ENTRY(HID_RI_TYPE_GLOBAL, 0x10, DataBits, __VA_ARGS__)
+#define HID_RI_LOGICAL_MAXIMUM(DataBits, ...)  _HID_RI_ENTRY(HID_RI_TYPE_GLOBAL, 0x20, DataBits, __VA_ARGS__)
+#define HID_RI_PHYSICAL_MINIMUM(DataBits, ...) _HID_RI_ENTRY(HID_RI_TYPE_GLOBAL, 0x30, DataBits, __VA_ARGS__)
+#define HID_RI_PHYSICAL_MAXIMUM(DataBits, ...) _HID_RI_ENTRY(HID_RI_TYPE_GLOBAL, 0x40, DataBits, __VA_ARGS__)
+#define HID_RI_UNIT_EXPONENT(DataBits, ...)    _HID_RI_ENTRY(HID_RI_TYPE_GLOBAL, 0x50, DataBits, __VA_ARGS__)
+#define HID_RI_UNIT(DataBits, ...)             _HID_RI_ENTRY(HID_RI_TYPE_GLOBAL, 0x60, DataBits, __VA_ARGS__)
+#define HID_RI_REPORT_SIZE(DataBits, ...)      _HID_RI_ENTRY(HID_RI_TYPE_GLOBAL, 0x70, DataBits, __VA_ARGS__)
+#define HID_RI_REPORT_ID(DataBits, ...)        _HID_RI_ENTRY(HID_RI_TYPE_GLOBAL, 0x80, DataBits, __VA_ARGS__)
+#define HID_RI_REPORT_COUNT(DataBits, ...)     _HID_RI_ENTRY(HID_RI_TYPE_GLOBAL, 0x90, DataBits, __VA_ARGS__)
+#define HID_RI_USAGE(DataBits, ...)            _HID_RI_ENTRY(HID_RI_TYPE_LOCAL , 0x00, DataBits, __VA_ARGS__)
+#define HID_RI_USAGE_MINIMUM(DataBits, ...)    _HID_RI_ENTRY(HID_RI_TYPE_LOCAL , 0x10, DataBits, __VA_ARGS__)
+#define HID_RI_USAGE_MAXIMUM(DataBits, ...)    _HID_RI_ENTRY(HID_RI_TYPE_LOCAL , 0x20, DataBits, __VA_ARGS__)
+
+#define HID_IOF_CONSTANT         (1 << 0)
+#define HID_IOF_DATA             (0 << 0)
+#define HID_IOF_VARIABLE         (1 << 1)
+#define HID_IOF_ARRAY            (0 << 1)
+#define HID_IOF_RELATIVE         (1 << 2)
+#define HID_IOF_ABSOLUTE         (0 << 2)
+#define HID_IOF_WRAP             (1 << 3)
+#define HID_IOF_NO_WRAP          (0 << 3)
+#define HID_IOF_NON_LINEAR       (1 << 4)
+#define HID_IOF_LINEAR           (0 << 4)
+#define HID_IOF_NO_PREFERRED_STATE (1 << 5)
+#define HID_IOF_PREFERRED_STATE  (0 << 5)
+#define HID_IOF_NULLSTATE        (1 << 6)
+#define HID_IOF_NO_NULL_POSITION (0 << 6)
+#define HID_IOF_VOLATILE         (1 << 7)
+#define HID_IOF_NON_VOLATILE     (0 << 7)
+
+// Keyboard usages
+#define HID_KEYBOARD_MODIFIER_LEFTCTRL   (1 << 0)
+#define HID_KEYBOARD_MODIFIER_LEFTSHIFT  (1 << 1)
+#define HID_KEYBOARD_MODIFIER_LEFTALT    (1 << 2)
+#define HID_KEYBOARD_MODIFIER_LEFTGUI    (1 << 3)
+#define HID_KEYBOARD_MODIFIER_RIGHTCTRL  (1 << 4)
+#define HID_KEYBOARD_MODIFIER_RIGHTSHIFT (1 << 5)
+#define HID_KEYBOARD_MODIFIER_RIGHTALT   (1 << 6)
+#define HID_KEYBOARD_MODIFIER_RIGHTGUI   (1 << 7)
+
+#define HID_KEYBOARD_SC_A            0x04
+#define HID_KEYBOARD_SC_F            0x09
+#define HID_KEYBOARD_SC_M            0x10
+#define HID_KEYBOARD_SC_P            0x13
+#define HID_KEYBOARD_SC_ENTER        0x28
+#define HID_KEYBOARD_SC_ESCAPE       0x29
+#define HID_KEYBOARD_SC_BACKSPACE    0x2A
+#define HID_KEYBOARD_SC_TAB          0x2B
+#define HID_KEYBOARD_SC_SPACE        0x2C
+#define HID_KEYBOARD_SC_PAGE_UP      0x4B
+#define HID_KEYBOARD_SC_PAGE_DOWN    0x4E
+#define HID_KEYBOARD_SC_RIGHT_ARROW  0x4F
+#define HID_KEYBOARD_SC_LEFT_ARROW   0x50
+#define HID_KEYBOARD_SC_DOWN_ARROW   0x51
+#define HID_KEYBOARD_SC_UP_ARROW     0x52
+#define HID_KEYBOARD_SC_MUTE         0x7F
+#define HID_KEYBOARD_SC_VOLUME_UP    0x80
+#define HID_KEYBOARD_SC_VOLUME_DOWN  0x81
+
+// Control requests
+typedef struct {
+  uint8_t  bmRequestType;
+  uint8_t  bRequest;
+  uint16_t wValue;
+  uint16_t wIndex;
+  uint16_t wLength;
+} ATTR_PACKED USB_Request_Header_t;
+
+#define REQDIR_HOSTTODEVICE (0 << 7)
+#define REQDIR_DEVICETOHOST (1 << 7)
+#define REQTYPE_STANDARD    (0 << 5)
+#define REQTYPE_CLASS       (1 << 5)
+#define REQTYPE_VENDOR      (2 << 5)
+#define REQREC_DEVICE       (0 << 0)
+#define REQREC_INTERFACE    (1 << 0)
+#define REQREC_ENDPOINT     (2 << 0)
+
+enum {
+  REQ_GetStatus        = 0,
+  REQ_ClearFeature     = 1,
+  REQ_SetFeature       = 3,
+  REQ_SetAddress       = 5,
+  REQ_GetDescriptor    = 6,
+  REQ_SetDescriptor    = 7,
+  REQ_GetConfiguration = 8,
+  REQ_SetConfiguration = 9,
+  REQ_GetInterface     = 10,
+  REQ_SetInterface     = 11
+};
+
+enum USB_Device_States_t {
+  DEVICE_STATE_Unattached = 0,
+  DEVICE_STATE_Powered    = 1,
+  DEVICE_STATE_Default    = 2,
+  DEVICE_STATE_Addressed  = 3,
+  DEVICE_STATE_Configured = 4,
+  DEVICE_STATE_Suspended  = 5
+};
+
+enum Endpoint_Stream_RW_ErrorCodes_t {
+  ENDPOINT_RWSTREAM_NoError = 0
+};
+enum Endpoint_ControlStream_RW_ErrorCodes_t {
+  ENDPOINT_RWCSTREAM_NoError = 0
+};
+
+extern volatile uint8_t USB_DeviceState;
+extern USB_Request_Header_t USB_ControlRequest;
+extern bool USB_Device_RemoteWakeupEnabled;
+
+void USB_Init(void);
+void USB_USBTask(void);
+void USB_Device_EnableSOFEvents(void);
+void USB_Device_DisableSOFEvents(void);
+void USB_Device_SendRemoteWakeup(void);
+uint16_t USB_Device_GetFrameNumber(void);
+
+bool Endpoint_ConfigureEndpoint(uint8_t address, uint8_t type, uint16_t size, uint8_t banks);
+void Endpoint_SelectEndpoint(uint8_t address);
+uint8_t Endpoint_GetCurrentEndpoint(void);
+bool Endpoint_IsReadWriteAllowed(void);
+bool Endpoint_IsINReady(void);
+bool Endpoint_IsOUTReceived(void);
+uint8_t Endpoint_GetBusyBanks(void);
+uint16_t Endpoint_BytesInEndpoint(void);
+void Endpoint_ClearIN(void);
+void Endpoint_ClearOUT(void);
+void Endpoint_ClearSETUP(void);
+void Endpoint_ClearStatusStage(void);
+void Endpoint_StallTransaction(void);
+void Endpoint_ResetDataToggle(void);
+uint8_t Endpoint_Read_8(void);
+void Endpoint_Write_8(uint8_t data);
+void Endpoint_Write_16_LE(uint16_t data);
+void Endpoint_Write_32_LE(uint32_t data);
+uint8_t Endpoint_Write_Stream_LE(const void* buffer, uint16_t length, uint16_t* bytesProcessed);
+uint8_t Endpoint_Write_Control_Stream_LE(const void* buffer, uint16_t length);
+uint8_t Endpoint_Write_Control_PStream_LE(const void* buffer, uint16_t length);
+uint8_t Endpoint_Read_Control_Stream_LE(void* buffer, uint16_t length);
+
+void EVENT_USB_Device_Connect(void);
+void EVENT_USB_Device_Disconnect(void);
+void EVENT_USB_Device_ConfigurationChanged(void);
+void EVENT_USB_Device_ControlRequest(void);
+void EVENT_USB_Device_StartOfFrame(void);
+void EVENT_USB_Device_Suspend(void);
+void EVENT_USB_Device_WakeUp(void);
+void EVENT_USB_Device_Reset(void);
+
+#endif
@@ -0,0 +1,26 @@
+#ifndef HOST_AVR_EEPROM_H
+#define HOST_AVR_EEPROM_H
+
+// Host-side stand-in for <avr/eeprom.h>. EEMEM variables are ordinary memory,
+// gathered into a section of their own so that the simulation can erase them
+// (see shimEepromErase()); writes complete at once.
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+#define EEMEM __attribute__((section("eeprom")))
+
+#define eeprom_is_ready() 1
+
+static inline uint8_t eeprom_read_byte(const uint8_t* const p) {
+  return *p;
+}
+static inline void eeprom_read_block(void* const dst, const void* const src, const size_t n) {
+  memcpy(dst, src, n);
+}
+static inline void eeprom_write_byte(uint8_t* const p, const uint8_t value) {
+  *p = value;
+}
+
+#endif
@@ -0,0 +1,28 @@
+#ifndef HOST_AVR_INTERRUPT_H
+#define HOST_AVR_INTERRUPT_H
+
+// Host-side stand-in for <avr/interrupt.h>. Each ISR becomes an ordinary
+// function which the simulation driver calls when the corresponding hardware
+// event would have fired. The driver is single-threaded, so interrupts never
+// really nest; cli() and sei() just track the global interrupt flag.
+
+#include <avr/io.h>
+
+#define ISR(vector, ...) void vector(void); void vector(void)
+
+void INT0_vect(void);
+void INT1_vect(void);
+void INT2_vect(void);
+void INT4_vect(void);
+void TIMER1_CAPT_vect(void);
+void TIMER1_COMPA_vect(void);
+void TIMER1_COMPB_vect(void);
+void TIMER1_COMPC_vect(void);
+void TIMER1_OVF_vect(void);
+void TIMER0_COMPA_vect(void);
+void PCINT0_vect(void);
+
+#define sei() (SREG |= 0x80)
+#define cli() (SREG &= (uint8_t)~0x80)
+
+#endif
@@ -0,0 +1,93 @@
+#ifndef HOST_AVR_IO_H
+#define HOST_AVR_IO_H
+
+// Host-side stand-in for <avr/io.h>. Every I/O register the firmware touches
+// is an ordinary variable (defined in shim.c) which the simulation driver can
+// inspect and modify. Bit positions are those of the AT90USB162.
+
+#include <stdint.h>
+
+#define _BV(bit) (1 << (bit))
+
+#define bit_is_set(reg, bit)   ((reg) & _BV(bit))
+#define bit_is_clear(reg, bit) (!((reg) & _BV(bit)))
+
+// Ports
+extern volatile uint8_t PINB, DDRB, PORTB;
+extern volatile uint8_t PINC, DDRC, PORTC;
+extern volatile uint8_t PIND, DDRD, PORTD;
+
+// Status and control
+extern volatile uint8_t SREG, MCUSR, SMCR;
+#define WDRF 3
+#define SE   0
+#define SM0  1
+#define SM1  2
+#define SM2  3
+
+// External interrupts
+extern volatile uint8_t EICRA, EICRB, EIMSK, EIFR;
+#define ISC00 0
+#define ISC01 1
+#define ISC10 2
+#define ISC11 3
+#define ISC20 4
+#define ISC21 5
+#define ISC40 0
+#define ISC41 1
+#define INT0  0
+#define INT1  1
+#define INT2  2
+#define INT4  4
+#define INTF4 4
+
+// Pin-change interrupts
+extern volatile uint8_t PCICR, PCIFR, PCMSK0, PCMSK1;
+#define PCIE0 0
+#define PCIE1 1
+#define PCIF0 0
+
+// Timer0
+extern volatile uint8_t TCCR0A, TCCR0B, TCNT0, OCR0A, OCR0B, TIMSK0, TIFR0;
+#define WGM00  0
+#define WGM01  1
+#define CS00   0
+#define CS01   1
+#define CS02   2
+#define TOIE0  0
+#define OCIE0A 1
+#define OCF0A  1
+
+// Timer1
+extern volatile uint8_t TCCR1A, TCCR1B, TCCR1C, TIMSK1, TIFR1;
+extern volatile uint16_t TCNT1, OCR1A, OCR1B, OCR1C, ICR1;
+#define WGM10  0
+#define WGM11  1
+#define CS10   0
+#define CS11   1
+#define CS12   2
+#define WGM12  3
+#define WGM13  4
+#define ICES1  6
+#define ICNC1  7
+#define TOIE1  0
+#define OCIE1A 1
+#define OCIE1B 2
+#define OCIE1C 3
+#define ICIE1  5
+#define TOV1   0
+#define OCF1A  1
+#define OCF1B  2
+#define OCF1C  3
+#define ICF1   5
+
+// Power reduction
+extern volatile uint8_t PRR0, PRR1;
+#define PRTIM0 5
+#define PRTIM1 3
+#define PRSPI  2
+
+// EEPROM (see eeprom.h)
+#define E2END 0x1FF
+
+#endif
@@ -0,0 +1,24 @@
+#ifndef HOST_AVR_SLEEP_H
+#define HOST_AVR_SLEEP_H
+
+// Host-side stand-in for <avr/sleep.h>. Sleeping sets shimAsleep, and calls
+// the simulation driver's sleep hook (see shim.h), which runs the hardware
+// until an ISR is called (which wakes the CPU, and clears it); without one, the
+// driver skips main-loop iterations until then. In power-down, it also stops
+// Timer1 and ignores edges, but for INT4's low level (see SUSPEND_ENABLE).
+
+#include <stdbool.h>
+#include <avr/io.h>
+
+extern volatile bool shimAsleep;
+void shimSleep(void);
+
+#define SLEEP_MODE_IDLE     0
+#define SLEEP_MODE_PWR_DOWN _BV(SM1)
+
+#define set_sleep_mode(mode) (SMCR = (uint8_t)((SMCR & ~(_BV(SM0) | _BV(SM1) | _BV(SM2))) | (mode)))
+#define sleep_enable()       (SMCR |= _BV(SE))
+#define sleep_disable()      (SMCR &= (uint8_t)~_BV(SE))
+#define sleep_cpu()          shimSleep()
+
+#endif
@@ -0,0 +1,35 @@
+#include <string.h>
+#include "capturefile.h"
+
+void capturefileRead(CaptureFile* const file, const CapturePacket* const packet, const CapturePulse pulse, void* const context) {
+  if (file->started && packet->sequence != file->sequence) {
+    file->missed += (uint8_t)(packet->sequence - file->sequence);
+  }
+  file->started = true;
+  file->sequence = packet->sequence + 1;
+  file->lost += packet->lost;
+  for (uint8_t i = 0; i < packet->count && i < CAPTURE_ENTRIES; ++i) {
+    const bool mark = (packet->levels >> i) & 1;
+    if (!file->edged) {
+      // Wait for the first pulse
+      if (mark) {
+        file->edged = file->mark = true;
+        file->ticks = 0;
+      }
+      continue;
+    }
+    file->ticks += packet->ticks[i];  // 0 if unknown
+    if (mark != file->mark) {
+      pulse(context, file->mark, file->ticks);
+      file->mark = mark;
+      file->ticks = 0;
+    }
+  }
+}
+
+void capturefileEnd(CaptureFile* const file, const CapturePulse pulse, void* const context) {
+  if (file->edged && file->mark) {
+    pulse(context, true, file->ticks);
+  }
+  file->edged = false;
+}
@@ -0,0 +1,31 @@
+#ifndef HOST_CAPTUREFILE_H
+#define HOST_CAPTUREFILE_H
+
+// The firmware's capture packets (see capture.h) turned back into a run of
+// pulses and spaces, as in the traces (LIRC mode2 format), for ircapture and
+// the simulator. The space before the first pulse is left out, and a space
+// after the last of the firmware's timeouts only counts up to that timeout.
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "capture.h"
+
+// Called with each pulse (mark) or space once it has ended, in Timer1 ticks
+typedef void (*CapturePulse)(void* context, bool mark, uint64_t ticks);
+
+typedef struct {
+  bool     started;   // whether a packet has been read yet
+  uint8_t  sequence;  // the next packet expected
+  bool     edged;     // whether the first pulse has started
+  bool     mark;      // the detector output now
+  uint64_t ticks;     // ...and how long it has been so
+  unsigned missed;    // packets missed (gaps in the sequence numbers)
+  unsigned lost;      // entries dropped by the firmware
+} CaptureFile;
+
+void capturefileRead(CaptureFile* file, const CapturePacket* packet, CapturePulse pulse, void* context);
+
+// The end of the capture: finish off the pulse in progress, if any.
+void capturefileEnd(CaptureFile* file, CapturePulse pulse, void* context);
+
+#endif
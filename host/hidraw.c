@@ -0,0 +1,52 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <linux/hidraw.h>
+#include "hidraw.h"
+
+#define VENDOR_ID  0x03EB
+#define PRODUCT_ID 0x204D
+
+// Is this the vendor-defined interface of an Irate?
+static bool isIrate(const int fd) {
+  struct hidraw_devinfo info;
+  struct hidraw_report_descriptor desc;
+  int size;
+  if (ioctl(fd, HIDIOCGRAWINFO, &info) < 0 || (uint16_t)info.vendor != VENDOR_ID || (uint16_t)info.product != PRODUCT_ID) {
+    return false;
+  }
+  if (ioctl(fd, HIDIOCGRDESCSIZE, &size) < 0) {
+    return false;
+  }
+  desc.size = (uint32_t)size;
+  if (ioctl(fd, HIDIOCGRDESC, &desc) < 0) {
+    return false;
+  }
+  return desc.size >= 3 && desc.value[0] == 0x06 && desc.value[1] == 0x00 && desc.value[2] == 0xFF;
+}
+
+int hidrawOpenIrate(const char* const path) {
+  char name[32];
+  if (path) {
+    const int fd = open(path, O_RDWR);
+    if (fd < 0) {
+      perror(path);
+    }
+    return fd;
+  }
+  for (int i = 0; i < 64; ++i) {
+    snprintf(name, sizeof(name), "/dev/hidraw%d", i);
+    const int fd = open(name, O_RDWR);
+    if (fd >= 0) {
+      if (isIrate(fd)) {
+        return fd;
+      }
+      close(fd);
+    }
+  }
+  fprintf(stderr, "No Irate with a vendor-defined interface found\n");
+  return -1;
+}
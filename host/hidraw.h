@@ -0,0 +1,11 @@
+#ifndef HOST_HIDRAW_H
+#define HOST_HIDRAW_H
+
+// Finding an Irate's vendor-defined HID interface through Linux's hidraw driver
+
+// Open the given hidraw device or, if path is NULL, the first one which is the
+// vendor-defined interface of an Irate. Returns the file descriptor, or -1
+// (having said why).
+int hidrawOpenIrate(const char* path);
+
+#endif
@@ -0,0 +1,461 @@
+// Decoder benchmark. Synthesises frames of every enabled protocol, with random
+// button-codes, and perturbs them the way real receivers and rooms do: timing
+// jitter, the detector stretching its marks, and short noise pulses (e.g from
+// fluorescent lighting) in the spaces and the marks. The frames are fed to the
+// firmware's decoder through its edge ISR, and each condition's decode success
+// rate (frames which produced a press of the right code) and false-positive
+// rate (presses of any other code) is reported. Some conditions are of a remote
+// whose clock runs slow or fast; each follows on from the last, so the decoders
+// carry what they learned of the timing from one to the next, as they would
+// when the remote changes. Then the timing margins, and what was learned, are
+// reported.
+//
+// The corpus is generated from a fixed seed, so runs are repeatable; compare
+// builds with e.g "make bench CFLAGS=-DIR_GLITCH_FILTER=0" (or IR_CALIBRATE=0).
+//
+// Usage: irbench [-q] [-n <frames>] [-s <seed>]
+//
+// Exits non-zero if any clean frame fails to decode, or decodes wrongly.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include "IrateConfig.h"
+#include "ir.h"
+#include "irproto.h"
+
+#define TICKS_PER_US  2     // Timer1 runs at 2MHz
+#define LOOP_TICKS    20    // irPoll() every 10us, as in the main loop
+#define GAP_US        40000 // silence before each frame: longer than a timeout
+#define MIN_PULSE_US  20    // nothing the detector outputs is shorter
+#define CUT_OFF_US    3000  // space between a cut-off frame and the next
+#define MAX_PULSES    512
+
+typedef struct {
+  const char* name;
+  double jitter;    // each pulse varies by up to this fraction of its width...
+  double wobble;    // ...plus or minus up to this many us
+  double stretch;   // marks come out this many us longer, spaces shorter
+  double spikes;    // noise marks per ms of space
+  double dropouts;  // noise spaces per ms of mark
+  double noiseMax;  // the noise pulses are up to this many us long
+  double cutOff;    // the chance a frame cuts off the end of another
+  double skew;      // the remote's clock is slow by this fraction (fast if negative)
+} Condition;
+
+static const Condition conditions[] = {
+  {"clean",       0.00,  0,   0, 0.0, 0.0,  0, 0.0, 0.00},
+  {"jitter",      0.10, 40,   0, 0.0, 0.0,  0, 0.0, 0.00},
+  {"stretch",     0.05, 20, 120, 0.0, 0.0,  0, 0.0, 0.00},
+  {"spikes",      0.00,  0,   0, 0.5, 0.0, 80, 0.0, 0.00},
+  {"dropouts",    0.00,  0,   0, 0.0, 0.5, 80, 0.0, 0.00},
+  {"cut-off",     0.00,  0,   0, 0.0, 0.0,  0, 0.5, 0.00},
+  {"fluorescent", 0.08, 30,  60, 1.0, 0.3, 80, 0.1, 0.00},
+  {"slow",        0.02, 10,   0, 0.0, 0.0,  0, 0.0, 0.20},
+  {"fast",        0.02, 10,   0, 0.0, 0.0,  0, 0.0,-0.20},
+  {"slow+stretch",0.02, 10, 120, 0.0, 0.0,  0, 0.0, 0.10},
+  {"fast+stretch",0.02, 10, 120, 0.0, 0.0,  0, 0.0,-0.10},
+};
+#define NUM_CONDITIONS (sizeof(conditions) / sizeof(conditions[0]))
+
+typedef struct {
+  bool     mark;
+  double   us;
+} Pulse;
+
+typedef struct {
+  Pulse    pulses[MAX_PULSES];
+  unsigned count;
+} Train;
+
+typedef struct {
+  const char* name;
+  uint8_t     protocol;
+  void      (*encode)(Train* train, const IrCode* code, bool toggle);
+  uint8_t     cmdBits;
+  uint8_t     addrBits;
+} Encoder;
+
+// irPoll() is called on every iteration, so the work ir.c flags is ignored
+volatile uint8_t schedWork;
+
+static uint64_t seed = 1;
+static uint64_t now;  // simulated time, in Timer1 ticks
+static bool quiet = false;
+
+// Called by the decoder for each new button-code: every one is pressed at once
+uint8_t irConfirmMode(const IrCode* const code) {
+  (void)code;
+  return IR_CONFIRM_NONE;
+}
+
+// ...and every remote is wanted
+bool irWanted(const IrCode* const code) {
+  (void)code;
+  return true;
+}
+
+// xorshift64*
+static uint64_t rnd(void) {
+  seed ^= seed >> 12;
+  seed ^= seed << 25;
+  seed ^= seed >> 27;
+  return seed * 2685821657736338717ULL;
+}
+static double uniform(const double lo, const double hi) {
+  return lo + (hi - lo) * (double)(rnd() >> 11) / (double)(1ULL << 53);
+}
+
+static void add(Train* const train, const bool mark, const double us) {
+  if (train->count && train->pulses[train->count - 1].mark == mark) {
+    train->pulses[train->count - 1].us += us;
+  } else if (train->count < MAX_PULSES) {
+    train->pulses[train->count].mark = mark;
+    train->pulses[train->count].us = us;
+    ++train->count;
+  }
+}
+
+#if IR_USE_SIRC12 || IR_USE_SIRC15 || IR_USE_SIRC20
+static void encodeSirc(Train* const train, const IrCode* const code, const uint8_t bits) {
+  const uint32_t value = code->command | ((uint32_t)code->address << 7);
+  add(train, true, 2400);
+  for (uint8_t i = 0; i < bits; ++i) {
+    add(train, false, 600);
+    add(train, true, ((value >> i) & 1) ? 1200 : 600);
+  }
+}
+#endif
+#if IR_USE_SIRC12
+static void encodeSirc12(Train* const train, const IrCode* const code, const bool toggle) {
+  (void)toggle;
+  encodeSirc(train, code, 12);
+}
+#endif
+#if IR_USE_SIRC15
+static void encodeSirc15(Train* const train, const IrCode* const code, const bool toggle) {
+  (void)toggle;
+  encodeSirc(train, code, 15);
+}
+#endif
+#if IR_USE_SIRC20
+static void encodeSirc20(Train* const train, const IrCode* const code, const bool toggle) {
+  (void)toggle;
+  encodeSirc(train, code, 20);
+}
+#endif
+
+#if IR_USE_NEC
+static void encodeNec(Train* const train, const IrCode* const code, const bool toggle) {
+  const uint8_t address = (uint8_t)code->address;
+  const uint32_t value =
+    address | ((uint32_t)(uint8_t)~address << 8) |
+    ((uint32_t)code->command << 16) | ((uint32_t)(uint8_t)~code->command << 24);
+  (void)toggle;
+  add(train, true, 9000);
+  add(train, false, 4500);
+  for (uint8_t i = 0; i < 32; ++i) {
+    add(train, true, 562);
+    add(train, false, ((value >> i) & 1) ? 1687 : 562);
+  }
+  add(train, true, 562);
+}
+#endif
+
+#if IR_USE_RC5 || IR_USE_RC6
+// A biphase bit: "1" is the given level first
+static void biphase(Train* const train, const bool bit, const bool oneFirst, const double half) {
+  add(train, bit == oneFirst, half);
+  add(train, bit != oneFirst, half);
+}
+#endif
+
+#if IR_USE_RC5
+static void encodeRc5(Train* const train, const IrCode* const code, const bool toggle) {
+  const uint16_t value =
+    (1U << 13) | ((code->command & 0x40) ? 0 : (1U << 12)) | (toggle ? (1U << 11) : 0) |
+    ((code->address & 0x1F) << 6) | (code->command & 0x3F);
+  for (int8_t i = 13; i >= 0; --i) {
+    biphase(train, (value >> i) & 1, false, 889);
+  }
+  if (!train->pulses[0].mark) {
+    // The first half of the first start bit is lost in the silence before it
+    memmove(train->pulses, train->pulses + 1, --train->count * sizeof(Pulse));
+  }
+}
+#endif
+
+#if IR_USE_RC6
+static void encodeRc6(Train* const train, const IrCode* const code, const bool toggle) {
+  const uint16_t value = (uint16_t)((code->address << 8) | code->command);
+  add(train, true, 2666);
+  add(train, false, 889);
+  biphase(train, true, true, 444);  // start bit
+  for (uint8_t i = 0; i < 3; ++i) {
+    biphase(train, false, true, 444);  // mode 0
+  }
+  biphase(train, toggle, true, 888);
+  for (int8_t i = 15; i >= 0; --i) {
+    biphase(train, (value >> i) & 1, true, 444);
+  }
+}
+#endif
+
+static const Encoder encoders[] = {
+#if IR_USE_SIRC12
+  {"SIRC-12", IR_PROTO_SIRC12, encodeSirc12, 7, 5},
+#endif
+#if IR_USE_SIRC15
+  {"SIRC-15", IR_PROTO_SIRC15, encodeSirc15, 7, 8},
+#endif
+#if IR_USE_SIRC20
+  {"SIRC-20", IR_PROTO_SIRC20, encodeSirc20, 7, 13},
+#endif
+#if IR_USE_NEC
+  {"NEC",     IR_PROTO_NEC,    encodeNec,    8, 8},
+#endif
+#if IR_USE_RC5
+  {"RC5",     IR_PROTO_RC5,    encodeRc5,    7, 5},
+#endif
+#if IR_USE_RC6
+  {"RC6",     IR_PROTO_RC6,    encodeRc6,    8, 8},
+#endif
+};
+#define NUM_ENCODERS (sizeof(encoders) / sizeof(encoders[0]))
+
+// Perturb a clean pulse train (which starts and ends with a mark), and turn it
+// into edge times. Noise pulses are dropped into the silence before the frame
+// as well as the frame itself. Returns the number of edges.
+static unsigned perturb(const Condition* const c, const Train* const in, uint64_t* const edges, const unsigned max) {
+  Train out = {.count = 0};
+  add(&out, false, GAP_US);
+  for (unsigned i = 0; i < in->count; ++i) {
+    const Pulse* const p = &in->pulses[i];
+    double us = p->us * (1 + c->skew) * (1 + uniform(-c->jitter, c->jitter)) + uniform(-c->wobble, c->wobble);
+    us += p->mark ? c->stretch : -c->stretch;
+    add(&out, p->mark, us < MIN_PULSE_US ? MIN_PULSE_US : us);
+  }
+  add(&out, false, 0);
+
+  // Now the noise: each pulse may be broken up by short pulses of the other
+  // level, at random places
+  unsigned count = 0;
+  double t = 0;
+  for (unsigned i = 0; i < out.count; ++i) {
+    const Pulse* const p = &out.pulses[i];
+    const double rate = p->mark ? c->dropouts : c->spikes;
+    double start = t;
+    const double end = t + p->us;
+    for (double at = start + uniform(0, 2000 / rate); rate > 0 && at < end; at += uniform(0, 2000 / rate)) {
+      const double width = uniform(MIN_PULSE_US, c->noiseMax);
+      if (at - start < MIN_PULSE_US || at + width > end - MIN_PULSE_US) {
+        continue;
+      }
+      if (count + 2 <= max) {
+        edges[count++] = (uint64_t)(at * TICKS_PER_US);
+        edges[count++] = (uint64_t)((at + width) * TICKS_PER_US);
+      }
+      start = at + width;
+    }
+    t = end;
+    if (i + 1 < out.count && count < max) {
+      edges[count++] = (uint64_t)(t * TICKS_PER_US);  // the end of this pulse
+    }
+  }
+  return count;
+}
+
+// Run the firmware until the given time, calling irPoll() as the main loop
+// would, and firing the timeout compare when it matches
+static void runTo(const uint64_t until) {
+  while (now < until) {
+    uint64_t next = now + LOOP_TICKS - (now % LOOP_TICKS);
+    if (next > until) {
+      next = until;
+    }
+    const uint16_t due = (uint16_t)(OCR1A - TCNT1);
+    if ((TIMSK1 & _BV(OCIE1A)) && due != 0 && due <= next - now) {
+      now += due;
+      TCNT1 = OCR1A;
+      TIMER1_COMPA_vect();
+      continue;
+    }
+    now = next;
+    TCNT1 = (uint16_t)now;
+    if ((now % LOOP_TICKS) == 0) {
+      irPoll();
+    }
+  }
+}
+
+// Apply an edge of the detector output to PC7, as the hardware would
+static void applyEdge(const bool mark) {
+  if (mark) {
+    PINC &= (uint8_t)~_BV(7);
+  } else {
+    PINC |= _BV(7);
+  }
+  if ((TIMSK1 & _BV(ICIE1)) && !mark == !!(TCCR1B & _BV(ICES1))) {
+    ICR1 = TCNT1;
+    TIMER1_CAPT_vect();
+  }
+  if (EIMSK & _BV(INT4)) {
+    INT4_vect();
+  }
+}
+
+// What the decoder for the given protocol has learned
+static IrTiming timingOf(const uint8_t protocol) {
+  IrTiming timing = {.protocol = IR_PROTO_NONE};
+  for (uint8_t i = 0; i < IRPROTO_COUNT; ++i) {
+    irprotoTiming(i, &timing);
+    if (timing.protocol == protocol) {
+      break;
+    }
+  }
+  return timing;
+}
+
+static bool sameCode(const IrCode* const a, const IrCode* const b) {
+  return a->protocol == b->protocol && a->address == b->address && a->command == b->command;
+}
+
+// Run every condition over every protocol, and print the table. Returns false
+// if any clean frame failed to decode, or decoded wrongly.
+static bool bench(const unsigned frames) {
+  static uint64_t edges[4 * MAX_PULSES];
+  static IrTiming learned[NUM_CONDITIONS][NUM_ENCODERS];
+  static double margins[NUM_CONDITIONS][NUM_ENCODERS];  // mean, of the frames decoded
+  bool ok = true;
+  printf("%-12s", "");
+  for (unsigned e = 0; e < NUM_ENCODERS; ++e) {
+    printf(" %15s", encoders[e].name);
+  }
+  printf(" | %8s %9s %7s\n", "glitches", "undecoded", "resyncs");
+
+  for (unsigned c = 0; c < NUM_CONDITIONS; ++c) {
+    const Condition* const cond = &conditions[c];
+    IrStats before, after;
+    irGetStats(&before);
+    printf("%-12s", cond->name);
+    for (unsigned e = 0; e < NUM_ENCODERS; ++e) {
+      const Encoder* const enc = &encoders[e];
+      IrCode last = {IR_PROTO_NONE, 0, 0};
+      unsigned decoded = 0, wrong = 0;
+      double margin = 0;
+      for (unsigned f = 0; f < frames; ++f) {
+        // A different code each time, so each frame is a new press
+        IrCode code;
+        do {
+          code.protocol = enc->protocol;
+          code.command = (uint8_t)(rnd() & ((1U << enc->cmdBits) - 1));
+          code.address = (uint16_t)(rnd() & ((1U << enc->addrBits) - 1));
+        } while (sameCode(&code, &last));
+        last = code;
+
+        Train train = {.count = 0};
+        if (uniform(0, 1) < cond->cutOff) {
+          // Start with the beginning of some other frame
+          const IrCode other = {enc->protocol, (uint8_t)~code.command, code.address};
+          enc->encode(&train, &other, !(f & 1));
+          train.count = 1 + 2 * (unsigned)uniform(0, train.count / 2);
+          add(&train, false, CUT_OFF_US);
+        }
+        enc->encode(&train, &code, f & 1);
+        const unsigned count = perturb(cond, &train, edges, sizeof(edges) / sizeof(edges[0]));
+        const uint64_t start = now;
+        for (unsigned i = 0; i < count; ++i) {
+          runTo(start + edges[i]);
+          applyEdge(!(i & 1));
+        }
+        runTo(start + edges[count - 1] + GAP_US * TICKS_PER_US);
+
+        bool found = false;
+        IrEvent event;
+        while (irGetEvent(&event)) {
+          if (event.type != IR_EVENT_PRESS) {
+            continue;
+          }
+          if (sameCode(&event.code, &code) && !found) {
+            found = true;
+          } else {
+            ++wrong;
+            if (!quiet) {
+              fprintf(
+                stderr, "%s %s: sent %02X/%04X, got %u %02X/%04X\n", cond->name, enc->name,
+                code.command, code.address, event.code.protocol, event.code.command, event.code.address
+              );
+            }
+          }
+        }
+        if (found) {
+          ++decoded;
+          margin += timingOf(enc->protocol).margin;
+        }
+      }
+      learned[c][e] = timingOf(enc->protocol);
+      margins[c][e] = decoded ? margin / decoded / TICKS_PER_US : 0;
+      printf(" %7.1f%% %5.1f%%", 100.0 * decoded / frames, 100.0 * wrong / frames);
+      if (c == 0 && (decoded != frames || wrong)) {
+        ok = false;
+      }
+    }
+    irGetStats(&after);
+    printf(
+      " | %8u %9u %7u\n",
+      (uint16_t)(after.glitches - before.glitches), (uint16_t)(after.undecoded - before.undecoded),
+      (uint16_t)(after.resyncs - before.resyncs)
+    );
+  }
+  printf("\n(each protocol: decoded correctly, then decoded wrongly, as %% of %u frames)\n\n", frames);
+
+  printf("%-12s", "");
+  for (unsigned e = 0; e < NUM_ENCODERS; ++e) {
+    printf(" %17s", encoders[e].name);
+  }
+  printf("\n");
+  for (unsigned c = 0; c < NUM_CONDITIONS; ++c) {
+    printf("%-12s", conditions[c].name);
+    for (unsigned e = 0; e < NUM_ENCODERS; ++e) {
+      const IrTiming* const t = &learned[c][e];
+      printf(" %5.0f %+6.1f%% %3d", margins[c][e], 100.0 * t->clock / 1024 - 100, t->stretch / TICKS_PER_US);
+    }
+    printf("\n");
+  }
+  printf(
+    "\n(each protocol: mean margin of the frames decoded, in us; then the remote's\n"
+    "clock and the receiver's stretch in us, as learned by the end)\n"
+  );
+  return ok;
+}
+
+int main(int argc, char* argv[]) {
+  unsigned frames = 500;
+  for (int i = 1; i < argc; ++i) {
+    if (!strcmp(argv[i], "-q")) {
+      quiet = true;
+    } else if (!strcmp(argv[i], "-n") && i + 1 < argc) {
+      frames = (unsigned)atoi(argv[++i]);
+    } else if (!strcmp(argv[i], "-s") && i + 1 < argc) {
+      seed = strtoull(argv[++i], NULL, 0);
+    } else {
+      fprintf(stderr, "Usage: %s [-q] [-n <frames>] [-s <seed>]\n", argv[0]);
+      return 2;
+    }
+  }
+  if (frames == 0 || seed == 0) {
+    fprintf(stderr, "%s: frames and seed must be non-zero\n", argv[0]);
+    return 2;
+  }
+
+  // Reset the hardware, and start the decoder as main() does
+  PINB = PINC = PIND = 0xFF;
+  PORTB = PORTC = PORTD = 0xFF;
+  irInit();
+  sei();
+  return bench(frames) ? 0 : 1;
+}
@@ -0,0 +1,119 @@
+// Capture the raw IR edges seen by an Irate (see capture.h) through Linux's
+// hidraw driver, and write them out as a trace which the simulator can replay.
+//
+// Usage: ircapture [-t <seconds>] [-o <file>] [/dev/hidrawN]
+//
+// Capture is switched on, and the pulses and spaces are written (in LIRC's
+// mode2 format, to stdout unless a file is given) until interrupted, or for
+// the given time; then it is switched off again. Add "expect" lines to the
+// trace for the reports it should produce. With no device given, the first
+// hidraw device with Irate's vendor and product IDs and a vendor-defined usage
+// page is used.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <linux/hidraw.h>
+#include "hidraw.h"
+#include "capturefile.h"
+
+#define TICKS_PER_US (F_CPU / 8 / 1000000)  // Timer1 runs at F_CPU/8
+
+static volatile sig_atomic_t interrupted = 0;
+
+static void onInterrupt(const int sig) {
+  (void)sig;
+  interrupted = 1;
+}
+
+static void writePulse(void* const context, const bool mark, const uint64_t ticks) {
+  fprintf(context, "%s %llu\n", mark ? "pulse" : "space", (unsigned long long)((ticks + TICKS_PER_US / 2) / TICKS_PER_US));
+}
+
+static bool setCapture(const int fd, const bool enabled) {
+  CaptureControl control = {CAPTURE_REPORT_ID, enabled};
+  if (ioctl(fd, HIDIOCSFEATURE(sizeof(control)), &control) < 0) {
+    perror("HIDIOCSFEATURE (is it built with CAPTURE_ENABLE?)");
+    return false;
+  }
+  return true;
+}
+
+int main(int argc, char* argv[]) {
+  const char* path = NULL;
+  const char* outPath = NULL;
+  unsigned seconds = 0;
+  for (int i = 1; i < argc; ++i) {
+    if (!strcmp(argv[i], "-t") && i + 1 < argc) {
+      seconds = (unsigned)atoi(argv[++i]);
+    } else if (!strcmp(argv[i], "-o") && i + 1 < argc) {
+      outPath = argv[++i];
+    } else if (argv[i][0] != '-') {
+      path = argv[i];
+    } else {
+      fprintf(stderr, "Usage: %s [-t <seconds>] [-o <file>] [/dev/hidrawN]\n", argv[0]);
+      return 2;
+    }
+  }
+  FILE* const out = outPath ? fopen(outPath, "w") : stdout;
+  if (!out) {
+    perror(outPath);
+    return 1;
+  }
+  const int fd = hidrawOpenIrate(path);
+  if (fd < 0) {
+    return 1;
+  }
+
+  // Without SA_RESTART, so the interrupt (or alarm) ends the read()
+  struct sigaction action;
+  memset(&action, 0, sizeof(action));
+  action.sa_handler = onInterrupt;
+  sigaction(SIGINT, &action, NULL);
+  sigaction(SIGALRM, &action, NULL);
+  if (!setCapture(fd, true)) {
+    return 1;
+  }
+  if (seconds) {
+    alarm(seconds);
+  }
+  fprintf(stderr, "Capturing; %s\n", seconds ? "waiting" : "interrupt to stop");
+  fprintf(out, "# Captured by ircapture\n");
+
+  CaptureFile file;
+  memset(&file, 0, sizeof(file));
+  unsigned dropped = 0;
+  while (!interrupted) {
+    CapturePacket packet;
+    const ssize_t length = read(fd, &packet, sizeof(packet));
+    if (length < 0) {
+      if (errno != EINTR) {
+        perror("read");
+        break;
+      }
+    } else if (length == (ssize_t)sizeof(packet) && packet.reportId == CAPTURE_REPORT_ID) {
+      capturefileRead(&file, &packet, writePulse, out);
+      if (file.missed + file.lost != dropped) {
+        fprintf(out, "# edges were lost here\n");
+        dropped = file.missed + file.lost;
+      }
+    }
+  }
+  capturefileEnd(&file, writePulse, out);
+  setCapture(fd, false);
+  close(fd);
+  if (out != stdout) {
+    fclose(out);
+  }
+  if (dropped) {
+    fprintf(stderr, "%u packets missed, %u entries dropped by the device\n", file.missed, file.lost);
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,148 @@
+// Show or replace the keymap of an Irate (a build with KEYMAP_CAPACITY, the
+// default) through Linux's hidraw driver, without reflashing it.
+//
+// Usage: irkeymap [-r] [-d /dev/hidrawN] [<file>]
+//
+// With a file ("-" for stdin), the keymap is replaced by the entries in it: one
+// "key <entry>" line for each (see keyfile.h), as in the traces. With -r, the
+// built-in keymap is restored. The keymap in use is then shown. With no device
+// given, the first hidraw device with Irate's vendor and product IDs and a
+// vendor-defined usage page is used.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <linux/hidraw.h>
+#include "hidraw.h"
+#include "keyfile.h"
+#include "keymap.h"
+
+#define RETRY_US 1000
+
+static bool getReport(const int fd, KeymapReport* const report) {
+  memset(report, 0, sizeof(*report));
+  report->reportId = KEYMAP_REPORT_ID;
+  if (ioctl(fd, HIDIOCGFEATURE(sizeof(*report)), report) != (int)sizeof(*report)) {
+    perror("HIDIOCGFEATURE (is it built with KEYMAP_CAPACITY?)");
+    return false;
+  }
+  return true;
+}
+
+// One step of an update (see keymap.h). The device refuses it while it is still
+// writing the last one, so wait until it is idle again. Returns the new state,
+// or -1 on error.
+static int step(const int fd, const uint8_t op, const uint8_t index, const KeymapEntry* const entry) {
+  KeymapReport report;
+  memset(&report, 0, sizeof(report));
+  report.reportId = KEYMAP_REPORT_ID;
+  report.op = op;
+  report.index = index;
+  if (entry) {
+    report.entry = *entry;
+  }
+  while (ioctl(fd, HIDIOCSFEATURE(sizeof(report)), &report) < 0) {
+    if (errno != EPIPE) {
+      perror("HIDIOCSFEATURE");
+      return -1;
+    }
+    usleep(RETRY_US);
+  }
+  do {
+    usleep(RETRY_US);
+    if (!getReport(fd, &report)) {
+      return -1;
+    }
+  } while (report.op == KEYMAP_BUSY);
+  return report.op;
+}
+
+// Read the keymap file. Returns the number of entries, or -1 on error.
+static int readKeymap(const char* const path, KeymapEntry* const entries, const unsigned capacity) {
+  FILE* const in = strcmp(path, "-") ? fopen(path, "r") : stdin;
+  char line[256];
+  unsigned lineNum = 0, count = 0;
+  if (!in) {
+    perror(path);
+    return -1;
+  }
+  while (fgets(line, sizeof(line), in)) {
+    char word[16];
+    const char* error;
+    int used;
+    ++lineNum;
+    char* const hash = strchr(line, '#');
+    if (hash) {
+      *hash = '\0';
+    }
+    if (sscanf(line, " %15s%n", word, &used) != 1) {
+      continue;
+    }
+    if (strcmp(word, "key")) {
+      fprintf(stderr, "%s:%u: unrecognised \"%s\"\n", path, lineNum, word);
+      return -1;
+    }
+    if (count == capacity) {
+      fprintf(stderr, "%s:%u: more than %u entries\n", path, lineNum, capacity);
+      return -1;
+    }
+    if (!keyfileParse(line + used, &entries[count++], &error)) {
+      fprintf(stderr, "%s:%u: %s\n", path, lineNum, error);
+      return -1;
+    }
+  }
+  if (in != stdin) {
+    fclose(in);
+  }
+  return (int)count;
+}
+
+int main(int argc, char* argv[]) {
+  KeymapReport report;
+  KeymapEntry entries[256];
+  const char* path = NULL;
+  const char* file = NULL;
+  bool restore = false;
+  for (int i = 1; i < argc; ++i) {
+    if (!strcmp(argv[i], "-r")) {
+      restore = true;
+    } else if (!strcmp(argv[i], "-d") && i + 1 < argc) {
+      path = argv[++i];
+    } else if (!file && (argv[i][0] != '-' || !strcmp(argv[i], "-"))) {
+      file = argv[i];
+    } else {
+      fprintf(stderr, "Usage: %s [-r] [-d /dev/hidrawN] [<file>]\n", argv[0]);
+      return 2;
+    }
+  }
+  const int fd = hidrawOpenIrate(path);
+  if (fd < 0 || !getReport(fd, &report)) {
+    return 1;
+  }
+  if (file || restore) {
+    const int count = restore ? 0 : readKeymap(file, entries, report.capacity);
+    if (count < 0) {
+      return 1;
+    }
+    bool ok = step(fd, KEYMAP_OP_BEGIN, (uint8_t)count, NULL) == KEYMAP_STAGING;
+    for (int i = 0; ok && i < count; ++i) {
+      ok = step(fd, KEYMAP_OP_ENTRY, (uint8_t)i, &entries[i]) == KEYMAP_STAGING;
+    }
+    if (!ok || step(fd, KEYMAP_OP_COMMIT, 0, NULL) != KEYMAP_IDLE || !getReport(fd, &report)) {
+      fprintf(stderr, "Programming the keymap failed; the old one is still in use\n");
+      return 1;
+    }
+  }
+  if (report.index) {
+    printf("keymap: %u of %u entries programmed (generation %u)\n", report.index, report.capacity, report.generation);
+  } else {
+    printf("keymap: built-in (room for %u entries)\n", report.capacity);
+  }
+  close(fd);
+  return 0;
+}
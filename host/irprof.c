@@ -0,0 +1,142 @@
+// Read the firmware's profiling stats (a build with PROFILE_ENABLE) through
+// Linux's hidraw driver, and print them.
+//
+// Usage: irprof [-r] [/dev/hidrawN]
+//
+// With no device given, the first hidraw device with Irate's vendor and product
+// IDs and a vendor-defined usage page is used. With -r, the stats are reset
+// after they have been read.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <linux/hidraw.h>
+#include "hidraw.h"
+#include "profile.h"
+
+static const char* const isrNames[PROFILE_NUM_ISRS] = {
+  "edge", "timeout", "tick", "sof"
+};
+static const char* const stageNames[PROFILE_NUM_STAGES] = {
+  "irPoll()", "usbSendReceive()", "USB_USBTask()"
+};
+static const char* const reportNames[USB_NUM_REPORTS] = {
+  "keyboard", "mouse",
+#if USB_MEDIA_KEYS
+  "consumer", "system"
+#endif
+};
+static const char* const protocolNames[] = {
+  [IR_PROTO_SIRC12] = "sirc12", [IR_PROTO_SIRC15] = "sirc15", [IR_PROTO_SIRC20] = "sirc20",
+  [IR_PROTO_NEC] = "nec", [IR_PROTO_RC5] = "rc5", [IR_PROTO_RC6] = "rc6"
+};
+
+int main(int argc, char* argv[]) {
+  ProfileReport report;
+  const char* path = NULL;
+  bool reset = false;
+  for (int i = 1; i < argc; ++i) {
+    if (!strcmp(argv[i], "-r")) {
+      reset = true;
+    } else if (argv[i][0] != '-') {
+      path = argv[i];
+    } else {
+      fprintf(stderr, "Usage: %s [-r] [/dev/hidrawN]\n", argv[0]);
+      return 2;
+    }
+  }
+  const int fd = hidrawOpenIrate(path);
+  if (fd < 0) {
+    return 1;
+  }
+  memset(&report, 0, sizeof(report));
+  report.reportId = PROFILE_REPORT_ID;
+  if (ioctl(fd, HIDIOCGFEATURE(sizeof(report)), &report) != (int)sizeof(report)) {
+    perror("HIDIOCGFEATURE (is it built with PROFILE_ENABLE?)");
+    return 1;
+  }
+
+  // Everything is reported in Timer1 ticks; print CPU cycles
+  const unsigned cpt = report.cyclesPerTick;
+  printf("Each time is a whole number of Timer1 ticks: to within %u cycles.\n\n", cpt - 1);
+  printf("%-8s %6s %6s %6s %8s |", "cycles", "count", "min", "max", "mean");
+  for (unsigned b = 0; b < PROFILE_BUCKETS; ++b) {
+    char label[16];
+    if (b < PROFILE_BUCKETS - 1) {
+      snprintf(label, sizeof(label), "<%u", (2U << b) * cpt);
+    } else {
+      snprintf(label, sizeof(label), ">=%u", (1U << b) * cpt);
+    }
+    printf(" %6s", label);
+  }
+  printf("\n");
+  for (unsigned i = 0; i < PROFILE_NUM_ISRS; ++i) {
+    const ProfileIsrStats* const s = &report.isr[i];
+    if (s->count == 0) {
+      printf("%-8s %6u\n", isrNames[i], 0);
+      continue;
+    }
+    printf(
+      "%-8s %6u %6u %6u %8.1f |",
+      isrNames[i], s->count, s->min * cpt, s->max * cpt,
+      (double)s->total * cpt / s->count
+    );
+    for (unsigned b = 0; b < PROFILE_BUCKETS; ++b) {
+      printf(" %6u", s->histogram[b]);
+    }
+    printf("\n");
+  }
+  printf(
+    "\nmain loop: %.0f iterations/s, longest %u cycles, awake %.1f%% of the time\n",
+    (double)report.loopsPerWindow * (F_CPU / cpt) / 65536.0, report.loopMax * cpt,
+    report.awakePerWindow * 100.0 / 65536
+  );
+  for (unsigned i = 0; i < PROFILE_NUM_STAGES; ++i) {
+    printf("  %-18s longest %u cycles\n", stageNames[i], report.stageMax[i] * cpt);
+  }
+  // The latency histogram is in microseconds
+  const ProfileIsrStats* const l = &report.latency;
+  const double usPerTick = cpt * 1e6 / F_CPU;
+  printf("\nIR edge to keyboard report: %u reports", l->count);
+  if (l->count) {
+    printf(
+      ", min/mean/max %.1f/%.1f/%.1fus\n ",
+      l->min * usPerTick, (double)l->total * usPerTick / l->count, l->max * usPerTick
+    );
+    for (unsigned b = 0; b < PROFILE_BUCKETS; ++b) {
+      const unsigned limit = (unsigned)(((2U << b) << PROFILE_LATENCY_SHIFT) * usPerTick);
+      printf(" %s%uus: %u", b < PROFILE_BUCKETS - 1 ? "<" : ">=", b < PROFILE_BUCKETS - 1 ? limit : limit / 2, l->histogram[b]);
+    }
+  }
+  printf("\n");
+
+  printf("\nreports sent: data changed/idle period up\n");
+  for (unsigned i = 0; i < USB_NUM_REPORTS; ++i) {
+    printf("  %-18s %u/%u\n", reportNames[i], report.usb.changed[i], report.usb.idle[i]);
+  }
+
+  // The timings are in ticks
+  printf("\ndecoders: frames, learned clock and stretch, margin of the last frame\n");
+  for (unsigned i = 0; i < IRPROTO_COUNT; ++i) {
+    const IrTiming* const t = &report.timing[i];
+    printf(
+      "  %-18s %u, %+.1f%%, %.1fus, %.1fus\n", protocolNames[t->protocol], t->frames,
+      100.0 * t->clock / 1024 - 100, t->stretch * usPerTick, t->margin * usPerTick
+    );
+  }
+
+  if (reset) {
+    memset(&report, 0, sizeof(report));
+    report.reportId = PROFILE_REPORT_ID;
+    if (ioctl(fd, HIDIOCSFEATURE(sizeof(report)), &report) < 0) {
+      perror("HIDIOCSFEATURE");
+      return 1;
+    }
+  }
+  close(fd);
+  return 0;
+}
@@ -0,0 +1,82 @@
+// Read the firmware's latency trace records (a build with TRACE_ENABLE) through
+// Linux's hidraw driver, and print the distribution of each stage's latency.
+//
+// Usage: irtrace [-q] [-n <records>] [/dev/hidrawN]
+//
+// Each record is printed as it arrives (unless -q), until n records have been
+// read, or until interrupted; then p50/p99/max of each stage (see trace.h) are
+// printed, for presses and releases. With no device given, the first hidraw
+// device with Irate's vendor and product IDs and a vendor-defined usage page is
+// used.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include "hidraw.h"
+#include "tracestats.h"
+
+static volatile sig_atomic_t interrupted = 0;
+
+static void onInterrupt(const int sig) {
+  (void)sig;
+  interrupted = 1;
+}
+
+int main(int argc, char* argv[]) {
+  const char* path = NULL;
+  bool quiet = false;
+  unsigned limit = 0;
+  for (int i = 1; i < argc; ++i) {
+    if (!strcmp(argv[i], "-q")) {
+      quiet = true;
+    } else if (!strcmp(argv[i], "-n") && i + 1 < argc) {
+      limit = (unsigned)atoi(argv[++i]);
+    } else if (argv[i][0] != '-') {
+      path = argv[i];
+    } else {
+      fprintf(stderr, "Usage: %s [-q] [-n <records>] [/dev/hidrawN]\n", argv[0]);
+      return 2;
+    }
+  }
+  const int fd = hidrawOpenIrate(path);
+  if (fd < 0) {
+    return 1;
+  }
+
+  // Without SA_RESTART, so the interrupt ends the read()
+  struct sigaction action;
+  memset(&action, 0, sizeof(action));
+  action.sa_handler = onInterrupt;
+  sigaction(SIGINT, &action, NULL);
+
+  TraceStats stats;
+  memset(&stats, 0, sizeof(stats));
+  if (!quiet) {
+    fprintf(stderr, "Reading trace records (is it built with TRACE_ENABLE?); interrupt to stop\n");
+  }
+  while (!interrupted && (limit == 0 || stats.records < limit)) {
+    TraceRecord record;
+    const ssize_t length = read(fd, &record, sizeof(record));
+    if (length < 0) {
+      if (errno != EINTR) {
+        perror("read");
+        return 1;
+      }
+    } else if (length == (ssize_t)sizeof(record) && record.reportId == TRACE_REPORT_ID) {
+      if (!quiet) {
+        traceStatsDescribe(stdout, &record);
+        fflush(stdout);
+      }
+      traceStatsAdd(&stats, &record);
+    }
+  }
+  close(fd);
+  traceStatsPrint(stdout, &stats, "");
+  traceStatsFree(&stats);
+  return 0;
+}
@@ -0,0 +1,88 @@
+#include <stdio.h>
+#include <string.h>
+#include <strings.h>
+#include "keyfile.h"
+#include "IrateKeymap.h"
+
+static const char* const protocols[] = {
+  [IR_PROTO_SIRC12] = "sirc12", [IR_PROTO_SIRC15] = "sirc15", [IR_PROTO_SIRC20] = "sirc20",
+  [IR_PROTO_NEC] = "nec", [IR_PROTO_RC5] = "rc5", [IR_PROTO_RC6] = "rc6"
+};
+static const char* const confirms[IR_CONFIRM_MODES] = {
+  [IR_CONFIRM_NONE] = "none", [IR_CONFIRM_VETO] = "veto", [IR_CONFIRM_MAJORITY] = "majority"
+};
+#define REPEAT_NAME(name, delay, first, last, step) #name,
+static const char* const repeats[] = {
+  [REPEAT_HOLD] = "hold", IRATE_REPEATS(REPEAT_NAME)
+};
+#define MACRO_NAME(name, ...) #name,
+static const char* const macros[] = {
+  [MACRO_NONE] = "none", IRATE_MACROS(MACRO_NAME)
+};
+
+static int find(const char* const name, const char* const* const names, const int count) {
+  for (int i = 0; i < count; ++i) {
+    if (names[i] && !strcasecmp(names[i], name)) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+bool keyfileParse(const char* text, KeymapEntry* const entry, const char** const error) {
+  char protocol[16], confirm[16], repeat[16], macro[16];
+  unsigned address, command, consumer, modifier, key;
+  int n;
+  memset(entry, 0, sizeof(*entry));
+  if (sscanf(text, " %15s %x %x %15s %15s %15s %x %x%n",
+             protocol, &address, &command, confirm, repeat, macro, &consumer, &modifier, &n) != 8) {
+    *error = "expected <protocol> <address> <command> <confirm> <repeat> <macro> <consumer> <modifier>";
+    return false;
+  }
+  const int p = find(protocol, protocols, sizeof(protocols) / sizeof(*protocols));
+  const int c = find(confirm, confirms, IR_CONFIRM_MODES);
+  const int r = find(repeat, repeats, sizeof(repeats) / sizeof(*repeats));
+  const int m = find(macro, macros, sizeof(macros) / sizeof(*macros));
+  if (p < 0) {
+    *error = "unknown protocol";
+    return false;
+  }
+  if (c < 0) {
+    *error = "unknown confirmation mode";
+    return false;
+  }
+  if (r < 0) {
+    *error = "unknown repeat curve";
+    return false;
+  }
+  if (m < 0) {
+    *error = "unknown macro";
+    return false;
+  }
+  if (address > 0xFFFF || command > 0xFF || consumer > 0xFFFF || modifier > 0xFF) {
+    *error = "value out of range";
+    return false;
+  }
+  entry->code.protocol = (uint8_t)p;
+  entry->code.address = (uint16_t)address;
+  entry->code.command = (uint8_t)command;
+  entry->confirm = (uint8_t)c;
+  entry->repeat = (uint8_t)r;
+  entry->macro = (uint8_t)m;
+  entry->consumer = (uint16_t)consumer;
+  entry->modifier = (uint8_t)modifier;
+  text += n;
+  for (unsigned i = 0; sscanf(text, " %x%n", &key, &n) == 1; ++i) {
+    if (i == KEYMAP_KEYS || key > 0xFF) {
+      *error = i == KEYMAP_KEYS ? "too many keycodes" : "value out of range";
+      return false;
+    }
+    entry->keys[i] = (uint8_t)key;
+    text += n;
+  }
+  if (sscanf(text, " %*s") != EOF) {
+    *error = "bad keycode";
+    return false;
+  }
+  return true;
+}
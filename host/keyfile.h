@@ -0,0 +1,21 @@
+#ifndef HOST_KEYFILE_H
+#define HOST_KEYFILE_H
+
+// Keymap entries as text, for traces and for irkeymap. An entry is written as
+// the KEY() lines in config/IrateKeymap.h are, without the name, in hex:
+//
+//   <protocol> <address> <command> <confirm> <repeat> <macro> <consumer> <modifier> [keycode...]
+//
+// where protocol is one of sirc12, sirc15, sirc20, nec, rc5 or rc6; confirm is
+// one of none, veto or majority; repeat is hold, or the name of one of the
+// IRATE_REPEATS curves (e.g scroll); and macro is none, or the name of one of
+// the IRATE_MACROS macros (e.g dvd_item_3); e.g "sirc15 64 33 veto hold none 0
+// 0 2c".
+
+#include <stdbool.h>
+#include "keymap.h"
+
+// Parse an entry. Returns false (and leaves a message in error) if it is bad.
+bool keyfileParse(const char* text, KeymapEntry* entry, const char** error);
+
+#endif
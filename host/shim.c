@@ -0,0 +1,327 @@
+// Host shim: I/O registers as plain variables, and a software model of the
+// AT90USB162's USB endpoint FIFOs.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <avr/io.h>
+#include <avr/sleep.h>
+#include <LUFA/Drivers/USB/USB.h>
+#include "shim.h"
+
+volatile uint8_t PINB, DDRB, PORTB;
+volatile uint8_t PINC, DDRC, PORTC;
+volatile uint8_t PIND, DDRD, PORTD;
+volatile uint8_t SREG, MCUSR, SMCR;
+volatile uint8_t EICRA, EICRB, EIMSK, EIFR;
+volatile uint8_t PCICR, PCIFR, PCMSK0, PCMSK1;
+volatile uint8_t TCCR0A, TCCR0B, TCNT0, OCR0A, OCR0B, TIMSK0, TIFR0;
+volatile uint8_t TCCR1A, TCCR1B, TCCR1C, TIMSK1, TIFR1;
+volatile uint16_t TCNT1, OCR1A, OCR1B, OCR1C, ICR1;
+volatile uint8_t PRR0, PRR1;
+
+volatile uint8_t USB_DeviceState = DEVICE_STATE_Unattached;
+USB_Request_Header_t USB_ControlRequest;
+bool USB_Device_RemoteWakeupEnabled;
+volatile bool shimAsleep;
+
+#define NUM_EPS   5
+#define MAX_BANKS 2
+#define BANK_SIZE 64
+
+typedef struct {
+  uint8_t  type;
+  bool     in;
+  uint16_t size;
+  uint8_t  banks;
+  uint8_t  filled;              // number of banks full (IN) or received (OUT)
+  uint8_t  head;                // oldest filled bank
+  uint16_t length[MAX_BANKS];   // bytes in each bank
+  uint8_t  data[MAX_BANKS][BANK_SIZE];
+  uint16_t pos;                 // read position in the current OUT bank
+} Endpoint;
+
+static Endpoint eps[NUM_EPS];
+static uint8_t current;
+static uint16_t frameNumber;
+static ShimInHook inHook;
+static bool remoteWakeup;
+static ShimSleepHook sleepHook;
+
+// Control endpoint state for the request in progress
+static uint8_t* ctrlData;
+static uint16_t ctrlLength;
+static uint16_t ctrlPos;
+static uint16_t ctrlPacket;  // start of the current data-stage packet
+static bool ctrlHostToDevice;
+
+static Endpoint* cur(void) {
+  return &eps[current];
+}
+static uint8_t tailBank(const Endpoint* ep) {
+  return (uint8_t)((ep->head + ep->filled) % ep->banks);
+}
+
+void USB_Init(void) {
+  memset(eps, 0, sizeof(eps));
+  remoteWakeup = false;
+  USB_DeviceState = DEVICE_STATE_Powered;
+}
+void USB_USBTask(void) { }
+void USB_Device_EnableSOFEvents(void) { }
+void USB_Device_DisableSOFEvents(void) { }
+void USB_Device_SendRemoteWakeup(void) {
+  remoteWakeup = true;
+}
+uint16_t USB_Device_GetFrameNumber(void) {
+  return frameNumber & 0x7FF;
+}
+
+bool Endpoint_ConfigureEndpoint(uint8_t address, uint8_t type, uint16_t size, uint8_t banks) {
+  const uint8_t num = address & ENDPOINT_EPNUM_MASK;
+  if (num >= NUM_EPS || size > BANK_SIZE || banks < 1 || banks > MAX_BANKS) {
+    fprintf(stderr, "shim: bad endpoint config 0x%02X\n", address);
+    exit(1);
+  }
+  memset(&eps[num], 0, sizeof(Endpoint));
+  eps[num].type = type;
+  eps[num].in = (address & ENDPOINT_DIR_IN) != 0;
+  eps[num].size = size;
+  eps[num].banks = banks;
+  return true;
+}
+void Endpoint_SelectEndpoint(uint8_t address) {
+  current = address & ENDPOINT_EPNUM_MASK;
+}
+uint8_t Endpoint_GetCurrentEndpoint(void) {
+  return current;
+}
+bool Endpoint_IsReadWriteAllowed(void) {
+  Endpoint* const ep = cur();
+  if (current == ENDPOINT_CONTROLEP) {
+    return true;
+  }
+  if (ep->banks == 0) {
+    return false;
+  }
+  if (ep->in) {
+    return ep->filled < ep->banks && ep->length[tailBank(ep)] < ep->size;
+  }
+  return ep->filled && ep->pos < ep->length[ep->head];
+}
+bool Endpoint_IsINReady(void) {
+  const Endpoint* const ep = cur();
+  return current == ENDPOINT_CONTROLEP || ep->filled < ep->banks;
+}
+bool Endpoint_IsOUTReceived(void) {
+  if (current == ENDPOINT_CONTROLEP) {
+    return ctrlHostToDevice && ctrlPos < ctrlLength;
+  }
+  return cur()->filled != 0;
+}
+uint8_t Endpoint_GetBusyBanks(void) {
+  return cur()->filled;
+}
+uint16_t Endpoint_BytesInEndpoint(void) {
+  const Endpoint* const ep = cur();
+  if (current == ENDPOINT_CONTROLEP) {
+    const uint16_t end = ctrlPacket + FIXED_CONTROL_ENDPOINT_SIZE;
+    return (ctrlHostToDevice ? (end < ctrlLength ? end : ctrlLength) : ctrlPos) - ctrlPos;
+  }
+  return ep->filled ? ep->length[ep->head] : 0;
+}
+void Endpoint_ClearIN(void) {
+  Endpoint* const ep = cur();
+  if (current == ENDPOINT_CONTROLEP) {
+    return;
+  }
+  if (ep->filled < ep->banks) {
+    ep->filled++;  // the host empties the bank when it takes it
+  }
+}
+void Endpoint_ClearOUT(void) {
+  Endpoint* const ep = cur();
+  if (current == ENDPOINT_CONTROLEP) {
+    if (ctrlHostToDevice) {
+      // Discard whatever is left of the packet
+      ctrlPacket += FIXED_CONTROL_ENDPOINT_SIZE;
+      ctrlPos = ctrlPacket < ctrlLength ? ctrlPacket : ctrlLength;
+    }
+    return;
+  }
+  if (ep->filled) {
+    ep->head = (uint8_t)((ep->head + 1) % ep->banks);
+    ep->filled--;
+    ep->pos = 0;
+  }
+}
+void Endpoint_ClearSETUP(void) { }
+void Endpoint_ClearStatusStage(void) { }
+void Endpoint_StallTransaction(void) { }
+void Endpoint_ResetDataToggle(void) { }
+
+uint8_t Endpoint_Read_8(void) {
+  if (current == ENDPOINT_CONTROLEP) {
+    return (ctrlHostToDevice && ctrlPos < ctrlLength) ? ctrlData[ctrlPos++] : 0;
+  }
+  Endpoint* const ep = cur();
+  if (ep->filled && ep->pos < ep->length[ep->head]) {
+    return ep->data[ep->head][ep->pos++];
+  }
+  return 0;
+}
+void Endpoint_Write_8(uint8_t data) {
+  if (current == ENDPOINT_CONTROLEP) {
+    if (!ctrlHostToDevice && ctrlPos < ctrlLength) {
+      ctrlData[ctrlPos] = data;
+    }
+    ctrlPos++;
+    return;
+  }
+  Endpoint* const ep = cur();
+  if (ep->filled < ep->banks) {
+    const uint8_t bank = tailBank(ep);
+    if (ep->length[bank] < ep->size) {
+      ep->data[bank][ep->length[bank]++] = data;
+    }
+  }
+}
+void Endpoint_Write_16_LE(uint16_t data) {
+  Endpoint_Write_8((uint8_t)data);
+  Endpoint_Write_8((uint8_t)(data >> 8));
+}
+void Endpoint_Write_32_LE(uint32_t data) {
+  Endpoint_Write_16_LE((uint16_t)data);
+  Endpoint_Write_16_LE((uint16_t)(data >> 16));
+}
+uint8_t Endpoint_Write_Stream_LE(const void* buffer, uint16_t length, uint16_t* bytesProcessed) {
+  const uint8_t* p = buffer;
+  (void)bytesProcessed;
+  while (length--) {
+    Endpoint_Write_8(*p++);
+  }
+  return ENDPOINT_RWSTREAM_NoError;
+}
+uint8_t Endpoint_Write_Control_Stream_LE(const void* buffer, uint16_t length) {
+  const uint8_t* p = buffer;
+  while (length--) {
+    Endpoint_Write_8(*p++);
+  }
+  return ENDPOINT_RWCSTREAM_NoError;
+}
+uint8_t Endpoint_Write_Control_PStream_LE(const void* buffer, uint16_t length) {
+  return Endpoint_Write_Control_Stream_LE(buffer, length);
+}
+uint8_t Endpoint_Read_Control_Stream_LE(void* buffer, uint16_t length) {
+  uint8_t* p = buffer;
+  while (length--) {
+    *p++ = Endpoint_Read_8();
+  }
+  return ENDPOINT_RWCSTREAM_NoError;
+}
+
+// Driver side
+void shimSetInHook(ShimInHook hook) {
+  inHook = hook;
+}
+
+bool shimPollIn(uint8_t epNum) {
+  Endpoint* const ep = &eps[epNum];
+  if (ep->banks == 0 || ep->filled == 0) {
+    return false;
+  }
+  if (inHook) {
+    inHook(epNum, ep->data[ep->head], ep->length[ep->head]);
+  }
+  ep->length[ep->head] = 0;
+  ep->head = (uint8_t)((ep->head + 1) % ep->banks);
+  ep->filled--;
+  return true;
+}
+
+void shimSendOut(uint8_t epNum, const uint8_t* data, uint16_t length) {
+  Endpoint* const ep = &eps[epNum];
+  if (ep->banks == 0 || ep->filled == ep->banks || length > ep->size) {
+    return;  // NAKed
+  }
+  const uint8_t bank = tailBank(ep);
+  memcpy(ep->data[bank], data, length);
+  ep->length[bank] = length;
+  ep->filled++;
+}
+
+uint16_t shimControl(
+  uint8_t bmRequestType, uint8_t bRequest, uint16_t wValue, uint16_t wIndex,
+  uint8_t* data, uint16_t length)
+{
+  const uint8_t saved = current;
+  USB_ControlRequest.bmRequestType = bmRequestType;
+  USB_ControlRequest.bRequest = bRequest;
+  USB_ControlRequest.wValue = wValue;
+  USB_ControlRequest.wIndex = wIndex;
+  USB_ControlRequest.wLength = length;
+  ctrlData = data;
+  ctrlLength = length;
+  ctrlPos = ctrlPacket = 0;
+  ctrlHostToDevice = !(bmRequestType & REQDIR_DEVICETOHOST);
+  current = ENDPOINT_CONTROLEP;
+  EVENT_USB_Device_ControlRequest();
+  current = saved;
+  return ctrlPos < length ? ctrlPos : length;
+}
+
+// The linker marks out the section EEMEM variables are put in (if there are any)
+extern uint8_t __start_eeprom[] __attribute__((weak));
+extern uint8_t __stop_eeprom[] __attribute__((weak));
+
+void shimEepromErase(void) {
+  if (__start_eeprom) {
+    memset(__start_eeprom, 0xFF, (size_t)(__stop_eeprom - __start_eeprom));
+  }
+}
+
+void shimSetSleepHook(ShimSleepHook hook) {
+  sleepHook = hook;
+}
+
+void shimSleep(void) {
+  if (SMCR & _BV(SE)) {
+    shimAsleep = true;
+    if (sleepHook) {
+      sleepHook();
+    }
+  }
+}
+
+bool shimTakeRemoteWakeup(void) {
+  const bool signalled = remoteWakeup;
+  remoteWakeup = false;
+  return signalled;
+}
+
+void shimStartOfFrame(void) {
+  frameNumber++;
+}
+
+// LUFA only calls the event handlers the application defines
+__attribute__((weak)) void EVENT_USB_Device_Connect(void) { }
+__attribute__((weak)) void EVENT_USB_Device_Disconnect(void) { }
+__attribute__((weak)) void EVENT_USB_Device_ConfigurationChanged(void) { }
+__attribute__((weak)) void EVENT_USB_Device_ControlRequest(void) { }
+__attribute__((weak)) void EVENT_USB_Device_StartOfFrame(void) { }
+__attribute__((weak)) void EVENT_USB_Device_Suspend(void) { }
+__attribute__((weak)) void EVENT_USB_Device_WakeUp(void) { }
+__attribute__((weak)) void EVENT_USB_Device_Reset(void) { }
+
+// Likewise, only the vectors the firmware uses have ISRs
+__attribute__((weak)) void INT0_vect(void) { }
+__attribute__((weak)) void INT1_vect(void) { }
+__attribute__((weak)) void INT2_vect(void) { }
+__attribute__((weak)) void INT4_vect(void) { }
+__attribute__((weak)) void TIMER1_CAPT_vect(void) { }
+__attribute__((weak)) void TIMER1_COMPA_vect(void) { }
+__attribute__((weak)) void TIMER1_COMPB_vect(void) { }
+__attribute__((weak)) void TIMER1_COMPC_vect(void) { }
+__attribute__((weak)) void TIMER1_OVF_vect(void) { }
+__attribute__((weak)) void TIMER0_COMPA_vect(void) { }
+__attribute__((weak)) void PCINT0_vect(void) { }
@@ -0,0 +1,43 @@
+#ifndef HOST_SHIM_H
+#define HOST_SHIM_H
+
+// Simulation-side view of the host shim: lets the driver play the part of the
+// USB host and inspect what the firmware sent.
+
+#include <stdint.h>
+#include <LUFA/Drivers/USB/USB.h>
+
+// Called each time the host collects a packet from an IN endpoint
+typedef void (*ShimInHook)(uint8_t epNum, const uint8_t* data, uint16_t length);
+void shimSetInHook(ShimInHook hook);
+
+// The host polls an IN endpoint. If the firmware has a bank waiting, it is
+// collected (and passed to the IN hook) and true is returned.
+bool shimPollIn(uint8_t epNum);
+
+// The host sends a packet to an OUT endpoint
+void shimSendOut(uint8_t epNum, const uint8_t* data, uint16_t length);
+
+// Issue a control request. For host-to-device requests, the data stage (if any)
+// is taken from data; for device-to-host requests up to length bytes are read
+// back into it. Returns the number of bytes transferred in the data stage.
+uint16_t shimControl(
+  uint8_t bmRequestType, uint8_t bRequest, uint16_t wValue, uint16_t wIndex,
+  uint8_t* data, uint16_t length
+);
+
+// Erase the EEPROM, as it is when new
+void shimEepromErase(void);
+
+// Called when the firmware sleeps (see <avr/sleep.h>), to run the hardware
+// until something wakes it
+typedef void (*ShimSleepHook)(void);
+void shimSetSleepHook(ShimSleepHook hook);
+
+// Whether the firmware has signalled remote wakeup since the last call
+bool shimTakeRemoteWakeup(void);
+
+// Advance the USB frame counter (called once per simulated millisecond)
+void shimStartOfFrame(void);
+
+#endif
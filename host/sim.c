@@ -0,0 +1,1025 @@
+// Host-side simulation driver. Replays a recorded IR edge-timing trace into the
+// firmware (via the ISRs, exactly as the hardware would invoke them), plays the
+// part of the USB host by polling the IN endpoints, and checks the HID reports
+// that come out against the trace's expectations.
+//
+// Traces use LIRC's mode2 format: one "pulse <us>" (IR burst, i.e detector
+// output asserted) or "space <us>" per line. Additionally:
+//
+//   # comment
+//   expect <kbd|mouse> <hex bytes>  the next report expected on that endpoint
+//   stall <ms>                      the host stops polling for a while
+//   key <entry>                     an entry of a keymap (see keyfile.h) which
+//                                   is programmed before the trace starts
+//   alt <interface> <setting>       the host selects an alternate setting of an
+//                                   interface (see USB_FAST_ALT) on enumeration
+//   boot <interface>                the host selects the boot protocol for an
+//                                   interface on enumeration, as a BIOS does
+//   capture                         the host switches on raw edge capture (see
+//                                   capture.h), and the edges which come back
+//                                   are checked against the trace's
+//   receivers <n>...                which receivers (see IR_RECEIVERS) see the
+//                                   pulses which follow; just 0 to begin with
+//   delay <n> <us>                  receiver n sees them this much later
+//   suspend <ms>                    the host suspends the bus for this long,
+//                                   or until the device wakes it (see
+//                                   SUSPEND_ENABLE)
+//
+// Usage: sim [-q] [-n <repeats>] <trace>...
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <time.h>
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <avr/sleep.h>
+#include <LUFA/Drivers/USB/USB.h>
+#include "shim.h"
+#include "capture.h"
+#include "capturefile.h"
+#include "desc.h"
+#include "ir.h"
+#include "irproto.h"
+#include "keymap.h"
+#include "keyfile.h"
+#include "mouse.h"
+#include "profile.h"
+#include "sched.h"
+#include "timer.h"
+#include "trace.h"
+#include "tracestats.h"
+#include "usb.h"
+
+#define TICKS_PER_MS  2000ULL  // Timer1 runs at 2MHz
+#define LOOP_TICKS    20       // one main-loop iteration every 10us
+#define SETTLE_MS     10       // after enumeration, before the trace starts
+#define TAIL_MS       300      // after the trace ends, to let releases through
+#define MAX_REPORT    64
+#define LONG_SPACE_MS 150      // captured spaces longer than this may be cut short
+#define SUSPEND_MS    3        // bus idle before the device sees a suspend
+#define RESUME_MS     20       // resume signalling, after a remote wakeup
+#define WAKE_TICKS    (IR_WAKE_STARTUP * TICKS_PER_MS / 1000)  // start-up from power-down
+
+typedef struct {
+  uint64_t at;
+  bool     mark;
+  uint8_t  receiver;
+} TraceEdge;
+
+typedef struct {
+  uint64_t at;
+  uint8_t  epNum;
+  uint8_t  length;
+  uint8_t  data[MAX_REPORT];
+} Report;
+
+typedef struct {
+  uint64_t from;
+  uint64_t to;
+} Stall;  // likewise a suspend
+
+typedef struct {
+  bool     mark;
+  uint64_t ticks;
+} Pulse;
+
+typedef struct {
+  void*  items;
+  size_t count;
+  size_t capacity;
+  size_t size;
+} List;
+
+static List edges    = {NULL, 0, 0, sizeof(TraceEdge)};
+static List expected = {NULL, 0, 0, sizeof(Report)};
+static List received = {NULL, 0, 0, sizeof(Report)};
+static List stalls   = {NULL, 0, 0, sizeof(Stall)};
+static List suspends = {NULL, 0, 0, sizeof(Stall)};
+static List keys     = {NULL, 0, 0, sizeof(KeymapEntry)};
+static List captured = {NULL, 0, 0, sizeof(Pulse)};
+
+static uint64_t now;       // simulated time, in Timer1 ticks
+static uint64_t lastEdge;  // time of the last edge in the trace
+static bool quiet = false;
+static uint8_t pollInterval[8];  // per IN endpoint, from the config descriptor
+static uint8_t altSetting[8];    // per interface, selected on enumeration
+static bool boot[8];             // ...and whether its boot protocol is
+static bool capturing;           // whether the trace switches on capture
+static bool remoteWakeup;        // whether the device can wake the host
+static CaptureFile captureFile;
+
+// Release latency, measured from the last edge of the last frame
+typedef struct {
+  unsigned count;
+  uint64_t min;
+  uint64_t max;
+  uint64_t total;
+} Latency;
+static Latency ledLatency;  // to the decoder's release (the blue LED going off)
+static Latency kbdLatency;  // to the keyboard report which releases the key
+static bool ledLit;
+static bool kbdDown;
+static unsigned kbdReleases;  // releases by the decoder not yet sent to the host
+                             // (so a repeat's or macro's releases don't count)
+static bool sleeping;   // whether the main loop is in schedSleep()
+static bool slotWoken;  // ...and if so, whether it woke in time for a slot
+
+#if TRACE_ENABLE
+static TraceStats traceStats;  // from the records streamed by the firmware
+#endif
+
+// Suspend: the one in progress, if any, and when the device is to see it begin
+// and end; and the start-up from power-down, if a mark has begun it
+static const Stall* suspend;
+static uint64_t suspendSeen;
+static uint64_t resumeAt;
+static uint64_t wakeAt;
+static size_t nextSuspend;
+static uint64_t suspendTicks;    // time suspended, in all
+static uint64_t downTicks;       // ...and powered down
+static unsigned remoteWakeups;
+static uint64_t wakeEdge;        // the first edge while suspended, if any
+static bool resumed;             // ...and whether the first report since is due
+static Latency wakeupLatency;    // from that edge to remote wakeup
+static Latency reportLatency;    // ...and to the first report after resuming
+
+// Main-loop duty cycle: of the slots in which it could have run, the number in
+// which it did (i.e wasn't asleep)
+static uint64_t loopSlots;
+static uint64_t loopsAwake;
+
+static void latencyAdd(Latency* const latency, const uint64_t from) {
+  const uint64_t ticks = now - from;
+  if (latency->count == 0 || ticks < latency->min) {
+    latency->min = ticks;
+  }
+  if (ticks > latency->max) {
+    latency->max = ticks;
+  }
+  latency->total += ticks;
+  ++latency->count;
+}
+
+static void latencyPrint(const char* const name, const char* const from, const Latency* const latency) {
+  if (latency->count) {
+    printf(
+      "  %s latency: %u measured, %.3f/%.3f/%.3fms min/mean/max after %s\n",
+      name, latency->count, (double)latency->min / TICKS_PER_MS,
+      (double)latency->total / latency->count / TICKS_PER_MS, (double)latency->max / TICKS_PER_MS, from
+    );
+  }
+}
+
+#if STATS_ENABLE
+// What each decoder which has decoded anything has learned of the timing
+static void timingPrint(void) {
+  static const char* const names[] = {
+    [IR_PROTO_SIRC12] = "sirc12", [IR_PROTO_SIRC15] = "sirc15", [IR_PROTO_SIRC20] = "sirc20",
+    [IR_PROTO_NEC] = "nec", [IR_PROTO_RC5] = "rc5", [IR_PROTO_RC6] = "rc6"
+  };
+  for (uint8_t i = 0; i < IRPROTO_COUNT; ++i) {
+    IrTiming timing;
+    irprotoTiming(i, &timing);
+    if (timing.frames) {
+      printf(
+        "  timing: %s: %u frames, clock %+.1f%%, stretch %.1fus, last margin %.1fus\n",
+        names[timing.protocol], timing.frames, 100.0 * timing.clock / 1024 - 100,
+        timing.stretch * 1000.0 / TICKS_PER_MS, timing.margin * 1000.0 / TICKS_PER_MS
+      );
+    }
+  }
+}
+#endif
+
+static void* append(List* const list) {
+  if (list->count == list->capacity) {
+    list->capacity = list->capacity ? 2 * list->capacity : 64;
+    list->items = realloc(list->items, list->capacity * list->size);
+    if (!list->items) {
+      perror("realloc");
+      exit(2);
+    }
+  }
+  return (char*)list->items + list->size * list->count++;
+}
+#define AT(list, type, i) (((type*)(list).items)[i])
+
+static const char* epName(const uint8_t epNum) {
+  static char buf[8];
+  if (epNum == (KEYBOARD_IN_EPADDR & ENDPOINT_EPNUM_MASK)) {
+    return "kbd";
+  } else if (epNum == (MOUSE_IN_EPADDR & ENDPOINT_EPNUM_MASK)) {
+    return "mouse";
+  }
+  snprintf(buf, sizeof(buf), "ep%u", epNum);
+  return buf;
+}
+
+static int epByName(const char* const name) {
+  for (uint8_t i = 1; i < 8; ++i) {
+    if (!strcmp(epName(i), name)) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+static void printReport(FILE* const out, const Report* const r) {
+  fprintf(out, "%s", epName(r->epNum));
+  for (uint8_t i = 0; i < r->length; ++i) {
+    fprintf(out, " %02X", r->data[i]);
+  }
+}
+
+static void addEdge(const uint64_t at, const bool mark, const uint8_t receiver) {
+  TraceEdge* const e = append(&edges);
+  e->at = at;
+  e->mark = mark;
+  e->receiver = receiver;
+}
+
+// In time order; at the same time, in receiver order
+static int compareEdges(const void* const a, const void* const b) {
+  const TraceEdge* const x = a;
+  const TraceEdge* const y = b;
+  return x->at != y->at ? (x->at < y->at ? -1 : 1) : (int)x->receiver - (int)y->receiver;
+}
+
+// Load a trace, appending its edges (offset to start at the given time).
+// Returns the time at which the trace ends.
+static uint64_t loadTrace(const char* const path, uint64_t t) {
+  FILE* const in = fopen(path, "r");
+  char line[512];
+  unsigned lineNum = 0;
+  bool level[IR_RECEIVERS] = {false};
+  bool seeing[IR_RECEIVERS] = {true};      // which receivers see the pulses
+  uint64_t delay[IR_RECEIVERS] = {0};      // ...and how late
+  if (!in) {
+    perror(path);
+    exit(2);
+  }
+  while (fgets(line, sizeof(line), in)) {
+    char word[16];
+    unsigned long value;
+    int used;
+    ++lineNum;
+    char* const hash = strchr(line, '#');
+    if (hash) {
+      *hash = '\0';
+    }
+    if (sscanf(line, " %15s%n", word, &used) != 1) {
+      continue;
+    }
+    if (!strcmp(word, "pulse") || !strcmp(word, "space")) {
+      const bool mark = (word[0] == 'p');
+      if (sscanf(line + used, "%lu", &value) != 1) {
+        fprintf(stderr, "%s:%u: missing duration\n", path, lineNum);
+        exit(2);
+      }
+      for (uint8_t r = 0; r < IR_RECEIVERS; ++r) {
+        if (seeing[r] && mark != level[r]) {
+          addEdge(t + delay[r], mark, r);
+          level[r] = mark;
+        }
+      }
+      t += value * TICKS_PER_MS / 1000;
+    } else if (!strcmp(word, "expect")) {
+      Report* const r = append(&expected);
+      char name[16];
+      int n;
+      const char* p = line + used;
+      if (sscanf(p, " %15s%n", name, &n) != 1 || epByName(name) < 0) {
+        fprintf(stderr, "%s:%u: bad endpoint\n", path, lineNum);
+        exit(2);
+      }
+      r->epNum = (uint8_t)epByName(name);
+      r->length = 0;
+      p += n;
+      unsigned byte;
+      while (r->length < MAX_REPORT && sscanf(p, " %x%n", &byte, &n) == 1) {
+        r->data[r->length++] = (uint8_t)byte;
+        p += n;
+      }
+    } else if (!strcmp(word, "stall")) {
+      Stall* const s = append(&stalls);
+      if (sscanf(line + used, "%lu", &value) != 1) {
+        fprintf(stderr, "%s:%u: missing duration\n", path, lineNum);
+        exit(2);
+      }
+      s->from = t;
+      s->to = t + value * TICKS_PER_MS;
+    } else if (!strcmp(word, "suspend")) {
+      Stall* const s = append(&suspends);
+      if (!SUSPEND_ENABLE) {
+        fprintf(stderr, "%s:%u: the device can't be suspended (SUSPEND_ENABLE is 0)\n", path, lineNum);
+        exit(2);
+      }
+      if (sscanf(line + used, "%lu", &value) != 1) {
+        fprintf(stderr, "%s:%u: missing duration\n", path, lineNum);
+        exit(2);
+      }
+      s->from = t;
+      s->to = t + value * TICKS_PER_MS;
+    } else if (!strcmp(word, "key")) {
+      const char* error;
+      if (!KEYMAP_CAPACITY) {
+        fprintf(stderr, "%s:%u: the keymap can't be programmed (KEYMAP_CAPACITY is 0)\n", path, lineNum);
+        exit(2);
+      }
+      if (!keyfileParse(line + used, append(&keys), &error)) {
+        fprintf(stderr, "%s:%u: %s\n", path, lineNum, error);
+        exit(2);
+      }
+    } else if (!strcmp(word, "capture")) {
+      if (!CAPTURE_ENABLE) {
+        fprintf(stderr, "%s:%u: edges can't be captured (CAPTURE_ENABLE is 0)\n", path, lineNum);
+        exit(2);
+      }
+      capturing = true;
+    } else if (!strcmp(word, "receivers")) {
+      const char* p = line + used;
+      unsigned r;
+      int n;
+      memset(seeing, 0, sizeof(seeing));
+      while (sscanf(p, "%u%n", &r, &n) == 1) {
+        if (r >= IR_RECEIVERS) {
+          fprintf(stderr, "%s:%u: there is no receiver %u (IR_RECEIVERS is %u)\n", path, lineNum, r, IR_RECEIVERS);
+          exit(2);
+        }
+        seeing[r] = true;
+        p += n;
+      }
+      for (uint8_t i = 0; i < IR_RECEIVERS; ++i) {
+        if (!seeing[i] && level[i]) {
+          addEdge(t + delay[i], false, i);  // it stops seeing the pulse
+          level[i] = false;
+        }
+      }
+    } else if (!strcmp(word, "delay")) {
+      unsigned r;
+      if (sscanf(line + used, "%u %lu", &r, &value) != 2 || r >= IR_RECEIVERS) {
+        fprintf(stderr, "%s:%u: bad receiver or delay (IR_RECEIVERS is %u)\n", path, lineNum, IR_RECEIVERS);
+        exit(2);
+      }
+      delay[r] = value * TICKS_PER_MS / 1000;
+    } else if (!strcmp(word, "alt")) {
+      unsigned interface, setting;
+      if (sscanf(line + used, "%u %u", &interface, &setting) != 2 || interface >= sizeof(altSetting)) {
+        fprintf(stderr, "%s:%u: bad alternate setting\n", path, lineNum);
+        exit(2);
+      }
+      altSetting[interface] = (uint8_t)setting;
+    } else if (!strcmp(word, "boot")) {
+      unsigned interface;
+      if (sscanf(line + used, "%u", &interface) != 1 || interface >= sizeof(boot)) {
+        fprintf(stderr, "%s:%u: bad interface\n", path, lineNum);
+        exit(2);
+      }
+      boot[interface] = true;
+    } else {
+      fprintf(stderr, "%s:%u: unrecognised \"%s\"\n", path, lineNum, word);
+      exit(2);
+    }
+  }
+  fclose(in);
+  for (uint8_t r = 0; r < IR_RECEIVERS; ++r) {
+    if (level[r]) {
+      addEdge(t + delay[r], false, r);
+    }
+  }
+  return t;
+}
+
+static void onCapturePulse(void* const context, const bool mark, const uint64_t ticks) {
+  Pulse* const p = append(&captured);
+  (void)context;
+  p->mark = mark;
+  p->ticks = ticks;
+}
+
+static void onIn(const uint8_t epNum, const uint8_t* const data, const uint16_t length) {
+  Report* const r = append(&received);
+  r->at = now;
+  r->epNum = epNum;
+  r->length = (uint8_t)(length < MAX_REPORT ? length : MAX_REPORT);
+  memcpy(r->data, data, r->length);
+  if (resumed) {
+    latencyAdd(&reportLatency, wakeEdge);
+    resumed = false;
+  }
+  if (epNum == (KEYBOARD_IN_EPADDR & ENDPOINT_EPNUM_MASK)) {
+    bool down = false;
+    for (uint8_t i = 0; i < r->length; ++i) {
+      down = down || r->data[i];
+    }
+    if (kbdDown && !down && kbdReleases) {
+      latencyAdd(&kbdLatency, lastEdge);
+      --kbdReleases;
+    }
+    kbdDown = down;
+  }
+#if CAPTURE_ENABLE
+  if (epNum == (VENDOR_IN_EPADDR & ENDPOINT_EPNUM_MASK) && length == sizeof(CapturePacket) && data[0] == CAPTURE_REPORT_ID) {
+    CapturePacket packet;
+    memcpy(&packet, data, sizeof(packet));
+    capturefileRead(&captureFile, &packet, onCapturePulse, NULL);
+    return;  // too many to print
+  }
+#endif
+#if TRACE_ENABLE
+  if (epNum == (VENDOR_IN_EPADDR & ENDPOINT_EPNUM_MASK) && length == sizeof(TraceRecord) && data[0] == TRACE_REPORT_ID) {
+    TraceRecord record;
+    memcpy(&record, data, sizeof(record));
+    traceStatsAdd(&traceStats, &record);
+  }
+#endif
+  if (!quiet) {
+    printf("%10.3f ", (double)now / TICKS_PER_MS);
+    printReport(stdout, r);
+    printf("\n");
+  }
+}
+
+// Find each IN endpoint's polling interval in the configuration descriptor,
+// in the selected setting of its interface
+static void readDescriptors(void) {
+  bool selected = false;
+  const void* addr;
+  const uint16_t size = CALLBACK_USB_GetDescriptor(DTYPE_Configuration << 8, 0, &addr);
+  const uint8_t* p = addr;
+  const uint8_t* const end = p + size;
+  remoteWakeup = (((const USB_Descriptor_Configuration_Header_t*)p)->ConfigAttributes & USB_CONFIG_ATTR_REMOTEWAKEUP) != 0;
+  while (p < end && p[0]) {
+    if (p[1] == DTYPE_Interface) {
+      const USB_Descriptor_Interface_t* const in = (const USB_Descriptor_Interface_t*)p;
+      selected = in->InterfaceNumber < sizeof(altSetting) && in->AlternateSetting == altSetting[in->InterfaceNumber];
+    } else if (p[1] == DTYPE_Endpoint && selected) {
+      const USB_Descriptor_Endpoint_t* const ep = (const USB_Descriptor_Endpoint_t*)p;
+      if (ep->EndpointAddress & ENDPOINT_DIR_IN) {
+        pollInterval[ep->EndpointAddress & ENDPOINT_EPNUM_MASK] = ep->PollingIntervalMS;
+      }
+    }
+    p += p[0];
+  }
+}
+
+// What the host does on enumeration: configure the device, then (like Linux's
+// usbhid) set the idle rate of every HID interface to zero.
+static void enumerate(void) {
+  EVENT_USB_Device_Connect();
+  USB_DeviceState = DEVICE_STATE_Configured;
+  EVENT_USB_Device_ConfigurationChanged();
+  for (uint8_t i = 0; i < sizeof(altSetting); ++i) {
+    uint8_t setting = 0;
+    if (altSetting[i]) {
+      shimControl(REQDIR_HOSTTODEVICE | REQTYPE_STANDARD | REQREC_INTERFACE, REQ_SetInterface, altSetting[i], i, NULL, 0);
+      shimControl(REQDIR_DEVICETOHOST | REQTYPE_STANDARD | REQREC_INTERFACE, REQ_GetInterface, 0, i, &setting, 1);
+      if (setting != altSetting[i]) {
+        fprintf(stderr, "interface %u: alternate setting %u not selected\n", i, altSetting[i]);
+        exit(2);
+      }
+    }
+  }
+  readDescriptors();
+  USB_Device_RemoteWakeupEnabled = remoteWakeup;  // LUFA handles SET_FEATURE itself
+  for (uint8_t i = 0; i < sizeof(boot); ++i) {
+    if (boot[i]) {
+      uint8_t protocol = 1;
+      shimControl(REQDIR_HOSTTODEVICE | REQTYPE_CLASS | REQREC_INTERFACE, HID_REQ_SetProtocol, 0, i, NULL, 0);
+      shimControl(REQDIR_DEVICETOHOST | REQTYPE_CLASS | REQREC_INTERFACE, HID_REQ_GetProtocol, 0, i, &protocol, 1);
+      if (protocol != 0) {
+        fprintf(stderr, "interface %u: boot protocol not selected\n", i);
+        exit(2);
+      }
+    }
+  }
+  shimControl(REQDIR_HOSTTODEVICE | REQTYPE_CLASS | REQREC_INTERFACE, HID_REQ_SetIdle, 0, ifKeyboard, NULL, 0);
+  shimControl(REQDIR_HOSTTODEVICE | REQTYPE_CLASS | REQREC_INTERFACE, HID_REQ_SetIdle, 0, ifMouse, NULL, 0);
+}
+
+// One iteration of the main loop (as in main.c). If it goes to sleep, the
+// following iterations are skipped until an ISR is called.
+static void loopOnce(void) {
+  PROFILE_LOOP_BEGIN();
+  if (schedTake(WORK_IR)) {
+    irPoll();
+  }
+#if KEYMAP_CAPACITY
+  keymapPoll();
+#endif
+  if (schedTake(WORK_TIMER)) {
+    timerPoll();
+  }
+  PROFILE_LOOP_MARK(PROFILE_POLL);
+  if (schedTake(WORK_USB)) {
+    usbSendReceive();
+  }
+  PROFILE_LOOP_MARK(PROFILE_SEND);
+  USB_USBTask();
+  PROFILE_LOOP_MARK(PROFILE_TASK);
+  schedSleep();
+}
+
+// Call an ISR, waking the CPU
+#define INTERRUPT(vector) (shimAsleep = false, vector())
+
+// Whether the CPU is in power-down, in which Timer1 stops and the pins are
+// only seen by the level interrupts
+static bool poweredDown(void) {
+  return shimAsleep && (SMCR & (_BV(SM0) | _BV(SM1) | _BV(SM2))) == SLEEP_MODE_PWR_DOWN;
+}
+static bool wakeArmed(void) {
+  return (EIMSK & _BV(INT4)) && !(EICRB & (_BV(ISC41) | _BV(ISC40)));
+}
+
+#if KEYMAP_CAPACITY
+// One step of a keymap update (see keymap.h), as irkeymap does it: set the
+// report, then get it until the device is no longer busy. Returns the state.
+static uint8_t keymapStep(const uint8_t op, const uint8_t index, const KeymapEntry* const entry) {
+  KeymapReport report;
+  memset(&report, 0, sizeof(report));
+  report.reportId = KEYMAP_REPORT_ID;
+  report.op = op;
+  report.index = index;
+  if (entry) {
+    report.entry = *entry;
+  }
+  shimControl(
+    REQDIR_HOSTTODEVICE | REQTYPE_CLASS | REQREC_INTERFACE, HID_REQ_SetReport,
+    FEATURE_REPORT(KEYMAP_REPORT_ID), ifVendor, (uint8_t*)&report, sizeof(report)
+  );
+  do {
+    loopOnce();
+    shimControl(
+      REQDIR_DEVICETOHOST | REQTYPE_CLASS | REQREC_INTERFACE, HID_REQ_GetReport,
+      FEATURE_REPORT(KEYMAP_REPORT_ID), ifVendor, (uint8_t*)&report, sizeof(report)
+    );
+  } while (report.op == KEYMAP_BUSY);
+  return report.op;
+}
+
+// Program the keymap given in the trace
+static void programKeymap(const char* const path, const size_t count) {
+  bool ok = keymapStep(KEYMAP_OP_BEGIN, (uint8_t)count, NULL) == KEYMAP_STAGING;
+  for (size_t i = 0; ok && i < count; ++i) {
+    ok = keymapStep(KEYMAP_OP_ENTRY, (uint8_t)i, &AT(keys, KeymapEntry, i)) == KEYMAP_STAGING;
+  }
+  if (!ok || keymapStep(KEYMAP_OP_COMMIT, 0, NULL) != KEYMAP_IDLE) {
+    fprintf(stderr, "%s: programming the keymap failed\n", path);
+    exit(2);
+  }
+}
+#endif
+
+static bool stalled(void) {
+  for (size_t i = 0; i < stalls.count; ++i) {
+    if (now >= AT(stalls, Stall, i).from && now < AT(stalls, Stall, i).to) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// Apply an edge of a receiver's detector output to its pin: PC7 for the first,
+// PD0 to PD2 (INT0 to INT2) for the others
+static void applyEdge(const uint8_t receiver, const bool mark) {
+  const bool rising = !mark;  // the detector output is active-low
+  lastEdge = now;
+  if (suspend && !wakeEdge) {
+    wakeEdge = now;
+  }
+  if (receiver > 0) {
+    const uint8_t n = receiver - 1;
+    if (mark) {
+      PIND &= (uint8_t)~_BV(n);
+    } else {
+      PIND |= _BV(n);
+    }
+    if (!poweredDown() && (EIMSK & _BV(n)) && ((EICRA >> (2 * n)) & 3) == _BV(ISC00)) {
+      if (n == 0) {
+        INTERRUPT(INT0_vect);
+      } else if (n == 1) {
+        INTERRUPT(INT1_vect);
+      } else {
+        INTERRUPT(INT2_vect);
+      }
+    }
+    return;
+  }
+  if (mark) {
+    PINC &= (uint8_t)~_BV(7);
+  } else {
+    PINC |= _BV(7);
+  }
+  if (poweredDown()) {
+    if (mark && wakeArmed() && !wakeAt) {
+      wakeAt = now + WAKE_TICKS;  // see tick()
+    }
+    return;
+  }
+  if ((TIMSK1 & _BV(ICIE1)) && rising == !!(TCCR1B & _BV(ICES1))) {
+    ICR1 = TCNT1;
+    INTERRUPT(TIMER1_CAPT_vect);
+  }
+  if ((EIMSK & _BV(INT4)) && (EICRB & (_BV(ISC41) | _BV(ISC40))) == _BV(ISC40)) {
+    INTERRUPT(INT4_vect);
+  }
+}
+
+// The host suspends and resumes the bus (see the suspend directive)
+static void busTick(void) {
+  if (!suspend && nextSuspend < suspends.count && AT(suspends, Stall, nextSuspend).from == now) {
+    suspend = &AT(suspends, Stall, nextSuspend++);
+    suspendSeen = now + SUSPEND_MS * TICKS_PER_MS;
+    resumeAt = suspend->to;
+    wakeEdge = 0;
+  }
+  if (!suspend) {
+    return;
+  }
+  ++suspendTicks;
+  if (now == suspendSeen) {
+    USB_DeviceState = DEVICE_STATE_Suspended;
+    INTERRUPT(EVENT_USB_Device_Suspend);
+  }
+  if (shimTakeRemoteWakeup() && now + RESUME_MS * TICKS_PER_MS < resumeAt) {
+    resumeAt = now + RESUME_MS * TICKS_PER_MS;
+    ++remoteWakeups;
+    latencyAdd(&wakeupLatency, wakeEdge);
+  }
+  if (now >= resumeAt) {
+    suspend = NULL;
+    USB_DeviceState = DEVICE_STATE_Configured;
+    INTERRUPT(EVENT_USB_Device_WakeUp);
+    resumed = wakeEdge != 0;
+  }
+}
+
+// Advance the hardware by one Timer1 tick
+static void tick(void) {
+  ++now;
+  if (poweredDown()) {
+    ++downTicks;
+  }
+  if (wakeAt == now) {
+    // The clock has started: a low level on INT4 still there interrupts, but
+    // the CPU wakes up either way
+    wakeAt = 0;
+    if (!(PINC & _BV(7)) && wakeArmed()) {
+      INTERRUPT(INT4_vect);
+    } else {
+      shimAsleep = false;
+    }
+  }
+  busTick();
+  if ((TCCR1B & (_BV(CS12) | _BV(CS11) | _BV(CS10))) && !poweredDown()) {
+    if (++TCNT1 == 0 && (TIMSK1 & _BV(TOIE1))) {
+      INTERRUPT(TIMER1_OVF_vect);
+    }
+    if (TCNT1 == OCR1A && (TIMSK1 & _BV(OCIE1A))) {
+      INTERRUPT(TIMER1_COMPA_vect);
+    }
+    if (TCNT1 == OCR1B && (TIMSK1 & _BV(OCIE1B))) {
+      INTERRUPT(TIMER1_COMPB_vect);
+    }
+    if (TCNT1 == OCR1C && (TIMSK1 & _BV(OCIE1C))) {
+      INTERRUPT(TIMER1_COMPC_vect);
+    }
+  }
+  if ((now % 128) == 0 && (TCCR0B & 7) == (_BV(CS02) | _BV(CS00))) {
+    // Timer0 at F_CPU/1024, in CTC mode
+    if (TCNT0 == OCR0A) {
+      TCNT0 = 0;
+      if (TIMSK0 & _BV(OCIE0A)) {
+        INTERRUPT(TIMER0_COMPA_vect);
+      }
+    } else {
+      ++TCNT0;
+    }
+  }
+  if ((now % TICKS_PER_MS) == 0 && !suspend) {
+    const uint64_t frame = now / TICKS_PER_MS;
+    shimStartOfFrame();
+    INTERRUPT(EVENT_USB_Device_StartOfFrame);
+    if (!stalled()) {
+      for (uint8_t ep = 1; ep < 8; ++ep) {
+        if (pollInterval[ep] && (frame % pollInterval[ep]) == 0) {
+          shimPollIn(ep);
+        }
+      }
+    }
+  }
+  if ((now % LOOP_TICKS) == 0) {
+    ++loopSlots;
+    if (sleeping) {
+      slotWoken = !shimAsleep;  // run once the iteration which slept returns
+    } else if (!shimAsleep) {
+      ++loopsAwake;
+      loopOnce();
+      while (slotWoken) {
+        slotWoken = false;
+        ++loopsAwake;
+        loopOnce();
+      }
+    }
+    const bool lit = !(PORTD & _BV(5));  // the blue LED is active-low
+    if (ledLit && !lit) {
+      latencyAdd(&ledLatency, lastEdge);
+      ++kbdReleases;
+    }
+    ledLit = lit;
+  }
+}
+
+// Apply the edges due now, and advance by a tick
+static size_t nextEdge;
+static void step(void) {
+  while (nextEdge < edges.count && AT(edges, TraceEdge, nextEdge).at == now) {
+    const TraceEdge* const e = &AT(edges, TraceEdge, nextEdge++);
+    applyEdge(e->receiver, e->mark);
+  }
+  tick();
+}
+
+// The firmware has gone to sleep: run the hardware until it wakes (or the run
+// ends), after which the main-loop iteration which slept carries on
+static uint64_t runEnd;
+static void onSleep(void) {
+  sleeping = true;
+  while (shimAsleep && now < runEnd) {
+    step();
+  }
+  sleeping = false;
+}
+
+// Compare the reports received on each endpoint that has expectations
+static bool check(const char* const name) {
+  bool ok = true;
+  for (uint8_t ep = 1; ep < 8; ++ep) {
+    size_t e = 0, r = 0;
+    bool any = false;
+    for (;;) {
+      while (e < expected.count && AT(expected, Report, e).epNum != ep) {
+        ++e;
+      }
+      while (r < received.count && AT(received, Report, r).epNum != ep) {
+        ++r;
+      }
+      if (e == expected.count) {
+        if (any && r != received.count) {
+          fprintf(stderr, "%s: unexpected report at %.3fms: ", name, (double)AT(received, Report, r).at / TICKS_PER_MS);
+          printReport(stderr, &AT(received, Report, r));
+          fprintf(stderr, "\n");
+          ok = false;
+        }
+        break;
+      }
+      any = true;
+      const Report* const exp = &AT(expected, Report, e);
+      if (r == received.count) {
+        fprintf(stderr, "%s: missing report: ", name);
+        printReport(stderr, exp);
+        fprintf(stderr, "\n");
+        ok = false;
+        break;
+      }
+      const Report* const got = &AT(received, Report, r);
+      if (got->length != exp->length || memcmp(got->data, exp->data, got->length)) {
+        fprintf(stderr, "%s: at %.3fms expected ", name, (double)got->at / TICKS_PER_MS);
+        printReport(stderr, exp);
+        fprintf(stderr, ", got ");
+        printReport(stderr, got);
+        fprintf(stderr, "\n");
+        ok = false;
+        break;
+      }
+      ++e;
+      ++r;
+    }
+  }
+  return ok;
+}
+
+// Compare the pulses and spaces captured with the trace's. Those after the
+// firmware's last timeout are only known to be long.
+static bool checkCapture(const char* const name) {
+  const size_t count = edges.count ? edges.count - 1 : 0;
+  bool ok = true;
+  capturefileEnd(&captureFile, onCapturePulse, NULL);
+  for (size_t i = 0; i < count && ok; ++i) {
+    const TraceEdge* const e = &AT(edges, TraceEdge, i);
+    const uint64_t ticks = e[1].at - e[0].at;
+    const uint64_t longSpace = LONG_SPACE_MS * TICKS_PER_MS;
+    if (i == captured.count) {
+      fprintf(stderr, "%s: capture ends early, at %.3fms\n", name, (double)e->at / TICKS_PER_MS);
+      ok = false;
+    } else {
+      const Pulse* const got = &AT(captured, Pulse, i);
+      if (got->mark != e->mark || (got->ticks != ticks && (got->mark || ticks < longSpace || got->ticks < longSpace))) {
+        fprintf(
+          stderr, "%s: at %.3fms expected a %s of %.1fus, captured a %s of %.1fus\n", name,
+          (double)e->at / TICKS_PER_MS, e->mark ? "pulse" : "space", ticks / 2.0, got->mark ? "pulse" : "space", got->ticks / 2.0
+        );
+        ok = false;
+      }
+    }
+  }
+  if (ok && captured.count > count) {
+    fprintf(stderr, "%s: %zu more pulses and spaces captured than were sent\n", name, captured.count - count);
+    ok = false;
+  }
+  return ok && captureFile.missed == 0 && captureFile.lost == 0;
+}
+
+static bool run(const char* const path, const unsigned repeats) {
+  uint64_t end = SETTLE_MS * TICKS_PER_MS;
+  edges.count = expected.count = received.count = stalls.count = suspends.count = keys.count = 0;
+  memset(altSetting, 0, sizeof(altSetting));
+  memset(boot, 0, sizeof(boot));
+  memset(&captureFile, 0, sizeof(captureFile));
+  captured.count = 0;
+  capturing = false;
+  memset(&ledLatency, 0, sizeof(ledLatency));
+  memset(&kbdLatency, 0, sizeof(kbdLatency));
+  ledLit = kbdDown = false;
+  kbdReleases = 0;
+  shimAsleep = false;
+  suspend = NULL;
+  nextSuspend = 0;
+  sleeping = slotWoken = false;
+  wakeAt = suspendTicks = downTicks = wakeEdge = 0;
+  remoteWakeups = 0;
+  resumed = false;
+  memset(&wakeupLatency, 0, sizeof(wakeupLatency));
+  memset(&reportLatency, 0, sizeof(reportLatency));
+  size_t keymapSize = 0;
+  for (unsigned i = 0; i < repeats; ++i) {
+    end = loadTrace(path, end);
+    keymapSize = i ? keymapSize : keys.count;  // the same keys repeat
+  }
+  qsort(edges.items, edges.count, edges.size, compareEdges);
+  end += TAIL_MS * TICKS_PER_MS;
+  runEnd = end;
+
+  // Reset the hardware, and start the firmware as main() does
+  now = 0;
+  PINB = PINC = PIND = 0xFF;
+  PORTB = PORTC = PORTD = 0xFF;
+  USB_Init();
+#if PROFILE_ENABLE
+  profileReset();
+#endif
+  irInit();
+  timerInit();
+#if TRACE_ENABLE
+  traceInit();
+  traceStatsFree(&traceStats);
+#endif
+#if KEYMAP_CAPACITY
+  shimEepromErase();
+  keymapInit();
+#endif
+  mouseInit();
+  sei();
+  shimSetInHook(onIn);
+  enumerate();
+#if KEYMAP_CAPACITY
+  if (keymapSize) {
+    programKeymap(path, keymapSize);
+  }
+#else
+  (void)keymapSize;
+#endif
+  if (capturing) {
+    CaptureControl control = {CAPTURE_REPORT_ID, 1};
+    shimControl(
+      REQDIR_HOSTTODEVICE | REQTYPE_CLASS | REQREC_INTERFACE, HID_REQ_SetReport,
+      FEATURE_REPORT(CAPTURE_REPORT_ID), ifVendor, (uint8_t*)&control, sizeof(control)
+    );
+  }
+
+  const clock_t start = clock();
+  nextEdge = 0;
+  loopSlots = loopsAwake = 0;
+  shimSetSleepHook(onSleep);
+  while (now < end) {
+    step();
+  }
+  shimSetSleepHook(NULL);
+  const double cpu = (double)(clock() - start) / CLOCKS_PER_SEC;
+
+  bool ok = check(path);
+  if (capturing) {
+    ok = checkCapture(path) && ok;
+  }
+  printf(
+    "%s: %s: %zu edges, %zu reports in %.1fms simulated (%.0fx real time)",
+    path, ok ? "PASS" : "FAIL", edges.count, received.count,
+    (double)now / TICKS_PER_MS, cpu > 0 ? (double)now / TICKS_PER_MS / 1000 / cpu : 0.0
+  );
+#if STATS_ENABLE
+  IrStats stats;
+  irGetStats(&stats);
+  printf(
+    "; ring: %u dropped, %u overruns, max depth %u; events: %u dropped\n",
+    stats.dropped, stats.overruns, stats.maxDepth, stats.eventsDropped
+  );
+  printf(
+    "  confirmed/vetoed: none %u/%u, veto %u/%u, majority %u/%u\n",
+    stats.confirmed[IR_CONFIRM_NONE], stats.vetoed[IR_CONFIRM_NONE],
+    stats.confirmed[IR_CONFIRM_VETO], stats.vetoed[IR_CONFIRM_VETO],
+    stats.confirmed[IR_CONFIRM_MAJORITY], stats.vetoed[IR_CONFIRM_MAJORITY]
+  );
+  printf(
+    "  errors: %u glitches, %u undecoded bursts, %u resyncs; %u frames ignored\n",
+    stats.glitches, stats.undecoded, stats.resyncs, stats.ignored
+  );
+  timingPrint();
+  if (IR_RECEIVERS > 1) {
+    printf("  receivers (frames decoded/first/missed):");
+    for (uint8_t r = 0; r < IR_RECEIVERS; ++r) {
+      const IrReceiverStats* const rx = &stats.receivers[r];
+      printf(" %u: %u/%u/%u", r, rx->frames, rx->first, rx->missed);
+    }
+    printf("\n");
+  }
+  UsbStats usb;
+  usbGetStats(&usb);
+  printf(
+    "  reports sent (data changed/idle period up): keyboard %u/%u, mouse %u/%u",
+    usb.changed[USB_REPORT_KEYBOARD], usb.idle[USB_REPORT_KEYBOARD],
+    usb.changed[USB_REPORT_MOUSE], usb.idle[USB_REPORT_MOUSE]
+  );
+#if USB_MEDIA_KEYS
+  printf(
+    ", consumer %u/%u, system %u/%u",
+    usb.changed[USB_REPORT_CONSUMER], usb.idle[USB_REPORT_CONSUMER],
+    usb.changed[USB_REPORT_SYSTEM], usb.idle[USB_REPORT_SYSTEM]
+  );
+#endif
+  printf("\n");
+#else
+  printf("\n");
+#endif
+  printf(
+    "  main loop: awake in %.1f%% of %llu slots\n",
+    loopSlots ? 100.0 * (double)loopsAwake / (double)loopSlots : 0.0, (unsigned long long)loopSlots
+  );
+  if (capturing) {
+    printf(
+      "  capture: %zu pulses and spaces, %u packets missed, %u entries dropped\n",
+      captured.count, captureFile.missed, captureFile.lost
+    );
+  }
+  latencyPrint("decoder release", "the last edge", &ledLatency);
+  latencyPrint("keyboard release", "the last edge", &kbdLatency);
+  if (suspendTicks) {
+    printf(
+      "  suspend: %.1fms, powered down for %.1f%% of it; %u remote wakeups\n",
+      (double)suspendTicks / TICKS_PER_MS, 100.0 * (double)downTicks / (double)suspendTicks, remoteWakeups
+    );
+    latencyPrint("remote wakeup", "the first edge", &wakeupLatency);
+    latencyPrint("first report", "the first edge", &reportLatency);
+  }
+#if PROFILE_ENABLE
+  // As measured by the firmware, to when the report was handed over
+  const ProfileIsrStats* const l = &profileFreeze()->latency;
+  if (l->count) {
+    printf(
+      "  edge to Endpoint_ClearIN(): %u reports, %.3f/%.3f/%.3fms min/mean/max\n",
+      l->count, (double)l->min / TICKS_PER_MS,
+      (double)l->total / l->count / TICKS_PER_MS, (double)l->max / TICKS_PER_MS
+    );
+  }
+#endif
+#if TRACE_ENABLE
+  traceStatsPrint(stdout, &traceStats, "  ");
+#endif
+  return ok;
+}
+
+int main(int argc, char* argv[]) {
+  unsigned repeats = 1;
+  bool ok = true;
+  int i = 1;
+  for (; i < argc && argv[i][0] == '-'; ++i) {
+    if (!strcmp(argv[i], "-q")) {
+      quiet = true;
+    } else if (!strcmp(argv[i], "-n") && i + 1 < argc) {
+      repeats = (unsigned)atoi(argv[++i]);
+    } else {
+      break;
+    }
+  }
+  if (i == argc) {
+    fprintf(stderr, "Usage: %s [-q] [-n <repeats>] <trace>...\n", argv[0]);
+    return 2;
+  }
+  for (; i < argc; ++i) {
+    ok = run(argv[i], repeats) && ok;
+  }
+  return ok ? 0 : 1;
+}
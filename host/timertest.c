@@ -0,0 +1,94 @@
+// Software timer test. Drives timer.c's wheel directly, a tick at a time, and
+// checks that a callback may start and stop other timers which are due in the
+// same tick: one that is stopped must not fire, and one that is restarted must
+// fire once, when its new delay is up, and leave the wheel intact.
+//
+// Usage: timertest
+//
+// Exits non-zero if any timer fires when it shouldn't, or doesn't when it
+// should.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <avr/io.h>
+#include "IrateConfig.h"
+#include "sched.h"
+#include "timer.h"
+
+#define FIRST   TIMER_JIGGLE         // the callbacks are called in TimerId order,
+#define RESTART TIMER_IDLE_KEYBOARD  // so the first one's runs before the others'
+#define STOP    TIMER_IDLE_MOUSE
+
+volatile uint8_t schedWork;
+
+static unsigned fired[TIMER_COUNT];
+static uint16_t firedAt[TIMER_COUNT];
+static int failures = 0;
+
+static void tickOnce(void) {
+  timerSofTick();
+  timerPoll();
+}
+
+static void count(const TimerId id) {
+  ++fired[id];
+  firedAt[id] = timerNow();
+}
+
+static void first(const TimerId id) {
+  count(id);
+  timerStart(RESTART, 5, 0, count);
+  timerStop(STOP);
+}
+
+static void expect(const char* what, const TimerId id, const unsigned times, const uint16_t at) {
+  if (fired[id] != times || (times && firedAt[id] != at)) {
+    printf("%s: fired %u times (last at %u), expected %u (at %u)\n", what, fired[id], firedAt[id], times, at);
+    ++failures;
+  }
+}
+
+int main(void) {
+  timerInit();
+  timerUseSof(true);
+
+  // All three are due at once; the first's callback restarts one of the
+  // others and stops the third, before either of theirs has been called
+  const uint16_t due = timerNow() + 3;
+  timerStart(FIRST, 3, 0, first);
+  timerStart(RESTART, 3, 0, count);
+  timerStart(STOP, 3, 10, count);
+  for (int t = 0; t < 3; ++t) {
+    tickOnce();
+  }
+  expect("first", FIRST, 1, due);
+  expect("restarted, in the same tick", RESTART, 0, 0);
+  expect("stopped", STOP, 0, 0);
+
+  for (int t = 0; t < 20; ++t) {
+    tickOnce();
+  }
+  expect("restarted", RESTART, 1, due + 5);
+  expect("stopped, afterwards", STOP, 0, 0);
+
+  // The wheel is still intact: every timer can be started on the same slot,
+  // and fires once
+  for (TimerId id = 0; id < TIMER_COUNT; ++id) {
+    fired[id] = 0;
+    timerStart(id, 8, 0, count);
+  }
+  for (int t = 0; t < 20; ++t) {
+    tickOnce();
+  }
+  for (TimerId id = 0; id < TIMER_COUNT; ++id) {
+    expect("afterwards", id, 1, timerNow() - 12);
+  }
+
+  if (failures) {
+    return EXIT_FAILURE;
+  }
+  printf("timers: ok\n");
+  return EXIT_SUCCESS;
+}
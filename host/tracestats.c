@@ -0,0 +1,127 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "irproto.h"
+#include "tracestats.h"
+
+#define BUCKETS 8  // histogram of the totals: <4, <8, <16, ... <256, >=256ms
+
+static const char* const stageNames[TRACE_NUM_STAGES] = {
+  "on air", "decode", "queue", "host poll", "total"
+};
+static const char* const protocolNames[] = {
+  "none", "SIRC12", "SIRC15", "SIRC20", "NEC", "RC5", "RC6"
+};
+
+// A span of the trace clock, in ms
+static double span(const uint16_t from, const uint16_t to) {
+  return (double)(uint16_t)(to - from) * TRACE_TICKS * IR_TIMER_PRESCALER * 1000.0 / F_CPU;
+}
+
+static void stages(const TraceRecord* const r, double* const ms) {
+  ms[TRACE_STAGE_AIR] = span(r->edge, r->decided);
+  ms[TRACE_STAGE_DECODE] = span(r->decided, r->queued);
+  ms[TRACE_STAGE_QUEUE] = span(r->queued, r->sent);
+  ms[TRACE_STAGE_POLL] = span(r->sent, r->collected);
+  ms[TRACE_STAGE_TOTAL] = span(r->edge, r->collected);
+}
+
+void traceStatsDescribe(FILE* const out, const TraceRecord* const r) {
+  double ms[TRACE_NUM_STAGES];
+  stages(r, ms);
+  fprintf(
+    out, "#%-3u %-7s %-6s 0x%02X:", r->sequence, r->type == IR_EVENT_PRESS ? "press" : "release",
+    r->protocol < sizeof(protocolNames) / sizeof(*protocolNames) ? protocolNames[r->protocol] : "?", r->command
+  );
+  for (unsigned s = 0; s < TRACE_NUM_STAGES; ++s) {
+    fprintf(out, " %s %.3f", stageNames[s], ms[s]);
+  }
+  fprintf(out, "ms\n");
+}
+
+void traceStatsAdd(TraceStats* const stats, const TraceRecord* const r) {
+  const unsigned type = (r->type == IR_EVENT_PRESS) ? 0 : 1;
+  if (stats->started && r->sequence != stats->sequence) {
+    stats->lost += (uint8_t)(r->sequence - stats->sequence);
+  }
+  stats->started = true;
+  stats->sequence = r->sequence + 1;
+  ++stats->records;
+  if (stats->count[type] == stats->capacity) {
+    stats->capacity = stats->capacity ? 2 * stats->capacity : 64;
+    for (unsigned t = 0; t < 2; ++t) {
+      for (unsigned s = 0; s < TRACE_NUM_STAGES; ++s) {
+        stats->samples[t][s] = realloc(stats->samples[t][s], stats->capacity * sizeof(double));
+        if (!stats->samples[t][s]) {
+          perror("realloc");
+          exit(2);
+        }
+      }
+    }
+  }
+  double ms[TRACE_NUM_STAGES];
+  stages(r, ms);
+  for (unsigned s = 0; s < TRACE_NUM_STAGES; ++s) {
+    stats->samples[type][s][stats->count[type]] = ms[s];
+  }
+  ++stats->count[type];
+}
+
+static int compare(const void* const a, const void* const b) {
+  const double x = *(const double*)a, y = *(const double*)b;
+  return (x > y) - (x < y);
+}
+
+// The pth percentile of n sorted samples (nearest rank)
+static double percentile(const double* const sorted, const size_t n, const unsigned p) {
+  size_t rank = (n * p + 99) / 100;
+  return sorted[rank ? rank - 1 : 0];
+}
+
+void traceStatsPrint(FILE* const out, const TraceStats* const stats, const char* const indent) {
+  static const char* const typeNames[2] = {"presses", "releases"};
+  fprintf(out, "%strace records: %u, %u lost\n", indent, stats->records, stats->lost);
+  for (unsigned t = 0; t < 2; ++t) {
+    const size_t n = stats->count[t];
+    if (n == 0) {
+      continue;
+    }
+    double* const sorted = malloc(n * sizeof(double));
+    if (!sorted) {
+      perror("malloc");
+      exit(2);
+    }
+    fprintf(out, "%s%s: %zu\n%s  %-10s %9s %9s %9s\n", indent, typeNames[t], n, indent, "ms", "p50", "p99", "max");
+    for (unsigned s = 0; s < TRACE_NUM_STAGES; ++s) {
+      memcpy(sorted, stats->samples[t][s], n * sizeof(double));
+      qsort(sorted, n, sizeof(double), compare);
+      fprintf(
+        out, "%s  %-10s %9.3f %9.3f %9.3f\n", indent, stageNames[s],
+        percentile(sorted, n, 50), percentile(sorted, n, 99), sorted[n - 1]
+      );
+    }
+    unsigned histogram[BUCKETS] = {0};
+    for (size_t i = 0; i < n; ++i) {
+      unsigned b = 0;
+      while (b < BUCKETS - 1 && stats->samples[t][TRACE_STAGE_TOTAL][i] >= (double)(4U << b)) {
+        ++b;
+      }
+      ++histogram[b];
+    }
+    fprintf(out, "%s  total:", indent);
+    for (unsigned b = 0; b < BUCKETS; ++b) {
+      fprintf(out, " %s%ums: %u", b < BUCKETS - 1 ? "<" : ">=", b < BUCKETS - 1 ? 4U << b : 4U << (b - 1), histogram[b]);
+    }
+    fprintf(out, "\n");
+    free(sorted);
+  }
+}
+
+void traceStatsFree(TraceStats* const stats) {
+  for (unsigned t = 0; t < 2; ++t) {
+    for (unsigned s = 0; s < TRACE_NUM_STAGES; ++s) {
+      free(stats->samples[t][s]);
+    }
+  }
+  memset(stats, 0, sizeof(*stats));
+}
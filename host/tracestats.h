@@ -0,0 +1,42 @@
+#ifndef HOST_TRACESTATS_H
+#define HOST_TRACESTATS_H
+
+// Latency distributions of the firmware's trace records (see trace.h), by
+// stage, for presses and releases separately.
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "trace.h"
+
+typedef enum {
+  TRACE_STAGE_AIR,     // edge to decided: the frame on the air
+  TRACE_STAGE_DECODE,  // decided to queued
+  TRACE_STAGE_QUEUE,   // queued to sent
+  TRACE_STAGE_POLL,    // sent to collected
+  TRACE_STAGE_TOTAL,   // edge to collected
+  TRACE_NUM_STAGES
+} TraceStage;
+
+typedef struct {
+  double*  samples[2][TRACE_NUM_STAGES];  // in ms, by IrEventType
+  size_t   count[2];
+  size_t   capacity;
+  unsigned records;
+  unsigned lost;      // gaps in the sequence numbers
+  bool     started;
+  uint8_t  sequence;  // the next one expected
+} TraceStats;
+
+// Describe one record, e.g "press SIRC15 0x12: ..." with each stage in ms.
+void traceStatsDescribe(FILE* out, const TraceRecord* record);
+
+void traceStatsAdd(TraceStats* stats, const TraceRecord* record);
+
+// Print p50/p99/max of each stage, and a histogram of the totals, with each
+// line indented by the given prefix.
+void traceStatsPrint(FILE* out, const TraceStats* stats, const char* indent);
+
+void traceStatsFree(TraceStats* stats);
+
+#endif
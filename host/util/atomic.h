@@ -0,0 +1,11 @@
+#ifndef HOST_UTIL_ATOMIC_H
+#define HOST_UTIL_ATOMIC_H
+
+// Host-side stand-in for <util/atomic.h>. The simulation never preempts the
+// main loop, so an atomic block is just an ordinary block.
+
+#define ATOMIC_RESTORESTATE
+#define ATOMIC_FORCEON
+#define ATOMIC_BLOCK(type) for (int _atomicOnce = 1; _atomicOnce; _atomicOnce = 0)
+
+#endif
@@ -2,38 +2,208 @@
 #include <stdbool.h>
 #include <avr/interrupt.h>
 #include <avr/io.h>
+#include <util/atomic.h>
+#include "IrateConfig.h"
+#include "capture.h"
 #include "ir.h"
+#include "irproto.h"
+#include "profile.h"
+#include "sched.h"
+#include "trace.h"
 
-typedef enum {
-  S_AWAIT_START_MARK,
-  S_AWAIT_START_SPACE,
-  S_AWAIT_BIT_MARK,
-  S_AWAIT_BIT_SPACE
-} State;
-static volatile State state = S_AWAIT_START_MARK;
-static volatile uint8_t bitNum;
-static volatile uint16_t accumulator;
-static volatile uint16_t value = 0x0000;
-
-// Timer controls, to start, reset and stop the 2MHz timer
-static inline void timerReset(void) {
-  TCNT1 = 0;
+// Timer1 free-runs at 2MHz, and every edge is timestamped against it: either
+// in hardware by the input-capture unit (IR_FRONTEND_ICP1), or in software by
+// the INT4 ISR (IR_FRONTEND_INT4). The OCR1A compare is used to detect 26ms
+// periods of silence following the last edge; it keeps firing every 26ms for a
+// while, so protocols which repeat more slowly than that can still tell when
+// their button is released.
+#define TIMEOUT_TICKS IR_TICKS(26000)
+#define MAX_TIMEOUTS  8
+
+// The ISRs do nothing but push timestamped edges onto this ring; the decoding
+// is done by irPoll(), from the main loop. The ISRs (which cannot preempt one
+// another) are the only producer and irPoll() is the only consumer, so each
+// index is written from one side only, and being single bytes they are read
+// and written atomically. When the ring is full, new edges are dropped, and
+// the next edge that does fit is flagged so the decoder can resynchronise.
+//
+// The edge ISRs' cost no longer depends on what the decoder is doing. Counted
+// from the listing of a release build for the AT90USB162 (by clang 14's AVR
+// backend, at -Os), TIMER1_CAPT_vect takes 136 cycles on its longest path (an
+// edge which fits in the ring) from its first instruction to its RETI, 59 of
+// them saving and restoring ten registers and SREG; 143 cycles, or 8.9us at
+// 16MHz, with the interrupt response and the vector's JMP. That's from the
+// instruction timings, not a board: build with PROFILE_ENABLE and read
+// host/irprof's PROFILE_EDGE figures (which leave out the save/restore and the
+// interrupt response) to check it on one.
+#define RING_SIZE 16  // must be a power of two
+#define EDGE_MARK    _BV(0)  // the pin was asserted by this edge
+#define EDGE_TIMEOUT _BV(1)  // not an edge: another 26ms have passed without one
+#define EDGE_OVERRUN _BV(2)  // one or more edges were dropped before this one
+#define EDGE_FINAL   _BV(3)  // a timeout, and the last until the next edge
+#define EDGE_RECEIVER_SHIFT 4  // which receiver an edge is from (not timeouts)
+#define EDGE_RECEIVER (3 << EDGE_RECEIVER_SHIFT)
+// Each edge's time and flags are in separate arrays, as indexing an array of
+// 3-byte entries takes a multiply, which the AT90USB162 (having no MUL) may
+// make a library call; in the ISR, that also makes it save eight more registers
+static volatile uint16_t ringTicks[RING_SIZE];
+static volatile uint8_t ringFlags[RING_SIZE];
+static volatile uint8_t ringHead = 0;  // written only by the ISRs
+static volatile uint8_t ringTail = 0;  // written only by irPoll()
+static volatile uint8_t overrun = 0;
+#if STATS_ENABLE
+static volatile uint16_t dropped = 0;
+static IrStats stats;
+#define COUNT(counter) (++stats.counter)
+#else
+#define COUNT(counter)
+#endif
+
+// Decoded presses and releases are queued here for the USB side, so that every
+// one of them reaches the host even if it isn't polling for a while. This is
+// another single-producer (irPoll()), single-consumer (irGetEvent()) ring with
+// single-byte indices, so it needs no locking either. A press is only queued
+// if there is also room for its release, so a release can never be dropped
+// (which would leave the key stuck down).
+#define EVENT_QUEUE_SIZE 8  // must be a power of two
+static volatile IrEvent events[EVENT_QUEUE_SIZE];
+static volatile uint8_t eventHead = 0;  // written only by irPoll()
+static volatile uint8_t eventTail = 0;  // written only by irGetEvent()
+static bool pressDropped = false;       // so its release is dropped too
+
+// Decoder state, maintained by irPoll()
+static IrCode held;              // the button currently held, if any
+static uint8_t heldToggle;       // ...and its toggle bit
+static uint8_t silence = 0;      // timeouts since the last frame
+static bool ignoring = false;    // the last frame with a button-code was unwanted
+
+// Each receiver's edges are measured, and glitch-filtered, on their own (see
+// IR_GLITCH_FILTER). Each pulse is held back until the one after it is known
+// not to be a glitch: a pulse shorter than GLITCH_TICKS is merged, along with
+// the pulse after it, into the held-back one. An edge in the same direction as
+// the one before means the edge between them was lost, so those pulses are
+// merged too.
+#define GLITCH_TICKS IR_TICKS(IR_GLITCH_FILTER)
+typedef struct {
+  uint16_t lastTicks;   // time of the last edge
+  bool     lastMark;    // whether the last edge asserted the pin
+  bool     idle;        // whether there was a timeout after it
+  bool     pulseHeld;   // whether a pulse is being held back
+  bool     pulseMark;   // ...whether it's a mark
+  uint16_t pulseWidth;  // ...its width so far
+  uint16_t pulseEnd;    // ...and the time of the edge ending it
+} Receiver;
+static Receiver receivers[IR_RECEIVERS];
+
+static inline bool isGlitch(const uint16_t width) {
+#if IR_GLITCH_FILTER
+  return width < GLITCH_TICKS;
+#else
+  (void)width;
+  return false;
+#endif
 }
-static inline void timerStart(void) {
-  timerReset();
-  TCCR1B = _BV(WGM12) | _BV(CS11);  // CTC mode, prescaler 8 (2 MHz)
+
+// The main loop may be asleep when a held-back pulse (the one ending at the
+// given time) is due to be released, so the OCR1B compare wakes it then. If
+// that time has passed already (or passes while the compare is being set),
+// flag the work straight away.
+static void flushArm(const uint16_t pulseEnd) {
+#if IR_GLITCH_FILTER
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+    OCR1B = pulseEnd + 2 * GLITCH_TICKS;
+    TIFR1 = _BV(OCF1B);
+    TIMSK1 |= _BV(OCIE1B);
+    if ((uint16_t)(TCNT1 - pulseEnd) >= 2 * GLITCH_TICKS) {
+      schedPost(WORK_IR);
+    }
+  }
+#else
+  (void)pulseEnd;
+#endif
 }
-static inline void timerStop(void) {
-  TCCR1B = 0x00;
+
+// Error tracking, maintained by irPoll()
+static bool burstMarks = false;  // whether the current burst has any marks
+static bool burstFrames = false; // ...and whether it has decoded
+
+// Confirmation (see IrConfirm), maintained by irPoll()
+static uint8_t voting = IR_CONFIRM_NONE;  // mode of the open vote, if any
+static IrCode candidate;                  // the button-code being voted on
+static uint8_t candidateToggle;           // ...and its toggle bit
+static uint8_t agree;                     // frames agreeing with it so far
+static uint8_t disagree;                  // ...and disagreeing
+static int8_t burstVote;                  // this burst's vote so far: +1, -1 or 0
+
+#if IR_RECEIVERS > 1
+// Diversity: when several receivers see a frame, the first to decode it wins,
+// and the same frame from the others (decoded within DUPLICATE_TICKS of it) is
+// dropped. A receiver which decodes two frames in a row decoded two different
+// ones, however alike.
+#define DUPLICATE_TICKS IR_TICKS(5000)
+static IrFrame lastFrame;        // the frame acted on last
+static uint16_t lastFrameTicks;  // ...when it was
+static uint8_t seenBy = 0;       // ...and the receivers which decoded it
+#endif
+
+#if TRACE_ENABLE
+// Trace-clock times (see trace.h), maintained by irPoll()
+static uint16_t traceFrame;      // the first edge of the latest frame
+static uint16_t traceCandidate;  // ...and of the candidate's first frame
+static uint16_t traceLastEdge;   // the last edge
+#endif
+
+#define FRAME_GAP IR_TICKS(8000)  // a mark after a longer space starts a frame
+
+#if IR_FAST_RELEASE
+// Fast release (see IrateConfig.h). Frame periods are too long for 16-bit
+// ticks, so the time left until the held button's next frame is overdue is
+// counted down as the timestamps of the ring entries advance (and likewise the
+// times since the frame started, and since the last edge). While a button is
+// held, consecutive entries are never more than one timeout apart.
+#define RELEASE_GUARD IR_TICKS(20)    // too soon to set a compare for
+static uint32_t frameAge;         // time since the latest frame started
+static uint32_t frameInterval;    // ...and from the one before to it
+static uint32_t quietFor;         // time since the last edge
+static uint16_t clockTicks;       // time of the last ring entry
+static bool releaseDue = false;   // whether the held button has a deadline
+static uint32_t releaseIn;        // ...and how long after clockTicks it is
+#endif
+
+// Timeout controls, to (re)arm and disarm the 26ms timeout
+static volatile uint8_t timeouts;
+static inline void timeoutArm(const uint16_t now) {
+  OCR1A = now + TIMEOUT_TICKS;
+  TIFR1 = _BV(OCF1A);  // discard any stale match
+  TIMSK1 |= _BV(OCIE1A);
+  timeouts = 0;
+}
+static inline void timeoutDisarm(void) {
+  TIMSK1 &= ~_BV(OCIE1A);
+}
+
+// Called only from the ISRs
+static inline void ringPush(const uint16_t ticks, const uint8_t flags) {
+  const uint8_t head = ringHead;
+  const uint8_t next = (head + 1) & (RING_SIZE - 1);
+  if (next == ringTail) {
+    overrun = EDGE_OVERRUN;  // full: drop this edge
+#if STATS_ENABLE
+    ++dropped;
+#endif
+  } else {
+    ringTicks[head] = ticks;
+    ringFlags[head] = flags | overrun;
+    overrun = 0;
+    ringHead = next;
+  }
+  schedPost(WORK_IR);
 }
 
 // Pin status for the (active-low) detector signal
 static inline bool pinAsserted(void) {
   return (PINC & _BV(7)) == 0;
 }
-static inline bool pinDeasserted(void) {
-  return (PINC & _BV(7)) != 0;
-}
 
 // Blue LED controls (LEDs are wired active-low)
 static inline void ledOn(void) {
@@ -43,117 +213,712 @@ static inline void ledOff(void) {
   PORTD |= _BV(5);
 }
 
-// This is called if things get out of sync. It'll try to re-sync at the next
-// mark.
-static inline void fsmReset(void) {
-  timerStop();
+// Red LED controls: lit when a burst fails to decode or edges are dropped, and
+// out again once a frame decodes
+static inline void errorOn(void) {
+  PORTD &= ~_BV(6);
+}
+static inline void errorOff(void) {
+  PORTD |= _BV(6);
+}
+
+// Queue an event for the USB side
+static void pushEvent(const uint8_t type, const uint16_t ticks) {
+  const uint8_t head = eventHead;
+  const uint8_t used = (head - eventTail) & (EVENT_QUEUE_SIZE - 1);
+  const uint8_t needed = (type == IR_EVENT_PRESS) ? 2 : 1;  // see above
+  if (type == IR_EVENT_RELEASE && pressDropped) {
+    pressDropped = false;
+  } else if (EVENT_QUEUE_SIZE - 1 - used < needed) {
+    pressDropped = true;
+    COUNT(eventsDropped);
+  } else {
+    events[head].type = type;
+    events[head].code = held;
+#if PROFILE_ENABLE
+    events[head].ticks = ticks;
+#endif
+#if TRACE_ENABLE
+    events[head].traceEdge = (type == IR_EVENT_PRESS) ? traceCandidate : traceLastEdge;
+    events[head].traceDecided = traceTime(ticks);
+    events[head].traceQueued = traceNow();
+#endif
+#if !PROFILE_ENABLE && !TRACE_ENABLE
+    (void)ticks;
+#endif
+    eventHead = (head + 1) & (EVENT_QUEUE_SIZE - 1);
+    schedPost(WORK_USB);
+  }
+}
+
+// The held button has been released.
+static void release(const uint16_t ticks) {
+  pushEvent(IR_EVENT_RELEASE, ticks);
+  held.protocol = IR_PROTO_NONE;
+  if (voting == IR_CONFIRM_VETO) {
+    voting = IR_CONFIRM_NONE;  // released before it could be vetoed
+    COUNT(confirmed[IR_CONFIRM_VETO]);
+  }
+#if IR_FAST_RELEASE
+  releaseDue = false;
+#endif
   ledOff();
-  value = 0x0000;
-  state = S_AWAIT_START_MARK;
 }
 
-// This is called for more serious problems that *should* never happen. It
-// lights the red LED, and it stays lit.
-static inline void fsmError(void) {
-  PORTD &= ~_BV(6);  // LEDs are active-low
-  fsmReset();
+#if IR_FAST_RELEASE
+// Set the held button's deadline: its protocol's frame period (plus margin)
+// after the latest frame started.
+static void releaseArm(void) {
+  const uint32_t due = irprotoPeriod(held.protocol) + IR_TICKS(IR_RELEASE_MARGIN);
+  releaseIn = (frameAge < due) ? due - frameAge : 0;
+  releaseDue = true;
 }
 
-// Pin interrupt fires on every rising and falling edge of PC7 (INT4).
-ISR(INT4_vect) {
-  switch (state) {
-    // Called at the beginning of a start mark
-    case S_AWAIT_START_MARK:
-      if (pinAsserted()) {
-        timerStart();
-        state = S_AWAIT_START_SPACE;
+// Called by irPoll() with the time of each ring entry, before it is processed.
+// If the deadline passed before it, the button was released at the deadline;
+// unless a frame (maybe the button's last) is still waiting for silence to
+// complete it, in which case the release waits for the timeout which does so.
+static void releaseClock(const uint16_t ticks) {
+  const uint16_t elapsed = ticks - clockTicks;
+  clockTicks = ticks;
+  frameAge += elapsed;
+  quietFor += elapsed;
+  if (releaseDue) {
+    if (elapsed < releaseIn) {
+      releaseIn -= elapsed;
+    } else {
+      if (!irprotoPending()) {
+        release(ticks - (uint16_t)(elapsed - releaseIn));
       }
-      break;
-
-    // Called at the end of the start mark. We can figure out the mark's
-    // duration to see whether it really is a start mark.
-    case S_AWAIT_START_SPACE:
-      if (pinDeasserted()) {
-        if (TCNT1 > 2*1800) {
-          // More than 1800us, therefore it was a start mark ("0" marks are
-          // 600us, "1" marks are 1200us, "start" marks are 2400us)
-          timerReset();
-          ledOn();
-          bitNum = accumulator = 0;
-          state = S_AWAIT_BIT_MARK;
-        } else {
-          // It was not a start mark. That's OK, we were probably just unlucky
-          // and started in the middle of a burst. Keep trying, eventually it'll
-          // work.
-          fsmReset();
-        }
+      releaseIn = 0;
+    }
+  }
+}
+
+// Called by irPoll() once the ring is drained. If the deadline comes before
+// the next timeout, bring the timeout forward to it, so the deadline gets a
+// ring entry of its own. An edge which has arrived since the ring was drained
+// has re-armed the timeout already, so then leave it alone. If the deadline is
+// too close to set a compare for, push its entry now instead.
+static void releaseSchedule(void) {
+  if (!releaseDue || releaseIn >= TIMEOUT_TICKS) {
+    return;
+  }
+  // Everything is measured from the last entry, as the spans may exceed 2^15
+  const uint16_t deadline = (uint16_t)releaseIn;
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+    if (ringHead == ringTail && (TIMSK1 & _BV(OCIE1A)) && (uint16_t)(OCR1A - clockTicks) > deadline) {
+      if ((uint16_t)(TCNT1 - clockTicks) + RELEASE_GUARD < deadline) {
+        OCR1A = clockTicks + deadline;
       } else {
-        fsmError();  // not expecting it to be asserted - noise perhaps?
+        ringPush(clockTicks + deadline, EDGE_TIMEOUT);  // the ISRs can't run, so this is safe
       }
-      break;
+    }
+  }
+}
+#endif
 
-    // Called at the beginning of a bit mark. The remote control sends 15 bits.
-    case S_AWAIT_BIT_MARK:
-      if (pinAsserted()) {
-        timerReset();
-        state = S_AWAIT_BIT_SPACE;
-      } else {
-        fsmError();  // not expecting it to be deasserted - noise perhaps?
+// Whether a frame carries the given button-code (and toggle bit)
+static inline bool matches(const IrCode* const code, const uint8_t toggle, const IrFrame* const frame) {
+  return
+    code->protocol == frame->code.protocol && code->address == frame->code.address &&
+    code->command == frame->code.command && toggle == (frame->flags & IR_FRAME_TOGGLE);
+}
+
+// Press a new button, releasing the one held before, if any.
+static void press(const IrFrame* const frame, const uint16_t ticks) {
+  if (held.protocol != IR_PROTO_NONE) {
+    release(ticks);
+  }
+  held = frame->code;
+  heldToggle = frame->flags & IR_FRAME_TOGGLE;
+  ledOn();
+  pushEvent(IR_EVENT_PRESS, ticks);
+#if IR_FAST_RELEASE
+  releaseArm();
+#endif
+}
+
+// A frame with a new button-code: open a vote on it (see IrConfirm), pressing
+// it straight away unless it needs a majority first.
+static void voteOpen(const IrFrame* const frame, const uint16_t ticks) {
+  const uint8_t mode = irConfirmMode(&frame->code);
+  candidate = frame->code;
+  candidateToggle = frame->flags & IR_FRAME_TOGGLE;
+#if TRACE_ENABLE
+  traceCandidate = traceFrame;
+#endif
+  agree = 1;
+  disagree = 0;
+  burstVote = 1;
+  if (mode == IR_CONFIRM_MAJORITY && IR_CONFIRM_VOTES > 1) {
+    voting = mode;
+    return;
+  }
+  press(frame, ticks);
+  if (mode == IR_CONFIRM_VETO) {
+    voting = mode;
+  } else {
+    COUNT(confirmed[mode]);
+  }
+}
+
+static void publish(const IrFrame* const frame, const uint16_t ticks);
+
+// Count a frame's vote on the open candidate, and close the vote if that
+// decides it. A rejected candidate gives way to a vote on the frame which
+// rejected it.
+//
+// One burst can decode twice, when the start of one protocol's frame passes
+// for a whole frame of another (the start of RC6 looks like SIRC), so each
+// burst gets one vote: a later decoding replaces an earlier one.
+static void voteCount(const IrFrame* const frame, const uint16_t ticks) {
+  const uint8_t mode = voting;
+  const uint8_t needed = (mode == IR_CONFIRM_VETO) ? 2 : IR_CONFIRM_VOTES;
+  if (burstVote > 0) {
+    --agree;
+  } else if (burstVote < 0) {
+    --disagree;
+  }
+  if (agree == 0) {
+    voting = IR_CONFIRM_NONE;  // the candidate itself was a misreading
+    publish(frame, ticks);
+    return;
+  }
+  if ((frame->flags & IR_FRAME_REPEAT) || matches(&candidate, candidateToggle, frame)) {
+    ++agree;
+    burstVote = 1;
+  } else {
+    ++disagree;
+    burstVote = -1;
+  }
+  if (agree >= needed) {
+    voting = IR_CONFIRM_NONE;
+    COUNT(confirmed[mode]);
+    if (mode == IR_CONFIRM_MAJORITY) {
+      const IrFrame winner = {candidate, candidateToggle};
+      press(&winner, ticks);
+    }
+  } else if (disagree >= needed) {
+    voting = IR_CONFIRM_NONE;
+    COUNT(vetoed[mode]);
+    if (mode == IR_CONFIRM_VETO && held.protocol != IR_PROTO_NONE) {
+      release(ticks);  // too late to take back the press, but stop it now
+    }
+    publish(frame, ticks);
+  }
+}
+
+// A decoder got a complete frame. Unless it's a repeat of the button already
+// held, it's a new button-code, which may need confirming.
+static void publish(const IrFrame* const frame, const uint16_t ticks) {
+  silence = 0;
+  burstFrames = true;
+  errorOff();
+  if (voting != IR_CONFIRM_NONE) {
+    voteCount(frame, ticks);
+  } else if (frame->flags & IR_FRAME_REPEAT) {
+    return;
+  } else if (held.protocol == IR_PROTO_NONE || !matches(&held, heldToggle, frame)) {
+    voteOpen(frame, ticks);
+  }
+}
+
+#if IR_RECEIVERS > 1
+// Count the last frame as missed by every receiver which didn't decode it.
+static void tally(void) {
+  if (seenBy) {
+    for (uint8_t r = 0; r < IR_RECEIVERS; ++r) {
+      if (!(seenBy & _BV(r))) {
+        COUNT(receivers[r].missed);
       }
-      break;
-
-    // Called at the end of a bit mark. We can figure out the mark's duration to
-    // see whether it was a "0" mark or a "1" mark.
-    case S_AWAIT_BIT_SPACE:
-      if (pinDeasserted()) {
-        const uint16_t t = TCNT1;
-        if (t < 2*1800) {
-          timerReset();
-          ++bitNum;
-          accumulator <<= 1;  // assume it was a "0" mark
-          if (t > 2*900) {
-            ++accumulator;    // nope, it was a "1" mark
-          }
-          if (bitNum == 15) {
-            value = accumulator;  // "publish" value so USB side has access to it
-            state = S_AWAIT_START_MARK;  // got all 15 bits
-          } else {
-            state = S_AWAIT_BIT_MARK;
-          }
-        } else {
-          fsmError();  // a start mark in the middle of a bunch of data bits
-        }
+    }
+    seenBy = 0;
+  }
+}
+#endif
+
+// Whether a frame is wanted (see irWanted()). A repeat code is wanted if the
+// frame it repeats was.
+static bool wanted(const IrFrame* const frame) {
+  if (!(frame->flags & IR_FRAME_REPEAT)) {
+    ignoring = !irWanted(&frame->code);
+  }
+  if (!ignoring) {
+    return true;
+  }
+  COUNT(ignored);
+  burstFrames = true;
+  errorOff();
+#if IR_FAST_RELEASE
+  // It wasn't the held button's next frame after all, so its deadline goes
+  // back to being from the frame before
+  frameAge += frameInterval;
+  frameInterval = 0;
+  if (held.protocol != IR_PROTO_NONE) {
+    releaseArm();
+  }
+#endif
+  return false;
+}
+
+// A receiver's decoders got a complete frame. Publish it, unless another
+// receiver got there first, or it's unwanted.
+static void combine(const uint8_t r, const IrFrame* const frame, const uint16_t ticks) {
+#if !STATS_ENABLE
+  (void)r;
+#endif
+  COUNT(receivers[r].frames);
+#if IR_RECEIVERS > 1
+  if (
+    seenBy && !(seenBy & _BV(r)) && (uint16_t)(ticks - lastFrameTicks) < DUPLICATE_TICKS &&
+    lastFrame.flags == frame->flags && matches(&lastFrame.code, lastFrame.flags & IR_FRAME_TOGGLE, frame)
+  ) {
+    seenBy |= _BV(r);
+    return;
+  }
+  tally();
+  lastFrame = *frame;
+  lastFrameTicks = ticks;
+  seenBy = _BV(r);
+#endif
+  COUNT(receivers[r].first);
+  if (wanted(frame)) {
+    publish(frame, ticks);
+  }
+}
+
+// A burst has ended (at a frame gap, or a timeout). Count it if it had marks,
+// but nothing decoded from it.
+static void burstEnd(void) {
+  if (burstMarks && !burstFrames) {
+    COUNT(undecoded);
+    errorOn();
+  }
+  burstMarks = burstFrames = false;
+}
+
+// Feed a pulse which has passed a receiver's glitch filter to its decoders.
+// The bursts are those of all the receivers together.
+static void decodePulse(const uint8_t r, const bool mark, const uint16_t width, const uint16_t ticks) {
+  IrFrame frame;
+  const bool gap = !mark && width >= FRAME_GAP;
+  if (gap) {
+    burstVote = 0;  // a new burst
+  }
+  if (irprotoPulse(r, mark, width, &frame)) {
+    combine(r, &frame, ticks);
+  }
+  if (gap) {
+    burstEnd();  // after decoding, as the gap may complete the last frame
+#if TRACE_ENABLE
+    traceFrame = traceTime(ticks);  // the gap ends with the next frame's first edge
+#endif
+  }
+  burstMarks = burstMarks || mark;
+}
+
+// Pass a receiver's held-back pulse, if any, on to its decoders.
+static void pulseRelease(const uint8_t r) {
+  Receiver* const rx = &receivers[r];
+  if (rx->pulseHeld) {
+    rx->pulseHeld = false;
+    decodePulse(r, rx->pulseMark, rx->pulseWidth, rx->pulseEnd);
+  }
+}
+
+// Called by irPoll() for each edge, to feed the pulse it ends to the decoders.
+static void onEdge(const uint8_t r, const bool mark, const uint16_t ticks) {
+  Receiver* const rx = &receivers[r];
+  const uint16_t width = rx->idle ? IR_LONG : (uint16_t)(ticks - rx->lastTicks);
+#if IR_FAST_RELEASE
+  quietFor = 0;
+  if (mark && width >= FRAME_GAP) {
+    // A new frame: the held button's next one may be starting. This goes by
+    // the raw edges, as the glitch filter may hold the gap back for a while.
+    // The interval is kept in case the frame turns out to be unwanted (other
+    // receivers seeing the same start a little later don't count).
+    if (frameAge >= FRAME_GAP) {
+      frameInterval = frameAge;
+    }
+    frameAge = 0;
+    if (held.protocol != IR_PROTO_NONE) {
+      releaseArm();
+    }
+  }
+#endif
+  if (mark == rx->lastMark) {
+    COUNT(glitches);  // the edge between was lost
+  }
+  if (rx->pulseHeld && (rx->lastMark == rx->pulseMark || isGlitch(width))) {
+    // Merge into the held-back pulse
+    if (rx->lastMark != rx->pulseMark) {
+      COUNT(glitches);
+    }
+    rx->pulseWidth = (width > IR_LONG - rx->pulseWidth) ? IR_LONG : rx->pulseWidth + width;
+    rx->pulseEnd = ticks;
+  } else {
+    pulseRelease(r);
+    rx->pulseHeld = true;
+    rx->pulseMark = rx->lastMark;
+    rx->pulseWidth = width;
+    rx->pulseEnd = ticks;
+  }
+  rx->lastMark = mark;
+  rx->lastTicks = ticks;
+  rx->idle = false;
+#if TRACE_ENABLE
+  traceLastEdge = traceTime(ticks);
+#endif
+}
+
+// Whether there has been a timeout since every receiver's last edge
+static inline bool allIdle(void) {
+  for (uint8_t r = 0; r < IR_RECEIVERS; ++r) {
+    if (!receivers[r].idle) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Called by irPoll() each time 26ms pass without an edge. Any partial frame
+// is abandoned, and the held button is released once its protocol's repeat
+// period has clearly passed with no repeat.
+static void onTimeout(const uint16_t ticks) {
+  IrFrame frame;
+  bool found = false;
+#if IR_FAST_RELEASE
+  if (!allIdle() && quietFor < TIMEOUT_TICKS) {
+    // Not silence, just the held button's deadline (see releaseSchedule()),
+    // which may even come in the middle of a pulse. releaseClock() has dealt
+    // with it already.
+    return;
+  }
+#endif
+  for (uint8_t r = 0; r < IR_RECEIVERS; ++r) {
+    pulseRelease(r);
+    receivers[r].idle = true;
+    if (irprotoTimeout(r, &frame)) {
+      combine(r, &frame, ticks);  // this frame's length could only be known now
+      found = true;
+    }
+  }
+#if IR_RECEIVERS > 1
+  tally();
+#endif
+  burstEnd();
+  if (!found) {
+    ++silence;
+    if (voting == IR_CONFIRM_MAJORITY && silence >= irprotoHoldPeriods(candidate.protocol)) {
+      voting = IR_CONFIRM_NONE;  // its frames stopped before it was confirmed
+      COUNT(vetoed[IR_CONFIRM_MAJORITY]);
+    }
+    if (held.protocol != IR_PROTO_NONE && silence >= irprotoHoldPeriods(held.protocol)) {
+      release(ticks);
+    }
+  }
+#if IR_FAST_RELEASE
+  if (releaseDue && releaseIn == 0) {
+    release(ticks);  // it was already overdue (see releaseClock())
+  }
+#endif
+}
+
+#if SUSPEND_ENABLE
+// Waking from power-down (see SUSPEND_ENABLE). An edge can't be detected
+// without a clock, but a low level can, so INT4 is switched to that; it only
+// fires if PC7 is still low once the clock has started, i.e the mark has
+// lasted at least IR_WAKE_STARTUP, by when Timer1 is counting again.
+#define WAKE_TICKS IR_TICKS(IR_WAKE_STARTUP)
+static volatile bool wakeArmed = false;
+
+bool irQuiet(void) {
+  return ringHead == ringTail && !(TIMSK1 & (_BV(OCIE1A) | _BV(OCIE1B))) && !pinAsserted();
+}
+
+void irWakeArm(void) {
+  ledOff();
+  errorOff();
+  EICRB &= ~(_BV(ISC41) | _BV(ISC40));  // low level
+  EIMSK |= _BV(INT4);
+  wakeArmed = true;
+}
+
+void irWakeDisarm(void) {
+  if (wakeArmed) {
+    wakeArmed = false;
+#if IR_FRONTEND == IR_FRONTEND_ICP1
+    EIMSK &= ~_BV(INT4);
+#else
+    EICRB |= _BV(ISC40);  // every edge again
+    EIFR = _BV(INTF4);
+#endif
+  }
+}
+
+// The mark began a start-up time ago, and its end is the next edge
+static inline void wake(void) {
+  const uint16_t now = TCNT1 - WAKE_TICKS;
+  irWakeDisarm();
+#if IR_FRONTEND == IR_FRONTEND_ICP1
+  TCCR1B |= _BV(ICES1);
+  TIFR1 = _BV(ICF1);  // discard any capture as the clock started
+#endif
+  timeoutArm(now);
+  ringPush(now, EDGE_MARK);
+}
+#endif
+
+#if IR_FRONTEND == IR_FRONTEND_ICP1
+#if SUSPEND_ENABLE
+ISR(INT4_vect) {
+  PROFILE_ISR_BEGIN();
+  wake();
+  PROFILE_ISR_END(PROFILE_EDGE);
+}
+#endif
+
+// Input-capture interrupt fires on the edge selected by ICES1, with the time
+// of the edge already latched in ICR1. The (active-low) pin was asserted if
+// the falling edge was the one being captured.
+ISR(TIMER1_CAPT_vect) {
+  PROFILE_ISR_BEGIN();
+  const uint16_t now = ICR1;
+  const bool asserted = !(TCCR1B & _BV(ICES1));
+  TCCR1B ^= _BV(ICES1);  // capture the opposite edge next time
+  TIFR1 = _BV(ICF1);     // changing ICES1 may set ICF1, so clear it
+  timeoutArm(now);
+  ringPush(now, asserted ? EDGE_MARK : 0);
+  PROFILE_ISR_END(PROFILE_EDGE);
+}
+#elif IR_FRONTEND == IR_FRONTEND_INT4
+// Pin interrupt fires on every rising and falling edge of PC7 (INT4).
+ISR(INT4_vect) {
+  PROFILE_ISR_BEGIN();
+#if SUSPEND_ENABLE
+  if (wakeArmed) {
+    wake();
+    PROFILE_ISR_END(PROFILE_EDGE);
+    return;
+  }
+#endif
+  const uint16_t now = TCNT1;
+  timeoutArm(now);
+  ringPush(now, pinAsserted() ? EDGE_MARK : 0);
+  PROFILE_ISR_END(PROFILE_EDGE);
+}
+#else
+  #error Unsupported IR_FRONTEND
+#endif
+
+#if IR_RECEIVERS > 4
+  #error Too many IR_RECEIVERS
+#elif IR_RECEIVERS > 1
+// The other receivers' pin interrupts fire on every rising and falling edge,
+// as INT4 does: receiver n is on PD(n-1), which is INT(n-1).
+static inline void otherEdge(const uint8_t r) {
+  const uint16_t now = TCNT1;
+  timeoutArm(now);
+  ringPush(now, ((PIND & _BV(r - 1)) ? 0 : EDGE_MARK) | (r << EDGE_RECEIVER_SHIFT));
+}
+ISR(INT0_vect) {
+  PROFILE_ISR_BEGIN();
+  otherEdge(1);
+  PROFILE_ISR_END(PROFILE_EDGE);
+}
+#endif
+#if IR_RECEIVERS > 2
+ISR(INT1_vect) {
+  PROFILE_ISR_BEGIN();
+  otherEdge(2);
+  PROFILE_ISR_END(PROFILE_EDGE);
+}
+#endif
+#if IR_RECEIVERS > 3
+ISR(INT2_vect) {
+  PROFILE_ISR_BEGIN();
+  otherEdge(3);
+  PROFILE_ISR_END(PROFILE_EDGE);
+}
+#endif
+
+// Timer interrupt fires 26ms from the last edge, and every 26ms thereafter for
+// a while. This should happen only when a button is released (or between the
+// frames of protocols with a long repeat period), so tell the decoder.
+ISR(TIMER1_COMPA_vect) {
+  PROFILE_ISR_BEGIN();
+  const uint16_t now = OCR1A;
+  uint8_t flags = EDGE_TIMEOUT;
+  if (++timeouts == MAX_TIMEOUTS) {
+    timeoutDisarm();
+    flags |= EDGE_FINAL;
+  } else {
+    OCR1A = now + TIMEOUT_TICKS;
+  }
+  ringPush(now, flags);
+  PROFILE_ISR_END(PROFILE_TIMEOUT);
+}
+
+#if IR_GLITCH_FILTER
+// Compare interrupt fires when the held-back pulse is due (see flushArm()).
+ISR(TIMER1_COMPB_vect) {
+  TIMSK1 &= ~_BV(OCIE1B);
+  schedPost(WORK_IR);
+}
+#endif
+
+// Called from the main loop whenever WORK_IR is flagged. This drains the edge
+// ring, feeding each edge to the protocol decoders.
+void irPoll(void) {
+  uint8_t tail = ringTail;
+  const uint8_t head = ringHead;
+  const uint8_t depth = (head - tail) & (RING_SIZE - 1);
+#if IR_FAST_RELEASE
+  bool busy = (depth != 0);
+#endif
+#if STATS_ENABLE
+  if (depth > stats.maxDepth) {
+    stats.maxDepth = depth;
+  }
+#endif
+  while (tail != head) {
+    const uint16_t ticks = ringTicks[tail];
+    const uint8_t flags = ringFlags[tail];
+    tail = (tail + 1) & (RING_SIZE - 1);
+    ringTail = tail;  // free the slot as soon as it has been read
+#if IR_FAST_RELEASE
+    releaseClock(ticks);
+#endif
+    const uint8_t r = (flags & EDGE_RECEIVER) >> EDGE_RECEIVER_SHIFT;
+    if (flags & EDGE_OVERRUN) {
+      // The frames in progress are incomplete, so discard them, and don't try
+      // to measure a pulse from an edge that has been lost (which may have
+      // been any receiver's)
+      COUNT(overruns);
+      irprotoReset();
+      for (uint8_t i = 0; i < IR_RECEIVERS; ++i) {
+        receivers[i].pulseHeld = false;
+        receivers[i].idle = true;
+      }
+      receivers[r].lastMark = !(flags & EDGE_MARK);
+      errorOn();
+#if CAPTURE_ENABLE
+      captureOverrun();
+#endif
+    }
+    if (flags & EDGE_TIMEOUT) {
+#if CAPTURE_ENABLE
+      captureTimeout(ticks, flags & EDGE_FINAL);
+#endif
+      onTimeout(ticks);
+    } else {
+#if CAPTURE_ENABLE
+      if (r == 0) {
+        captureEdge(ticks, flags & EDGE_MARK);  // only the first receiver's
+      }
+#endif
+      onEdge(r, flags & EDGE_MARK, ticks);
+    }
+  }
+  const uint16_t now = TCNT1;
+  bool waiting = false;  // whether a held-back pulse is still too recent...
+  uint16_t oldest = 0;   // ...and the end of the one due first
+  for (uint8_t r = 0; r < IR_RECEIVERS; ++r) {
+    const Receiver* const rx = &receivers[r];
+    if (rx->pulseHeld && rx->lastMark != rx->pulseMark) {
+      // Once it's too long ago for a glitch to follow it, release the held-back
+      // pulse (unless a glitch has just been merged into it, and it's still
+      // going on). An edge may have happened whose ISR hasn't run yet, so allow
+      // twice as long.
+      if (ringHead == tail && !isGlitch((uint16_t)(now - rx->pulseEnd) / 2)) {
+        pulseRelease(r);
+#if IR_FAST_RELEASE
+        busy = true;
+#endif
       } else {
-        fsmError();  // not expecting it to be asserted - noise perhaps?
+        if (!waiting || (uint16_t)(now - rx->pulseEnd) > (uint16_t)(now - oldest)) {
+          oldest = rx->pulseEnd;
+        }
+        waiting = true;
       }
-      break;
+    }
+  }
+  if (waiting) {
+    flushArm(oldest);
+  }
+#if IR_FAST_RELEASE
+  if (busy) {
+    releaseSchedule();
   }
+#endif
 }
 
-// Timer interrupt fires 26ms from the last edge. This should happen only when
-// a button is released.
-ISR(TIMER1_COMPA_vect) {
-  fsmReset();
+// Allow the USB stuff to take the next press or release event, if any.
+bool irGetEvent(IrEvent* const event) {
+  const uint8_t tail = eventTail;
+  if (tail == eventHead) {
+    return false;
+  }
+  event->type = events[tail].type;
+  event->code = events[tail].code;
+#if PROFILE_ENABLE
+  event->ticks = events[tail].ticks;
+#endif
+#if TRACE_ENABLE
+  event->traceEdge = events[tail].traceEdge;
+  event->traceDecided = events[tail].traceDecided;
+  event->traceQueued = events[tail].traceQueued;
+#endif
+  eventTail = (tail + 1) & (EVENT_QUEUE_SIZE - 1);
+  return true;
+}
+
+// Whether there is a press or release event waiting to be taken.
+bool irEventPending(void) {
+  return eventTail != eventHead;
 }
 
-// Allow the USB stuff to get access to the current button-code.
-uint16_t irGetState(void) {
-  return value;
+#if STATS_ENABLE
+// Get the decoder's statistics.
+void irGetStats(IrStats* const result) {
+  *result = stats;
+  result->resyncs = irprotoResyncs();
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+    result->dropped = dropped;
+  }
 }
+#endif
 
 // Initialise pin, timer and LEDs
 void irInit(void) {
   // LEDs
   DDRD |= _BV(5) | _BV(6);
 
-  // INT4 config
-  EICRB = _BV(ISC40); // generate interrupt on INT4 edges
-  EIMSK = _BV(INT4);  // enable INT4 interrupt
+  for (uint8_t r = 0; r < IR_RECEIVERS; ++r) {
+    receivers[r].idle = true;
+  }
 
-  // Configure timer 1
+  // Configure timer 1: normal mode, prescaler 8 (2 MHz), free-running
   TCNT1 = 0;
-  OCR1A = 51999;  // 26ms
-  TIMSK1 = _BV(OCIE1A);
   TCCR1A = 0x00;
-  timerStop();
+#if IR_FRONTEND == IR_FRONTEND_ICP1
+  // Capture the falling edge first (the idle detector output is high)
+  TCCR1B = (IR_NOISE_CANCEL ? _BV(ICNC1) : 0) | _BV(CS11);
+  TIFR1 = _BV(ICF1);
+  TIMSK1 = _BV(ICIE1);
+#else
+  TCCR1B = _BV(CS11);
+  TIMSK1 = 0x00;
+
+  // INT4 config
+  EICRB = _BV(ISC40); // generate interrupt on INT4 edges
+  EIMSK = _BV(INT4);  // enable INT4 interrupt
+#endif
+#if IR_RECEIVERS > 1
+  // The other receivers' INTn, likewise (the pins are inputs with pull-ups)
+  EICRA = _BV(ISC00) | (IR_RECEIVERS > 2 ? _BV(ISC10) : 0) | (IR_RECEIVERS > 3 ? _BV(ISC20) : 0);
+  EIFR = (uint8_t)(_BV(IR_RECEIVERS - 1) - 1);
+  EIMSK |= (uint8_t)(_BV(IR_RECEIVERS - 1) - 1);
+#endif
 }
@@ -2,8 +2,108 @@
 #define IR_H
 
 #include <stdint.h>
+#include <stdbool.h>
+#include "IrateConfig.h"
 
-uint16_t irGetState(void);
+typedef enum {
+  IR_PROTO_NONE,
+  IR_PROTO_SIRC12,
+  IR_PROTO_SIRC15,
+  IR_PROTO_SIRC20,
+  IR_PROTO_NEC,
+  IR_PROTO_RC5,
+  IR_PROTO_RC6
+} IrProtocol;
+
+// A decoded button-code. The address is the device address sent by the remote
+// (SIRC-20: the 5-bit device and 8-bit extended device; extended NEC: all 16
+// bits), and the command identifies the button itself.
+typedef struct {
+  uint8_t  protocol;  // IrProtocol (IR_PROTO_NONE if no button is pressed)
+  uint8_t  command;
+  uint16_t address;
+} IrCode;
+
+typedef enum {
+  IR_EVENT_PRESS,
+  IR_EVENT_RELEASE
+} IrEventType;
+
+typedef struct {
+  uint8_t  type;   // IrEventType
+  IrCode   code;
+#if PROFILE_ENABLE
+  uint16_t ticks;  // Timer1 count (0.5us units) at the edge or timeout causing it
+#endif
+#if TRACE_ENABLE
+  uint16_t traceEdge;     // the stages so far, in trace-clock time (see trace.h)
+  uint16_t traceDecided;
+  uint16_t traceQueued;
+#endif
+} IrEvent;
+
+// How much agreement a new button-code needs from the frames that follow it,
+// since a corrupted frame may decode as a valid but different code:
+//   IR_CONFIRM_NONE:     pressed on its first frame.
+//   IR_CONFIRM_VETO:     pressed on its first frame, but released again if the
+//                        next two frames both disagree with it.
+//   IR_CONFIRM_MAJORITY: only pressed once IR_CONFIRM_VOTES frames agree; if
+//                        that many disagree first, it is dropped.
+// A repeat code (NEC) agrees with any button-code.
+typedef enum {
+  IR_CONFIRM_NONE,
+  IR_CONFIRM_VETO,
+  IR_CONFIRM_MAJORITY,
+  IR_CONFIRM_MODES
+} IrConfirm;
+
+// Each receiver's share of the frames decoded (see IR_RECEIVERS). A frame which
+// more than one receiver decodes counts for each of them, but is only acted on
+// for the first.
+typedef struct {
+  uint16_t frames;  // frames decoded
+  uint16_t first;   // ...before any other receiver had
+  uint16_t missed;  // frames which only other receivers decoded
+} IrReceiverStats;
+
+typedef struct {
+  uint16_t dropped;        // edges dropped because the ring was full
+  uint16_t overruns;       // frames discarded because edges were dropped
+  uint16_t eventsDropped;  // presses dropped because the event queue was full
+  uint8_t  maxDepth;       // high-water mark of the ring
+  uint16_t glitches;       // pulses merged away by the glitch filter
+  uint16_t undecoded;      // bursts which decoded as nothing
+  uint16_t resyncs;        // frames abandoned for a new one starting mid-frame
+  uint16_t ignored;        // frames dropped because irWanted() said so
+  uint16_t confirmed[IR_CONFIRM_MODES];  // button-codes accepted, by IrConfirm
+  uint16_t vetoed[IR_CONFIRM_MODES];     // ...and rejected
+  IrReceiverStats receivers[IR_RECEIVERS];
+} IrStats;  // kept with STATS_ENABLE only
+
+// Implemented by the application: the IrConfirm mode for the given code.
+uint8_t irConfirmMode(const IrCode* code);
+
+// Implemented by the application: whether frames with the given code are for
+// it at all. Those which aren't (e.g from another device's remote) are dropped
+// as soon as they decode, along with any repeat codes following them, as if
+// they had never been sent.
+bool irWanted(const IrCode* code);
+
+bool irGetEvent(IrEvent* event);
+bool irEventPending(void);
+void irGetStats(IrStats* result);
+void irPoll(void);
 void irInit(void);
 
+#if SUSPEND_ENABLE
+// Power-down (see SUSPEND_ENABLE) stops Timer1, so it must wait until nothing
+// is being timed: irQuiet() says whether it may. Called with interrupts off,
+// irWakeArm() then makes a mark on PC7 wake the CPU (and turns the LEDs off),
+// and irWakeDisarm() restores the front-end once it has woken, if INT4 hasn't
+// already (i.e something else woke it).
+bool irQuiet(void);
+void irWakeArm(void);
+void irWakeDisarm(void);
+#endif
+
 #endif
@@ -0,0 +1,635 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include <avr/io.h>
+#include <avr/pgmspace.h>
+#include "IrateConfig.h"
+#include "irproto.h"
+
+// Each supported protocol is described by an entry in a table in flash, and
+// has a decoder which is fed every pulse. A decoder does a fixed amount of
+// work per pulse, so the cost of an edge is bounded by the number of enabled
+// protocols.
+
+typedef enum {
+  ENC_PULSE_WIDTH,     // the width of each mark carries the bit (SIRC)
+  ENC_PULSE_DISTANCE,  // the width of each space carries the bit (NEC)
+  ENC_BIPHASE          // Manchester: each bit is a mid-bit transition (RC5, RC6)
+} Encoding;
+
+#define PF_LSB_FIRST _BV(0)  // bits are sent least-significant first
+#define PF_TRAILER   _BV(1)  // the frame is only complete once silence follows it
+#define PF_NEC       _BV(2)  // check NEC's inverted command (and maybe address)
+#define PF_RC5       _BV(3)  // check RC5's start bit; field bit is command bit 6
+#define PF_RC6       _BV(4)  // check RC6's start bit and mode; trailer bit is wide
+
+#define NO_TOGGLE 0xFF
+
+typedef struct {
+  uint16_t min;
+  uint16_t max;
+} Window;
+
+typedef struct {
+  uint8_t  protocol;     // IrProtocol
+  uint8_t  encoding;     // Encoding
+  uint8_t  flags;        // PF_*
+  uint8_t  bits;         // number of bits in a frame
+  uint8_t  holdPeriods;  // see irprotoHoldPeriods()
+  uint16_t period;       // see irprotoPeriod(), in PERIOD_UNITs
+  uint8_t  cmdShift;     // position and size of the fields in the frame
+  uint8_t  cmdBits;
+  uint8_t  addrShift;
+  uint8_t  addrBits;
+  uint8_t  toggleShift;
+  Window   hdrMark;      // header mark; empty if the protocol has no header
+  Window   hdrSpace;     // header space
+  Window   rptSpace;     // header space of a repeat code (NEC); empty if none
+  Window   mark;         // ENC_PULSE_*: a data mark (ENC_PULSE_WIDTH: a "0")
+  Window   space;        // ENC_PULSE_*: a data space (ENC_PULSE_DISTANCE: a "0")
+  Window   one;          // ENC_PULSE_*: the longer carrying pulse of a "1"
+  Window   unit;         // ENC_BIPHASE: one half-bit
+} Protocol;
+
+// Windows are given as a nominal duration in microseconds and a tolerance in
+// percent, and converted to Timer1 ticks at compile time.
+#define WIN(us, tol)  {IR_TICKS((us) * (100UL - (tol)) / 100), IR_TICKS((us) * (100UL + (tol)) / 100)}
+#define NO_WIN        {0xFFFF, 0x0000}
+
+// Frame periods don't fit in 16 bits of ticks, so they're stored in coarser
+// units (which still divide the nominal periods finely enough).
+#define PERIOD_UNIT 32
+#define PERIOD(us) ((uint16_t)((us) / PERIOD_UNIT))
+
+// Sony SIRC: 2400us header mark, then "0" = 600us mark, "1" = 1200us mark, with
+// a 600us space before each. A 7-bit command and a 5, 8 or 13-bit address, LSB
+// first. The whole frame repeats every 45ms while the button is held, so if
+// not released sooner, it is released when one 26ms timeout expires.
+#define SIRC(proto, nbits, trailer) { \
+  .protocol = proto, .encoding = ENC_PULSE_WIDTH, \
+  .flags = PF_LSB_FIRST | ((trailer) ? PF_TRAILER : 0), \
+  .bits = nbits, .holdPeriods = 1, .period = PERIOD(45000), \
+  .cmdShift = 0, .cmdBits = 7, .addrShift = 7, .addrBits = (nbits) - 7, .toggleShift = NO_TOGGLE, \
+  .hdrMark = WIN(2400, 25), .hdrSpace = WIN(600, 50), .rptSpace = NO_WIN, \
+  .mark = WIN(600, 35), .space = WIN(600, 35), .one = WIN(1200, 25), \
+  .unit = NO_WIN \
+}
+
+static const Protocol PROGMEM protocols[] = {
+#if IR_USE_SIRC12
+  SIRC(IR_PROTO_SIRC12, 12, IR_USE_SIRC15 || IR_USE_SIRC20),
+#endif
+#if IR_USE_SIRC15
+  SIRC(IR_PROTO_SIRC15, 15, IR_USE_SIRC20),
+#endif
+#if IR_USE_SIRC20
+  SIRC(IR_PROTO_SIRC20, 20, 0),
+#endif
+#if IR_USE_NEC
+  // NEC: 9ms header mark, 4.5ms space, then 562us marks with a 562us ("0") or
+  // 1687us ("1") space after each. 8-bit address, its inverse (or a 16-bit
+  // address), 8-bit command and its inverse, LSB first. While the button is
+  // held, a repeat code (9ms mark, 2.25ms space, 562us mark) is sent every
+  // 108ms, so allow five 26ms timeouts before releasing it.
+  {
+    .protocol = IR_PROTO_NEC, .encoding = ENC_PULSE_DISTANCE,
+    .flags = PF_LSB_FIRST | PF_NEC,
+    .bits = 32, .holdPeriods = 5, .period = PERIOD(108000),
+    .cmdShift = 16, .cmdBits = 8, .addrShift = 0, .addrBits = 16, .toggleShift = NO_TOGGLE,
+    .hdrMark = WIN(9000, 25), .hdrSpace = WIN(4500, 25), .rptSpace = WIN(2250, 25),
+    .mark = WIN(562, 50), .space = WIN(562, 40), .one = WIN(1687, 30),
+    .unit = NO_WIN
+  },
+#endif
+#if IR_USE_RC5
+  // Philips RC5: no header; 14 biphase bits of 2x889us, "1" = space then mark.
+  // Two start bits (the second is the inverse of RC5X's command bit 6), a
+  // toggle bit, 5-bit address and 6-bit command, MSB first. The frame repeats
+  // every 114ms while the button is held; the toggle bit changes on a new
+  // press.
+  {
+    .protocol = IR_PROTO_RC5, .encoding = ENC_BIPHASE,
+    .flags = PF_RC5,
+    .bits = 14, .holdPeriods = 4, .period = PERIOD(113778),
+    .cmdShift = 0, .cmdBits = 6, .addrShift = 6, .addrBits = 5, .toggleShift = 11,
+    .hdrMark = NO_WIN, .hdrSpace = NO_WIN, .rptSpace = NO_WIN,
+    .mark = NO_WIN, .space = NO_WIN, .one = NO_WIN,
+    .unit = WIN(889, 25)
+  },
+#endif
+#if IR_USE_RC6
+  // Philips RC6 mode 0: 2666us header mark, 889us space, then 21 biphase bits
+  // of 2x444us, "1" = mark then space: a start bit, three mode bits, a
+  // double-width toggle ("trailer") bit, 8-bit address and 8-bit command, MSB
+  // first. Repeats like RC5, every 107ms.
+  {
+    .protocol = IR_PROTO_RC6, .encoding = ENC_BIPHASE,
+    .flags = PF_RC6,
+    .bits = 21, .holdPeriods = 4, .period = PERIOD(106667),
+    .cmdShift = 0, .cmdBits = 8, .addrShift = 8, .addrBits = 8, .toggleShift = 16,
+    .hdrMark = WIN(2666, 20), .hdrSpace = WIN(889, 25), .rptSpace = NO_WIN,
+    .mark = NO_WIN, .space = NO_WIN, .one = NO_WIN,
+    .unit = WIN(444, 20)
+  },
+#endif
+};
+
+#define NUM_PROTOCOLS (sizeof(protocols)/sizeof(*protocols))
+#if !(IR_USE_SIRC12 || IR_USE_SIRC15 || IR_USE_SIRC20 || IR_USE_NEC || IR_USE_RC5 || IR_USE_RC6)
+  #error No IR protocols enabled
+#endif
+
+// Index of RC6's double-width trailer bit
+#define RC6_TRAILER_BIT 4
+
+#if IR_CALIBRATE
+// Pulses are scaled by the remote's clock, in 1/CAL_ONEths, and then have the
+// receiver's stretch taken off. The stretch is learned an eighth of each
+// pulse's error at a time, and never beyond STRETCH_MAX either way. The clock
+// is learned from the total length of each frame (in 1 << SUM_SHIFT ticks), and
+// forgotten if a frame decodes which is off by more than SKEW_MAX.
+#define CAL_SHIFT     10
+#define CAL_ONE       (1 << CAL_SHIFT)
+#define SKEW_MAX      (CAL_ONE / 5)
+#define STRETCH_SHIFT 3
+#define STRETCH_MAX   IR_TICKS(300)
+#define SUM_SHIFT     2
+#endif
+
+typedef enum {
+  ST_IDLE,       // waiting for a header mark
+  ST_ARMED,      // (no header) seen a long space, so a mark may start a frame
+  ST_HDR_SPACE,  // waiting for the header space to end
+  ST_MARK,       // waiting for a data mark to end
+  ST_SPACE,      // waiting for a data space to end
+  ST_BIPHASE,    // receiving biphase half-bits
+  ST_REPEAT,     // waiting for the stop mark of a repeat code to end
+  ST_TRAILER     // got all the bits, waiting to be sure no more follow
+} Stage;
+
+typedef struct {
+  uint8_t  stage;
+  uint8_t  count;  // bits (or biphase half-bits) received so far
+  uint8_t  first;  // ENC_BIPHASE: level of the current bit's first half
+  uint32_t acc;    // the bits so far (IR_CALIBRATE: or the header mark, until
+                   // the space after it)
+#if IR_CALIBRATE
+  int16_t  skew;         // nominal over the remote's clock, less one (see CAL_ONE)
+  bool     scaled;       // ...whether it applies to this frame
+  int16_t  stretch;      // the receiver's, as refined over this frame so far
+  uint16_t nominalSum;   // the length of this frame's pulses so far: nominal...
+  uint16_t receivedSum;  // ...and as received, less the stretch
+#endif
+#if STATS_ENABLE
+  uint16_t frameMargin;  // the least by which a pulse of this frame fitted
+  uint16_t margin;       // ...and of the last frame decoded (see IrTiming)
+  uint16_t frames;
+#endif
+} Decoder;
+
+// Each receiver (see IR_RECEIVERS) has a decoder for each protocol
+static Decoder decoders[IR_RECEIVERS][NUM_PROTOCOLS];
+static uint8_t receiver;  // whose pulses are being decoded
+#if STATS_ENABLE
+static uint16_t resyncs = 0;  // see irprotoResyncs()
+#endif
+#if IR_CALIBRATE
+static int16_t learnedStretch[IR_RECEIVERS];  // each receiver's own
+#endif
+
+static inline uint8_t rdByte(const uint8_t* p) {
+  return pgm_read_byte(p);
+}
+static inline bool inWindow(const Window* const w, const uint16_t t) {
+  return t >= pgm_read_word(&w->min) && t <= pgm_read_word(&w->max);
+}
+static inline bool hasHeader(const Protocol* const p) {
+  return pgm_read_word(&p->hdrMark.max) != 0;
+}
+static inline uint16_t nominal(const Window* const w) {
+  return (uint16_t)(((uint32_t)pgm_read_word(&w->min) + pgm_read_word(&w->max)) / 2);
+}
+
+// A pulse's width as it would have been from a remote with a nominal clock, and
+// from a receiver which doesn't stretch marks
+static inline uint16_t normalize(const Decoder* const d, const bool mark, const uint16_t t) {
+#if IR_CALIBRATE
+  if (t == IR_LONG) {
+    return t;
+  }
+  const uint16_t scale = d->scaled ? CAL_ONE + d->skew : CAL_ONE;
+  const int32_t width = (int32_t)(((uint32_t)t * scale) >> CAL_SHIFT) + (mark ? -d->stretch : d->stretch);
+  return width < 0 ? 0 : width >= IR_LONG ? IR_LONG - 1 : (uint16_t)width;
+#else
+  (void)d;
+  (void)mark;
+  return t;
+#endif
+}
+
+#if IR_CALIBRATE
+static inline int16_t clamp(const int16_t value, const int16_t max) {
+  return value > max ? max : value < -max ? -max : value;
+}
+
+// A frame has been decoded: learn the remote's clock from it, as the ratio of
+// its pulses' nominal length to their received length (which the receiver's
+// stretch doesn't change, since it makes each space shorter by as much as it
+// makes the mark before longer), and keep the stretch as refined over it
+static void calibrate(Decoder* const d) {
+  if (d->receivedSum) {
+    const int16_t skew = (int16_t)(((uint32_t)d->nominalSum << CAL_SHIFT) / d->receivedSum) - CAL_ONE;
+    d->skew = (skew <= SKEW_MAX && skew >= -SKEW_MAX) ? (d->skew + skew) / 2 : 0;
+  }
+  learnedStretch[receiver] = d->stretch;
+}
+#endif
+
+// Whether a header pulse fits the window, either as it came or without the
+// receiver's stretch (headers are long enough, and their windows wide enough,
+// that they needn't be scaled by the clock)
+static bool inHeader(const Window* const w, const bool mark, const uint16_t ticks) {
+#if IR_CALIBRATE
+  const int16_t stretch = learnedStretch[receiver];
+  if (inWindow(w, ticks + (mark ? -stretch : stretch))) {
+    return true;
+  }
+#else
+  (void)mark;
+#endif
+  return inWindow(w, ticks);
+}
+
+#if IR_CALIBRATE
+// The header is over: scale the frame by the remote's clock, if the header
+// agrees with it to within an eighth. Otherwise, it may well be another remote,
+// or another protocol whose header looks similar.
+static void scaleFrame(Decoder* const d, const uint16_t space, const uint16_t nominal) {
+  const uint16_t length = (uint16_t)((((uint16_t)d->acc + (uint32_t)space) * (uint16_t)(CAL_ONE + d->skew)) >> CAL_SHIFT);
+  const uint16_t error = length > nominal ? length - nominal : nominal - length;
+  d->scaled = (error <= nominal / 8);
+}
+#endif
+
+// Whether a pulse fits n times the window, as normalized (t) or failing that
+// as it came (ticks), so that a poor estimate of the timing can't lose a frame
+// which would have decoded without one. If it fits, it is counted towards the
+// frame's margin, and the stretch is learned from it.
+static bool fits(Decoder* const d, const Window* const w, const uint8_t n, const bool mark, const uint16_t t, const uint16_t ticks) {
+  const uint16_t min = n * pgm_read_word(&w->min);
+  const uint16_t max = n * pgm_read_word(&w->max);
+  uint16_t width = t;
+  if (width < min || width > max) {
+#if IR_CALIBRATE
+    width = ticks;
+    if (width < min || width > max) {
+      return false;
+    }
+#else
+    (void)ticks;
+    return false;
+#endif
+  }
+#if STATS_ENABLE
+  const uint16_t margin = (width - min < max - width) ? width - min : max - width;
+  if (margin < d->frameMargin) {
+    d->frameMargin = margin;
+  }
+#else
+  (void)d;
+#endif
+#if IR_CALIBRATE
+  const uint16_t expected = n * nominal(w);
+  const int16_t error = (int16_t)(t - expected);
+  d->stretch = clamp(d->stretch + (mark ? error : -error) / (1 << STRETCH_SHIFT), STRETCH_MAX);
+  d->nominalSum += expected >> SUM_SHIFT;
+  d->receivedSum += (uint16_t)(ticks + (mark ? -d->stretch : d->stretch)) >> SUM_SHIFT;
+#else
+  (void)mark;
+#endif
+  return true;
+}
+
+// Shift a bit into the accumulator, in the order it was sent
+static inline void shiftIn(const Protocol* const p, Decoder* const d, const bool bit) {
+  if (rdByte(&p->flags) & PF_LSB_FIRST) {
+    d->acc >>= 1;
+    if (bit) {
+      d->acc |= 0x80000000UL;
+    }
+  } else {
+    d->acc <<= 1;
+    d->acc |= bit;
+  }
+}
+
+static inline uint16_t field(const uint32_t acc, const uint8_t shift, const uint8_t bits) {
+  return (uint16_t)(acc >> shift) & (uint16_t)((1UL << bits) - 1);
+}
+
+// All bits received: check the frame and extract its fields
+static bool complete(const Protocol* const p, Decoder* const d, IrFrame* const frame) {
+  const uint8_t flags = rdByte(&p->flags);
+  const uint8_t bits = rdByte(&p->bits);
+  const uint8_t toggleShift = rdByte(&p->toggleShift);
+  uint32_t acc = d->acc;
+  d->stage = ST_IDLE;
+  if (flags & PF_LSB_FIRST) {
+    acc >>= 32 - bits;
+  }
+  frame->code.protocol = rdByte(&p->protocol);
+  frame->code.command = field(acc, rdByte(&p->cmdShift), rdByte(&p->cmdBits));
+  frame->code.address = field(acc, rdByte(&p->addrShift), rdByte(&p->addrBits));
+  frame->flags = 0;
+  if (toggleShift != NO_TOGGLE && ((acc >> toggleShift) & 1)) {
+    frame->flags |= IR_FRAME_TOGGLE;
+  }
+  if (flags & PF_NEC) {
+    const uint8_t inverse = (uint8_t)(acc >> 24);
+    if ((uint8_t)(frame->code.command ^ inverse) != 0xFF) {
+      return false;
+    }
+    const uint8_t addr = (uint8_t)acc;
+    if ((uint8_t)(addr ^ (uint8_t)(acc >> 8)) == 0xFF) {
+      frame->code.address = addr;  // standard NEC: 8-bit address
+    }
+  } else if (flags & PF_RC5) {
+    if (!(acc & (1UL << 13))) {
+      return false;  // first start bit must be a "1"
+    }
+    if (!(acc & (1UL << 12))) {
+      frame->code.command |= 0x40;  // RC5X: field bit is the inverse of command bit 6
+    }
+  } else if (flags & PF_RC6) {
+    if ((acc >> 17) != 0x8) {
+      return false;  // start bit must be a "1", and only mode 0 is supported
+    }
+  }
+#if IR_CALIBRATE
+  calibrate(d);
+#endif
+#if STATS_ENABLE
+  d->margin = d->frameMargin;
+  if (d->frames != 0xFFFF) {
+    ++d->frames;
+  }
+#endif
+  return true;
+}
+
+static bool startFrame(const Protocol* const p, Decoder* const d, const bool mark, const uint16_t t);
+
+// Feed one pulse to a biphase decoder, which may cover one, two or three
+// half-bit units (three only around RC6's double-width trailer bit)
+static bool biphase(const Protocol* const p, Decoder* const d, const bool mark, const uint16_t ticks, IrFrame* const frame) {
+  const uint16_t t = normalize(d, mark, ticks);
+  const uint8_t flags = rdByte(&p->flags);
+  const uint8_t bits = rdByte(&p->bits);
+  uint8_t units;
+  if (fits(d, &p->unit, 1, mark, t, ticks)) {
+    units = 1;
+  } else if (fits(d, &p->unit, 2, mark, t, ticks)) {
+    units = 2;
+  } else if ((flags & PF_RC6) && fits(d, &p->unit, 3, mark, t, ticks)) {
+    units = 3;
+  } else {
+    return startFrame(p, d, mark, ticks);
+  }
+  while (units) {
+    const uint8_t need = ((flags & PF_RC6) && (d->count >> 1) == RC6_TRAILER_BIT) ? 2 : 1;
+    if (units < need) {
+      return startFrame(p, d, mark, ticks);
+    }
+    units -= need;
+    if (!(d->count & 1)) {
+      d->first = mark;
+    } else if (mark == d->first) {
+      return startFrame(p, d, mark, ticks);  // no mid-bit transition
+    } else {
+      shiftIn(p, d, (flags & PF_RC6) ? d->first : mark);
+    }
+    ++d->count;
+    if (d->count == 2*bits - 1) {
+      // The last bit's second half may merge into the following silence, so
+      // its first half is all there is to go on
+      shiftIn(p, d, (flags & PF_RC6) ? d->first : !d->first);
+      return complete(p, d, frame);
+    }
+  }
+  return false;
+}
+
+// Start over: see whether this pulse could be the beginning of a new frame,
+// which may also cut short the one in progress
+static bool startFrame(const Protocol* const p, Decoder* const d, const bool mark, const uint16_t t) {
+  const bool inFrame = (d->stage >= ST_MARK);
+  d->stage = ST_IDLE;
+#if STATS_ENABLE
+  d->frameMargin = 0xFFFF;
+#endif
+#if IR_CALIBRATE
+  d->stretch = learnedStretch[receiver];
+  d->nominalSum = 0;
+  d->receivedSum = 0;
+#endif
+  if (hasHeader(p)) {
+    if (mark && inHeader(&p->hdrMark, mark, t)) {
+      d->stage = ST_HDR_SPACE;
+#if IR_CALIBRATE
+      d->acc = t;
+#endif
+    }
+  } else if (!mark && t > 2*pgm_read_word(&p->unit.max)) {
+    d->stage = ST_ARMED;
+  }
+#if STATS_ENABLE
+  if (inFrame && d->stage != ST_IDLE) {
+    ++resyncs;
+  }
+#else
+  (void)inFrame;
+#endif
+  return false;
+}
+
+static bool decode(const Protocol* const p, Decoder* const d, const bool mark, const uint16_t ticks, IrFrame* const frame) {
+  const uint8_t encoding = rdByte(&p->encoding);
+  const uint16_t t = normalize(d, mark, ticks);
+  bool one;
+  switch (d->stage) {
+    case ST_ARMED:
+      if (mark) {
+        // RC5: the first half of the first start bit is a space, which merged
+        // into the idle time before the frame
+        d->stage = ST_BIPHASE;
+#if IR_CALIBRATE
+        d->scaled = true;
+#endif
+        d->count = 1;
+        d->first = false;
+        d->acc = 0;
+        return biphase(p, d, mark, ticks, frame);
+      }
+      break;
+
+    case ST_HDR_SPACE:
+      if (!mark && inHeader(&p->hdrSpace, mark, ticks)) {
+#if IR_CALIBRATE
+        scaleFrame(d, ticks, nominal(&p->hdrMark) + nominal(&p->hdrSpace));
+#endif
+        d->count = 0;
+        d->acc = 0;
+        d->stage = (encoding == ENC_BIPHASE) ? ST_BIPHASE : ST_MARK;
+        return false;
+      }
+      if (!mark && inHeader(&p->rptSpace, mark, ticks)) {
+#if IR_CALIBRATE
+        scaleFrame(d, ticks, nominal(&p->hdrMark) + nominal(&p->rptSpace));
+#endif
+        d->stage = ST_REPEAT;
+        return false;
+      }
+      break;
+
+    case ST_MARK:
+      one = mark && (encoding == ENC_PULSE_WIDTH) && fits(d, &p->one, 1, mark, t, ticks);
+      if (mark && (one || fits(d, &p->mark, 1, mark, t, ticks))) {
+        if (encoding == ENC_PULSE_DISTANCE) {
+          d->stage = ST_SPACE;
+          return false;
+        }
+        shiftIn(p, d, one);
+        if (++d->count < rdByte(&p->bits)) {
+          d->stage = ST_SPACE;
+          return false;
+        }
+        if (rdByte(&p->flags) & PF_TRAILER) {
+          d->stage = ST_TRAILER;
+          return false;
+        }
+        return complete(p, d, frame);
+      }
+      break;
+
+    case ST_SPACE:
+      one = !mark && (encoding == ENC_PULSE_DISTANCE) && fits(d, &p->one, 1, mark, t, ticks);
+      if (!mark && (one || fits(d, &p->space, 1, mark, t, ticks))) {
+        if (encoding == ENC_PULSE_WIDTH) {
+          d->stage = ST_MARK;
+          return false;
+        }
+        shiftIn(p, d, one);
+        if (++d->count < rdByte(&p->bits)) {
+          d->stage = ST_MARK;
+          return false;
+        }
+        return complete(p, d, frame);  // the stop mark has just started
+      }
+      break;
+
+    case ST_BIPHASE:
+      return biphase(p, d, mark, ticks, frame);
+
+    case ST_REPEAT:
+      if (mark && fits(d, &p->mark, 1, mark, t, ticks)) {
+        d->stage = ST_IDLE;
+        frame->code.protocol = rdByte(&p->protocol);
+        frame->code.command = 0;
+        frame->code.address = 0;
+        frame->flags = IR_FRAME_REPEAT;
+        return true;
+      }
+      break;
+
+    case ST_TRAILER:
+      if (!mark && t > pgm_read_word(&p->space.max)) {
+        return complete(p, d, frame);
+      }
+      break;
+  }
+  return startFrame(p, d, mark, ticks);
+}
+
+bool irprotoPulse(const uint8_t from, const bool mark, const uint16_t ticks, IrFrame* const frame) {
+  bool found = false;
+  receiver = from;
+  for (uint8_t i = 0; i < NUM_PROTOCOLS; ++i) {
+    IrFrame thisFrame;
+    if (decode(&protocols[i], &decoders[from][i], mark, ticks, &thisFrame) && !found) {
+      *frame = thisFrame;
+      found = true;
+    }
+  }
+  return found;
+}
+
+bool irprotoTimeout(const uint8_t from, IrFrame* const frame) {
+  bool found = false;
+  receiver = from;
+  for (uint8_t i = 0; i < NUM_PROTOCOLS; ++i) {
+    Decoder* const d = &decoders[from][i];
+    IrFrame thisFrame;
+    if (d->stage == ST_TRAILER && complete(&protocols[i], d, &thisFrame) && !found) {
+      *frame = thisFrame;
+      found = true;
+    }
+    d->stage = ST_IDLE;
+  }
+  return found;
+}
+
+bool irprotoPending(void) {
+  for (uint8_t r = 0; r < IR_RECEIVERS; ++r) {
+    for (uint8_t i = 0; i < NUM_PROTOCOLS; ++i) {
+      if (decoders[r][i].stage == ST_TRAILER) {
+        return true;
+      }
+    }
+  }
+  return false;
+}
+
+void irprotoReset(void) {
+  for (uint8_t r = 0; r < IR_RECEIVERS; ++r) {
+    for (uint8_t i = 0; i < NUM_PROTOCOLS; ++i) {
+      decoders[r][i].stage = ST_IDLE;
+    }
+  }
+}
+
+#if STATS_ENABLE
+uint16_t irprotoResyncs(void) {
+  return resyncs;
+}
+
+void irprotoTiming(const uint8_t index, IrTiming* const timing) {
+  const Decoder* const d = &decoders[0][index];
+  timing->protocol = rdByte(&protocols[index].protocol);
+  timing->frames = d->frames;
+  timing->margin = d->margin;
+#if IR_CALIBRATE
+  timing->clock = (uint16_t)(((uint32_t)CAL_ONE << CAL_SHIFT) / (uint16_t)(CAL_ONE + d->skew));
+  timing->stretch = learnedStretch[0];
+#else
+  timing->clock = 1024;
+  timing->stretch = 0;
+#endif
+}
+#endif
+
+uint8_t irprotoHoldPeriods(const uint8_t protocol) {
+  for (uint8_t i = 0; i < NUM_PROTOCOLS; ++i) {
+    if (rdByte(&protocols[i].protocol) == protocol) {
+      return rdByte(&protocols[i].holdPeriods);
+    }
+  }
+  return 1;
+}
+
+uint32_t irprotoPeriod(const uint8_t protocol) {
+  for (uint8_t i = 0; i < NUM_PROTOCOLS; ++i) {
+    if (rdByte(&protocols[i].protocol) == protocol) {
+      return (uint32_t)pgm_read_word(&protocols[i].period) * IR_TICKS(PERIOD_UNIT);
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,70 @@
+#ifndef IRPROTO_H
+#define IRPROTO_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "ir.h"
+
+// Timer1 ticks at F_CPU/8 (see irInit()). Durations in the protocol tables are
+// converted to ticks at compile time with this.
+#define IR_TIMER_PRESCALER 8
+#define IR_TICKS(us) ((uint16_t)(((uint32_t)(us) * (F_CPU / 1000UL / IR_TIMER_PRESCALER)) / 1000UL))
+
+// Duration given for a space that has lasted longer than a timeout period
+#define IR_LONG 0xFFFF
+
+// Flags attached to a decoded frame
+#define IR_FRAME_REPEAT _BV(0)  // a repeat code (NEC): no address or command
+#define IR_FRAME_TOGGLE _BV(1)  // the frame's toggle bit (RC5, RC6)
+
+typedef struct {
+  IrCode  code;
+  uint8_t flags;
+} IrFrame;
+
+// Feed a pulse (a mark, i.e IR burst, or a space) of the given duration in
+// ticks from the given receiver to each of its decoders. If one of them
+// completes a frame, it is written to the frame and true is returned.
+bool irprotoPulse(uint8_t receiver, bool mark, uint16_t ticks, IrFrame* frame);
+
+// End of transmission: the 26ms timeout expired. This may complete a frame too
+// (when its length could only be known once no more bits arrived).
+bool irprotoTimeout(uint8_t receiver, IrFrame* frame);
+
+// Whether a decoder (of any receiver) has a frame which only needs silence to
+// complete it.
+bool irprotoPending(void);
+
+// Forget every receiver's partially-received frames.
+void irprotoReset(void);
+
+// The number of times a decoder has abandoned a frame part-way through because
+// the pulse which broke it could start a new one (STATS_ENABLE).
+uint16_t irprotoResyncs(void);
+
+// What the first receiver's decoder for a protocol has learned of the frames
+// it has decoded (see IR_CALIBRATE; STATS_ENABLE). Times are in ticks.
+typedef struct {
+  uint8_t  protocol;  // IrProtocol
+  uint16_t frames;    // frames decoded (saturating)
+  uint16_t clock;     // the remote's unit period as learned, in 1/1024ths of nominal
+  int16_t  stretch;   // how much longer the receiver makes marks, and spaces shorter
+  uint16_t margin;    // the least by which a pulse of the last one fitted its window
+} __attribute__((packed)) IrTiming;
+
+// The number of protocols enabled, for which there are IrTimings
+#define IRPROTO_COUNT \
+  (IR_USE_SIRC12 + IR_USE_SIRC15 + IR_USE_SIRC20 + IR_USE_NEC + IR_USE_RC5 + IR_USE_RC6)
+
+// Get the IrTiming of the index'th protocol enabled.
+void irprotoTiming(uint8_t index, IrTiming* timing);
+
+// The number of consecutive timeout periods with no frames, after which a
+// button using the given protocol should be considered released.
+uint8_t irprotoHoldPeriods(uint8_t protocol);
+
+// The nominal start-to-start period of the given protocol's frames while a
+// button is held, in ticks.
+uint32_t irprotoPeriod(uint8_t protocol);
+
+#endif
@@ -0,0 +1,349 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <string.h>
+#include <avr/pgmspace.h>
+#include <avr/eeprom.h>
+#include <util/crc16.h>
+#include <LUFA/Drivers/USB/USB.h>
+#include "IrateConfig.h"
+#include "IrateKeymap.h"
+#include "keymap.h"
+
+// The keymap's entries are stored in flash in the order they're listed, and
+// found through a table of slots indexed by a hash of the button-code. Each
+// slot holds one plus the index of the entry hashing to it (or zero). The
+// slots are filled in with designated initializers, so a collision is a field
+// initialized twice, which is made an error: the hash is then perfect for the
+// keymap it was built with, and a lookup is one hash, one slot read and one
+// comparison.
+
+#define SLOTS (1U << KEYMAP_SLOT_BITS)
+
+// Multiplicative hash of the whole button-code, keeping the top bits
+#define HASH(bits, protocol, address, command) ((uint8_t)( \
+  ((((uint32_t)(protocol) << 24) | ((uint32_t)(address) << 8) | (command)) * (uint32_t)(KEYMAP_SEED)) \
+    >> (32 - (bits)) \
+))
+
+// The repeat curves are numbered from one, as entries refer to them
+#define REPEAT_INDEX(name, delay, first, last, step) REPEAT_##name,
+enum {
+  REPEAT_BASE = REPEAT_HOLD,  // so the first curve is 1
+  IRATE_REPEATS(REPEAT_INDEX)
+  REPEAT_COUNT
+};
+
+#define REPEAT_CHECK(name, delay, first, last, step) \
+  _Static_assert((delay) > 0 && (last) > 0 && (first) >= (last), "bad repeat curve " #name);
+IRATE_REPEATS(REPEAT_CHECK)
+
+#define REPEAT_CURVE(name, delay, first, last, step) {delay, first, last, step},
+static const RepeatCurve PROGMEM repeatCurves[] = {
+  IRATE_REPEATS(REPEAT_CURVE)
+};
+
+// So are the macros; each one's steps are an array of their own
+#define MACRO_INDEX(name, ...) MACRO_##name,
+enum {
+  MACRO_BASE = MACRO_NONE,  // so the first macro is 1
+  IRATE_MACROS(MACRO_INDEX)
+  MACRO_COUNT
+};
+
+#define MACRO_STEPS(name, ...) \
+  static const MacroStep PROGMEM macro_##name[] = {__VA_ARGS__}; \
+  _Static_assert(sizeof(macro_##name) / sizeof(MacroStep) <= 0xFF, "too many steps in macro " #name);
+IRATE_MACROS(MACRO_STEPS)
+
+#define MACRO_ENTRY(name, ...) {macro_##name, sizeof(macro_##name) / sizeof(MacroStep)},
+static const Macro PROGMEM macros[] = {
+  IRATE_MACROS(MACRO_ENTRY)
+};
+
+#define KEY_INDEX(name, protocol, address, command, ...) KEY_##name,
+enum {
+  IRATE_KEYMAP(KEY_INDEX)
+  KEYMAP_SIZE
+};
+
+_Static_assert(KEYMAP_SLOT_BITS <= 8, "KEYMAP_SLOT_BITS is too large");
+_Static_assert(KEYMAP_SIZE < SLOTS, "not enough keymap slots");
+
+#define KEY_CHECK(name, protocol, address, command, confirm, repeat, macro, consumer, modifier, ...) \
+  _Static_assert(sizeof((uint8_t[]){__VA_ARGS__}) <= KEYMAP_KEYS, "too many keycodes for " #name); \
+  _Static_assert((repeat) < REPEAT_COUNT, "no such repeat curve for " #name); \
+  _Static_assert((macro) < MACRO_COUNT, "no such macro for " #name);
+IRATE_KEYMAP(KEY_CHECK)
+
+#define KEY_ENTRY(name, protocol, address, command, confirm, repeat, macro, consumer, modifier, ...) \
+  {{protocol, command, address}, confirm, repeat, macro, modifier, {__VA_ARGS__}, consumer},
+static const KeymapEntry PROGMEM entries[] = {
+  IRATE_KEYMAP(KEY_ENTRY)
+};
+
+#pragma GCC diagnostic push
+#pragma GCC diagnostic error "-Woverride-init"
+#define KEY_SLOT(name, protocol, address, command, ...) \
+  [HASH(KEYMAP_SLOT_BITS, protocol, address, command)] = KEY_##name + 1,
+static const uint8_t PROGMEM slots[SLOTS] = {
+  IRATE_KEYMAP(KEY_SLOT)
+};
+#pragma GCC diagnostic pop
+
+// The routes are found the same way, by a hash of the protocol and address
+// alone.
+
+#define ROUTE_SLOTS (1U << ROUTE_SLOT_BITS)
+
+typedef struct {
+  uint8_t  protocol;
+  uint8_t  route;
+  uint16_t address;
+} RouteEntry;
+
+#define ROUTE_INDEX(protocol, address, route) ROUTE_##protocol##_##address,
+enum {
+  IRATE_ROUTES(ROUTE_INDEX)
+  ROUTES_SIZE
+};
+
+_Static_assert(ROUTE_SLOT_BITS <= 8, "ROUTE_SLOT_BITS is too large");
+_Static_assert(ROUTES_SIZE < ROUTE_SLOTS, "not enough route slots");
+
+#define ROUTE_ENTRY(protocol, address, route) {protocol, route, address},
+static const RouteEntry PROGMEM routes[] = {
+  IRATE_ROUTES(ROUTE_ENTRY)
+};
+
+#pragma GCC diagnostic push
+#pragma GCC diagnostic error "-Woverride-init"
+#define ROUTE_SLOT(protocol, address, route) \
+  [HASH(ROUTE_SLOT_BITS, protocol, address, 0)] = ROUTE_##protocol##_##address + 1,
+static const uint8_t PROGMEM routeSlots[ROUTE_SLOTS] = {
+  IRATE_ROUTES(ROUTE_SLOT)
+};
+#pragma GCC diagnostic pop
+
+static bool sameCode(const KeymapEntry* const entry, const IrCode* const code) {
+  return
+    entry->code.protocol == code->protocol &&
+    entry->code.address == code->address &&
+    entry->code.command == code->command;
+}
+
+#if KEYMAP_CAPACITY
+
+// A keymap programmed over USB is kept in EEPROM, twice: the copy in use, and
+// the one the next update is written to. At boot, the valid copy with the
+// later generation is loaded into RAM, with a hash table of slots like the
+// built-in one's. Its hash can't be made perfect at compile time, so
+// collisions go in the next free slot; there are at least twice as many slots
+// as entries, so a lookup seldom needs more than one.
+
+#define KEYMAP_VERSION 3  // erased EEPROM reads as 0xFF; 1 had no repeat curves, 2 no macros
+#define RAM_SLOT_BITS (KEYMAP_CAPACITY > 8 ? 5 : KEYMAP_CAPACITY > 4 ? 4 : 3)
+#define RAM_SLOTS (1U << RAM_SLOT_BITS)
+
+typedef struct {
+  uint8_t  version;     // KEYMAP_VERSION
+  uint8_t  generation;
+  uint8_t  count;       // entries in use
+  uint16_t crc;         // of the fields above, then the entries in use
+} __attribute__((packed)) Header;
+
+typedef struct {
+  Header      header;
+  KeymapEntry entries[KEYMAP_CAPACITY];
+} __attribute__((packed)) Copy;
+
+// The AT90USB162's EEPROM holds two copies of at most 15 entries; the slots
+// would do for 16
+_Static_assert(KEYMAP_CAPACITY <= 16, "KEYMAP_CAPACITY is too large for the slots");
+_Static_assert(2 * sizeof(Copy) <= E2END + 1, "the keymap doesn't fit in EEPROM");
+
+static Copy EEMEM copies[2];
+
+static KeymapEntry ramEntries[KEYMAP_CAPACITY];
+static uint8_t ramSlots[RAM_SLOTS];  // one plus the index of an entry, or zero
+static uint8_t ramCount = 0;         // zero: use the built-in keymap
+static uint8_t active = 0;           // the copy loaded (if it is valid)
+static uint8_t generation = 0;
+
+// An update in progress
+static uint8_t state = KEYMAP_IDLE;
+static uint8_t stageCount;  // entries in the new keymap
+static uint8_t stageNext;   // the next one expected
+static bool loadDue = false;
+
+// EEPROM writes waiting to be done by keymapPoll()
+static uint8_t writeBuf[sizeof(KeymapEntry)];
+static uint8_t* writeAt;
+static uint8_t writeLen = 0;
+static uint8_t writePos = 0;
+
+static uint16_t crcOf(uint16_t crc, const uint8_t* p, uint8_t length) {
+  while (length--) {
+    crc = _crc16_update(crc, *p++);
+  }
+  return crc;
+}
+
+// The CRC a copy's header should have, from its contents in EEPROM
+static uint16_t copyCrc(const Copy* const copy, const Header* const header) {
+  uint16_t crc = crcOf(0xFFFF, &header->version, offsetof(Header, crc));
+  for (uint8_t i = 0; i < header->count; ++i) {
+    KeymapEntry entry;
+    eeprom_read_block(&entry, &copy->entries[i], sizeof(entry));
+    crc = crcOf(crc, (const uint8_t*)&entry, sizeof(entry));
+  }
+  return crc;
+}
+
+static bool readValid(const Copy* const copy, Header* const header) {
+  eeprom_read_block(header, &copy->header, sizeof(*header));
+  return
+    header->version == KEYMAP_VERSION && header->count <= KEYMAP_CAPACITY &&
+    header->crc == copyCrc(copy, header);
+}
+
+// Load the newest valid copy into RAM
+static void load(void) {
+  Header headers[2];
+  const bool valid0 = readValid(&copies[0], &headers[0]);
+  const bool valid1 = readValid(&copies[1], &headers[1]);
+  ramCount = 0;
+  memset(ramSlots, 0, sizeof(ramSlots));
+  if (!valid0 && !valid1) {
+    active = 0;
+    generation = 0;
+    return;
+  }
+  active = (valid1 && (!valid0 || (int8_t)(headers[1].generation - headers[0].generation) > 0));
+  generation = headers[active].generation;
+  eeprom_read_block(ramEntries, copies[active].entries, headers[active].count * sizeof(KeymapEntry));
+  for (uint8_t i = 0; i < headers[active].count; ++i) {
+    const KeymapEntry* const e = &ramEntries[i];
+    uint8_t slot = HASH(RAM_SLOT_BITS, e->code.protocol, e->code.address, e->code.command);
+    while (ramSlots[slot]) {
+      slot = (slot + 1) & (RAM_SLOTS - 1);
+    }
+    ramSlots[slot] = i + 1;
+  }
+  ramCount = headers[active].count;
+}
+
+static void queueWrite(void* const at, const void* const data, const uint8_t length) {
+  memcpy(writeBuf, data, length);
+  writeAt = at;
+  writeLen = length;
+  writePos = 0;
+}
+
+void keymapInit(void) {
+  load();
+}
+
+void keymapPoll(void) {
+  if (writePos < writeLen) {
+    if (eeprom_is_ready()) {
+      uint8_t* const at = writeAt + writePos;
+      if (eeprom_read_byte(at) != writeBuf[writePos]) {
+        eeprom_write_byte(at, writeBuf[writePos]);
+      }
+      ++writePos;
+    }
+  } else if (loadDue && eeprom_is_ready()) {
+    loadDue = false;
+    load();
+    state = KEYMAP_IDLE;
+  }
+}
+
+bool keymapBusy(void) {
+  return writePos < writeLen || loadDue;
+}
+
+void keymapSetReport(const KeymapReport* const report) {
+  Copy* const stage = &copies[!active];
+  if (report->op == KEYMAP_OP_BEGIN && report->index <= KEYMAP_CAPACITY) {
+    // Invalidate the copy being written to, before anything else is
+    const uint8_t version = 0;
+    queueWrite(&stage->header.version, &version, sizeof(version));
+    stageCount = report->index;
+    stageNext = 0;
+    state = KEYMAP_STAGING;
+  } else if (state == KEYMAP_STAGING && report->op == KEYMAP_OP_ENTRY && report->index == stageNext && stageNext < stageCount) {
+    queueWrite(&stage->entries[stageNext++], &report->entry, sizeof(KeymapEntry));
+  } else if (state == KEYMAP_STAGING && report->op == KEYMAP_OP_COMMIT && stageNext == stageCount) {
+    // The entries are all written by now; the CRC is of what was written
+    Header header = {KEYMAP_VERSION, generation + 1, stageCount, 0};
+    header.crc = copyCrc(stage, &header);
+    queueWrite(&stage->header, &header, sizeof(header));
+    loadDue = true;
+  } else {
+    state = KEYMAP_ERROR;
+  }
+}
+
+void keymapGetReport(KeymapReport* const report) {
+  memset(report, 0, sizeof(*report));
+  report->reportId = KEYMAP_REPORT_ID;
+  report->op = keymapBusy() ? KEYMAP_BUSY : state;
+  report->index = ramCount;
+  report->generation = generation;
+  report->capacity = KEYMAP_CAPACITY;
+}
+
+#endif
+
+bool keymapRepeat(const uint8_t repeat, RepeatCurve* const curve) {
+  if (repeat == REPEAT_HOLD || repeat >= REPEAT_COUNT) {
+    return false;
+  }
+  memcpy_P(curve, &repeatCurves[repeat - 1], sizeof(*curve));
+  return true;
+}
+
+bool keymapMacro(const uint8_t macro, Macro* const result) {
+  if (macro == MACRO_NONE || macro >= MACRO_COUNT) {
+    return false;
+  }
+  memcpy_P(result, &macros[macro - 1], sizeof(*result));
+  return true;
+}
+
+uint8_t keymapRoute(const IrCode* const code) {
+  const uint8_t slot = pgm_read_byte(&routeSlots[HASH(ROUTE_SLOT_BITS, code->protocol, code->address, 0)]);
+  if (slot) {
+    RouteEntry entry;
+    memcpy_P(&entry, &routes[slot - 1], sizeof(entry));
+    if (entry.protocol == code->protocol && entry.address == code->address) {
+      return entry.route;
+    }
+  }
+  return ROUTE_DEFAULT;
+}
+
+bool keymapLookup(const IrCode* const code, KeymapEntry* const entry) {
+#if KEYMAP_CAPACITY
+  if (ramCount) {
+    uint8_t slot = HASH(RAM_SLOT_BITS, code->protocol, code->address, code->command);
+    while (ramSlots[slot]) {
+      const KeymapEntry* const e = &ramEntries[ramSlots[slot] - 1];
+      if (sameCode(e, code)) {
+        *entry = *e;
+        return true;
+      }
+      slot = (slot + 1) & (RAM_SLOTS - 1);
+    }
+    return false;
+  }
+#endif
+  const uint8_t slot = pgm_read_byte(&slots[HASH(KEYMAP_SLOT_BITS, code->protocol, code->address, code->command)]);
+  if (slot == 0) {
+    return false;
+  }
+  memcpy_P(entry, &entries[slot - 1], sizeof(*entry));
+  return sameCode(entry, code);
+}
@@ -0,0 +1,138 @@
+#ifndef KEYMAP_H
+#define KEYMAP_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "IrateConfig.h"
+#include "ir.h"
+
+#define KEYMAP_KEYS 6  // keycodes per entry, as in the boot keyboard report
+
+// What an IR button-code does (see config/IrateKeymap.h). This is also the
+// format of an entry in EEPROM, and in a keymap feature report.
+typedef struct {
+  IrCode   code;
+  uint8_t  confirm;             // IrConfirm mode
+  uint8_t  repeat;              // repeat curve (see KEY_REPEAT), or REPEAT_HOLD
+  uint8_t  macro;               // macro sent instead of keys (see MACRO_ENABLE), or MACRO_NONE
+  uint8_t  modifier;            // HID_KEYBOARD_MODIFIER_* bits (or MOUSE_* buttons)
+  uint8_t  keys[KEYMAP_KEYS];   // HID_KEYBOARD_SC_* keycodes, zero-padded (or MOUSE_MOVE())
+  uint16_t consumer;            // consumer-page usage (or KEYMAP_SYSTEM | usage), or zero
+} __attribute__((packed)) KeymapEntry;
+
+// Set in an entry's consumer usage to make it a System Control usage (on the
+// generic desktop page) instead
+#define KEYMAP_SYSTEM 0x8000
+
+// Where each remote's button-codes go, by its protocol and device address (see
+// IRATE_ROUTES in config/IrateKeymap.h).
+typedef enum {
+  ROUTE_IGNORE,    // nowhere: its frames are dropped as soon as they decode
+  ROUTE_KEYBOARD,  // the keyboard report: each entry's modifier and keycodes,
+                   // and its consumer usage (see USB_MEDIA_KEYS)
+  ROUTE_MOUSE,     // the mouse report: each entry's buttons and movement
+  ROUTE_CONSUMER   // each entry's consumer usage alone
+} Route;
+
+// How a held button's keys repeat (see KEY_REPEAT, and IRATE_REPEATS in
+// config/IrateKeymap.h): they are released and pressed again delay ms after
+// the press, and then every interval ms, which starts at first and shortens by
+// step each time, until it is last. An entry's repeat is the number of its
+// curve, counting from one; REPEAT_HOLD holds the keys down instead.
+#define REPEAT_HOLD 0
+
+typedef struct {
+  uint16_t delay;
+  uint16_t first;
+  uint16_t last;
+  uint16_t step;
+} RepeatCurve;
+
+// Get a repeat curve. Returns false for REPEAT_HOLD (or a curve which doesn't
+// exist, e.g in a programmed keymap).
+bool keymapRepeat(uint8_t repeat, RepeatCurve* curve);
+
+// A keystroke macro (see MACRO_ENABLE, and IRATE_MACROS in
+// config/IrateKeymap.h): its steps, each of which sends a keyboard report
+// holding modifier and key (if any), delay ms after the one before. An entry's
+// macro is the number of its macro, counting from one; MACRO_NONE is none.
+#define MACRO_NONE 0
+
+typedef struct {
+  uint8_t delay;
+  uint8_t modifier;
+  uint8_t key;
+} MacroStep;
+
+typedef struct {
+  const MacroStep* steps;  // in flash
+  uint8_t count;
+} Macro;
+
+// Get a macro. Returns false for MACRO_NONE (or a macro which doesn't exist,
+// e.g in a programmed keymap).
+bool keymapMacro(uint8_t macro, Macro* result);
+
+// The route for a button-code's remote. Like keymapLookup(), this takes no
+// longer however many remotes are listed.
+uint8_t keymapRoute(const IrCode* code);
+
+// Look up a button-code in the keymap. If it is there, its entry is copied out
+// and true is returned. This is a hash lookup, so it takes no longer however
+// many entries there are, and it never reads the EEPROM.
+bool keymapLookup(const IrCode* code, KeymapEntry* entry);
+
+// Unless KEYMAP_CAPACITY is 0, the keymap can be replaced without reflashing,
+// through a feature report on the vendor-defined interface (see
+// host/irkeymap.c). Setting the report does one step of an update:
+//
+//   KEYMAP_OP_BEGIN:  start a keymap of index entries;
+//   KEYMAP_OP_ENTRY:  entry number index (they must come in order);
+//   KEYMAP_OP_COMMIT: switch to the new keymap, once all its entries are in.
+//
+// The new keymap is written to whichever of the two copies in EEPROM is not in
+// use, and is only switched to when its header (with its CRC) is written by
+// the commit, so lookups keep using the old one until then, even across a
+// reset. A keymap with no entries means the built-in one. Each step's EEPROM
+// writes are done from the main loop (by keymapPoll()), and while they are in
+// progress, setting the report is refused (stalled); getting it returns the
+// state below, so the host can wait for KEYMAP_IDLE between steps.
+#define KEYMAP_REPORT_ID 2
+
+typedef enum {
+  KEYMAP_OP_BEGIN = 1,
+  KEYMAP_OP_ENTRY,
+  KEYMAP_OP_COMMIT
+} KeymapOp;
+
+typedef enum {
+  KEYMAP_IDLE,     // nothing in progress
+  KEYMAP_STAGING,  // a new keymap is being received
+  KEYMAP_BUSY,     // EEPROM writes are in progress
+  KEYMAP_ERROR     // the last update went wrong, and was abandoned
+} KeymapState;
+
+typedef struct {
+  uint8_t     reportId;    // KEYMAP_REPORT_ID
+  uint8_t     op;          // set: KeymapOp; get: KeymapState
+  uint8_t     index;       // set: see KeymapOp; get: the number of entries in use
+  uint8_t     generation;  // get: incremented by each commit
+  uint8_t     capacity;    // get: KEYMAP_CAPACITY
+  KeymapEntry entry;       // set: KEYMAP_OP_ENTRY's entry
+} __attribute__((packed)) KeymapReport;
+
+#if KEYMAP_CAPACITY
+// Load the newest valid keymap from EEPROM (or fall back to the built-in one).
+void keymapInit(void);
+
+// Carry on with any EEPROM writes. Called repeatedly from the main loop.
+void keymapPoll(void);
+
+// Whether a step of an update is still being written (see above).
+bool keymapBusy(void);
+
+void keymapSetReport(const KeymapReport* report);
+void keymapGetReport(KeymapReport* report);
+#endif
+
+#endif
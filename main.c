@@ -7,8 +7,13 @@
 #include <avr/interrupt.h>
 #include <LUFA/Drivers/USB/USB.h>
 #include "ir.h"
+#include "keymap.h"
 #include "mouse.h"
 #include "usb.h"
+#include "profile.h"
+#include "sched.h"
+#include "timer.h"
+#include "trace.h"
 
 int main(void) {
   MCUSR &= ~(1 << WDRF);
@@ -18,10 +23,33 @@ int main(void) {
   PORTB = 0xFF; PORTC = 0xFF; PORTD = 0xFF;  // ...with pull-ups
   USB_Init();
   irInit();
+  timerInit();
+#if TRACE_ENABLE
+  traceInit();
+#endif
+#if KEYMAP_CAPACITY
+  keymapInit();
+#endif
   mouseInit();
   sei();
   for (;;) {
-    usbSendReceive();
+    PROFILE_LOOP_BEGIN();
+    if (schedTake(WORK_IR)) {
+      irPoll();
+    }
+#if KEYMAP_CAPACITY
+    keymapPoll();
+#endif
+    if (schedTake(WORK_TIMER)) {
+      timerPoll();
+    }
+    PROFILE_LOOP_MARK(PROFILE_POLL);
+    if (schedTake(WORK_USB)) {
+      usbSendReceive();
+    }
+    PROFILE_LOOP_MARK(PROFILE_SEND);
     USB_USBTask();
+    PROFILE_LOOP_MARK(PROFILE_TASK);
+    schedSleep();
   }
 }
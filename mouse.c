@@ -1,13 +1,13 @@
 #include <stdint.h>
 #include <stdbool.h>
-#include <avr/interrupt.h>
 #include <avr/io.h>
 #include "mouse.h"
+#include "sched.h"
+#include "timer.h"
 
-#define COUNT_INIT 375  // 375*16ms = 6 seconds
-//#define COUNT_INIT 4  // 4*16ms = 64ms
-static volatile uint16_t count = COUNT_INIT;
-static volatile bool sendReport = false;;
+#define JIGGLE_PERIOD 6000  // ms
+//#define JIGGLE_PERIOD 64
+static bool sendReport = false;
 
 // Allow the USB stuff to know when a report is due (every six seconds)
 bool mouseIsReportDue(void) {
@@ -23,24 +23,18 @@ bool mouseIsButtonPressed(void) {
   return !(PIND & _BV(7));
 }
 
-// Timer interrupt fires every 16ms.
-ISR(TIMER0_COMPA_vect) {
-  --count;
-  if (count == 0) {
-    count = COUNT_INIT;
-    sendReport = true;
-  }
+// Timer callback, every six seconds.
+static void jiggle(const TimerId id) {
+  (void)id;
+  sendReport = true;
+  schedPost(WORK_USB);
 }
 
-// Initialise button and timer
+// Initialise button and timer (after timerInit())
 void mouseInit(void) {
   // Button
   DDRD &= ~_BV(7);
 
-  // Configure timer 0
-  TCNT0 = 0;
-  OCR0A = 249;  // 16ms (250*1024/16MHz = 0.016s)
-  TIMSK0 = _BV(OCIE0A);
-  TCCR0A = _BV(WGM01);
-  TCCR0B = _BV(CS02) | _BV(CS00);  // CTC mode, prescaler 1024 (15.625 kHz)
+  // Jiggler
+  timerStart(TIMER_JIGGLE, JIGGLE_PERIOD, JIGGLE_PERIOD, jiggle);
 }
@@ -0,0 +1,134 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <avr/io.h>
+#include <util/atomic.h>
+#include "IrateConfig.h"
+#include "irproto.h"
+#include "profile.h"
+
+#if PROFILE_ENABLE
+
+// The ISRs update the stats directly in the report. While the host is reading
+// it, it is frozen (the ISRs discard their timings), so the readout needs no
+// copy, and nothing is sampled half-updated. It thaws at the start of the next
+// main-loop iteration; the iteration which did the readout is not timed.
+static ProfileReport report = {
+  .isr = {[0 ... PROFILE_NUM_ISRS - 1] = {.min = 0xFFFF}},
+  .latency = {.min = 0xFFFF}
+};
+static volatile bool frozen = false;
+static uint16_t loopStart;
+static uint16_t stageStart;
+static uint16_t loops = 0;
+static uint16_t slept = 0;        // this iteration
+static uint32_t sleptWindow = 0;  // ...and this window
+static bool started = false;
+
+static uint16_t now(void) {
+  uint16_t ticks;
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+    ticks = TCNT1;  // the ISRs also use the 16-bit TEMP register
+  }
+  return ticks;
+}
+
+static void record(ProfileIsrStats* const stats, uint16_t ticks, const uint8_t shift) {
+  uint8_t bucket = 0;
+  if (ticks < stats->min) {
+    stats->min = ticks;
+  }
+  if (ticks > stats->max) {
+    stats->max = ticks;
+  }
+  if (stats->count != 0xFFFF) {
+    ++stats->count;
+    stats->total += ticks;
+  }
+  ticks >>= shift;
+  while (ticks >= 2 && bucket < PROFILE_BUCKETS - 1) {
+    ticks >>= 1;
+    ++bucket;
+  }
+  if (stats->histogram[bucket] != 0xFFFF) {
+    ++stats->histogram[bucket];
+  }
+}
+
+// Called at the end of each ISR, with interrupts disabled.
+void profileIsr(const uint8_t isr, const uint16_t ticks) {
+  if (!frozen) {
+    record(&report.isr[isr], ticks, 0);
+  }
+}
+
+// Called just after a keyboard report is handed to the USB controller, with the
+// time of the IR edge which caused it.
+void profileLatency(const uint16_t since) {
+  const uint16_t ticks = now() - since;
+  if (!frozen) {
+    record(&report.latency, ticks, PROFILE_LATENCY_SHIFT);
+  }
+}
+
+// Called at the top of the main loop. Timer1 wraps every 65536 ticks, so count
+// the iterations (and the time asleep) between wraps.
+void profileLoopBegin(void) {
+  const uint16_t ticks = now();
+  if (frozen) {
+    frozen = false;
+  } else if (started) {
+    const uint16_t elapsed = ticks - loopStart - slept;
+    if (elapsed > report.loopMax) {
+      report.loopMax = elapsed;
+    }
+  }
+  ++loops;
+  if (ticks < loopStart) {
+    report.loopsPerWindow = loops;
+    report.awakePerWindow = (sleptWindow == 0) ? 0xFFFF : (sleptWindow >= 0x10000) ? 0 : 0x10000 - sleptWindow;
+    loops = 0;
+    sleptWindow = 0;
+  }
+  slept = 0;
+  loopStart = stageStart = ticks;
+  started = true;
+}
+
+// Called at the end of each main-loop stage.
+void profileLoopMark(const uint8_t stage) {
+  const uint16_t ticks = now();
+  const uint16_t elapsed = ticks - stageStart;
+  if (!frozen && elapsed > report.stageMax[stage]) {
+    report.stageMax[stage] = elapsed;
+  }
+  stageStart = ticks;
+}
+
+// Called with interrupts disabled, having slept for the given time.
+void profileSleep(const uint16_t ticks) {
+  slept += ticks;
+  sleptWindow += ticks;
+}
+
+// Freeze the stats for the host to read them.
+ProfileReport* profileFreeze(void) {
+  frozen = true;
+  report.reportId = PROFILE_REPORT_ID;
+  report.cyclesPerTick = IR_TIMER_PRESCALER;
+  return &report;
+}
+
+// Start again from scratch.
+void profileReset(void) {
+  frozen = true;
+  memset(&report, 0, sizeof(report));
+  for (uint8_t i = 0; i < PROFILE_NUM_ISRS; ++i) {
+    report.isr[i].min = 0xFFFF;
+  }
+  report.latency.min = 0xFFFF;
+  loops = 0;
+  sleptWindow = 0;
+}
+
+#endif
@@ -0,0 +1,102 @@
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#include <stdint.h>
+#include "IrateConfig.h"
+#include "irproto.h"
+#include "usb.h"
+
+// Execution-time profiling. Everything is timed with Timer1 (free-running at
+// F_CPU/8, set up by irInit()), so the resolution is eight CPU cycles. An ISR
+// is timed from just after its prologue to just before its epilogue, so the
+// register save/restore (and the interrupt latency) are not included. Time
+// asleep is measured from just before sleeping to just after waking, so it
+// includes the ISR which did the waking.
+//
+// With PROFILE_ENABLE off, the macros below expand to nothing, and none of the
+// rest of this header is used.
+
+#define PROFILE_REPORT_ID 1  // feature report on the vendor interface
+#define PROFILE_BUCKETS   8  // histogram: <2, <4, <8, ... <128, >=128 ticks
+#define PROFILE_LATENCY_SHIFT 5  // ...but 32 times those for the latency
+
+// ISRs which are timed
+typedef enum {
+  PROFILE_EDGE,     // TIMER1_CAPT_vect or INT4_vect, depending on IR_FRONTEND
+  PROFILE_TIMEOUT,  // TIMER1_COMPA_vect
+  PROFILE_TICK,     // TIMER1_COMPC_vect: the timers' tick, until configured
+  PROFILE_SOF,      // LUFA's USB_GEN_vect, for the SOF event handler only
+  PROFILE_NUM_ISRS
+} ProfileIsr;
+
+// Main-loop stages which are timed
+typedef enum {
+  PROFILE_POLL,     // irPoll(), keymapPoll() and timerPoll()
+  PROFILE_SEND,     // usbSendReceive()
+  PROFILE_TASK,     // USB_USBTask()
+  PROFILE_NUM_STAGES
+} ProfileStage;
+
+// All times are in Timer1 ticks, i.e quantised to eight CPU cycles: each one
+// measured may be up to seven cycles longer or shorter than it is reported
+// (the two reads of TCNT1 can each fall anywhere in a tick). The counts
+// saturate at 0xFFFF, and the total then stops too, so total/count is always
+// the mean.
+typedef struct {
+  uint16_t count;
+  uint16_t min;                          // ticks, each +-7 cycles
+  uint16_t max;                          // ticks, each +-7 cycles
+  uint32_t total;                        // ticks, each +-7 cycles per count
+  uint16_t histogram[PROFILE_BUCKETS];   // bucketed by ticks, so a time within
+                                         // 7 cycles of a boundary may be in
+                                         // either bucket
+} __attribute__((packed)) ProfileIsrStats;
+
+typedef struct {
+  uint8_t         reportId;          // PROFILE_REPORT_ID
+  uint8_t         cyclesPerTick;     // CPU cycles per Timer1 tick: the quantum
+  ProfileIsrStats isr[PROFILE_NUM_ISRS];
+  uint16_t        loopsPerWindow;    // main-loop iterations per 65536 ticks
+  uint16_t        awakePerWindow;    // ...and ticks not spent asleep, each
+                                     // sleep +-7 cycles
+  uint16_t        loopMax;           // longest main-loop iteration (awake), in
+                                     // ticks, +-7 cycles
+  uint16_t        stageMax[PROFILE_NUM_STAGES];  // ...and stage, likewise
+  UsbStats        usb;               // filled in by usb.c
+  ProfileIsrStats latency;           // IR edge to Endpoint_ClearIN() (see below)
+  IrTiming        timing[IRPROTO_COUNT];  // filled in by usb.c
+} __attribute__((packed)) ProfileReport;
+
+// The latency is measured from the edge (or timeout) which caused an IR event
+// to the Endpoint_ClearIN() of the keyboard report it changed, in ticks (so to
+// within 7 cycles, i.e 0.5us, as above). The host then
+// collects the report at its next poll, up to USB_POLL_INTERVAL later. Only
+// latencies under 32ms (a turn of Timer1) are measured correctly.
+
+#if PROFILE_ENABLE
+  #include <avr/io.h>
+  #define PROFILE_ISR_BEGIN() const uint16_t profileStart = TCNT1
+  #define PROFILE_ISR_END(isr) profileIsr(isr, TCNT1 - profileStart)
+  #define PROFILE_LOOP_BEGIN() profileLoopBegin()
+  #define PROFILE_LOOP_MARK(stage) profileLoopMark(stage)
+  #define PROFILE_SLEEP_BEGIN() const uint16_t profileSleepStart = TCNT1
+  #define PROFILE_SLEEP_END() profileSleep(TCNT1 - profileSleepStart)
+  #define PROFILE_LATENCY(since) profileLatency(since)
+  void profileIsr(uint8_t isr, uint16_t ticks);
+  void profileLoopBegin(void);
+  void profileLoopMark(uint8_t stage);
+  void profileSleep(uint16_t ticks);
+  void profileLatency(uint16_t since);
+  ProfileReport* profileFreeze(void);
+  void profileReset(void);
+#else
+  #define PROFILE_ISR_BEGIN()
+  #define PROFILE_ISR_END(isr)
+  #define PROFILE_LOOP_BEGIN()
+  #define PROFILE_LOOP_MARK(stage)
+  #define PROFILE_SLEEP_BEGIN()
+  #define PROFILE_SLEEP_END()
+  #define PROFILE_LATENCY(since)
+#endif
+
+#endif
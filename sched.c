@@ -0,0 +1,73 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <avr/sleep.h>
+#include <LUFA/Drivers/USB/USB.h>
+#include "IrateConfig.h"
+#include "ir.h"
+#include "keymap.h"
+#include "profile.h"
+#include "sched.h"
+
+volatile uint8_t schedWork = 0;
+
+bool schedTake(const uint8_t work) {
+  bool taken;
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+    taken = (schedWork & work) != 0;
+    schedWork &= ~work;
+  }
+  return taken;
+}
+
+// Interrupts are disabled while checking for work, and only enabled again by
+// the instruction before SLEEP, which always executes before any interrupt
+// can, so an interrupt flagging work can't slip in between and be slept
+// through. Only once configured is the CPU woken every millisecond by the SOF,
+// to poll the endpoints and control requests; until then, and while EEPROM
+// writes are in progress (see keymapPoll()), it doesn't sleep at all. While
+// suspended, it powers down once the receivers are quiet (see SUSPEND_ENABLE),
+// to be woken by a mark or by the host resuming the bus, and until then it
+// idles, woken by the IR interrupts.
+void schedSleep(void) {
+#if SLEEP_ENABLE || SUSPEND_ENABLE
+  cli();
+  bool idle = !schedWork;
+#if KEYMAP_CAPACITY
+  idle = idle && !keymapBusy();
+#endif
+#if SUSPEND_ENABLE
+  const bool suspended = USB_DeviceState == DEVICE_STATE_Suspended;
+  const bool down = idle && suspended && irQuiet();
+#else
+  const bool suspended = false;
+  const bool down = false;
+#endif
+  if (down) {
+#if SUSPEND_ENABLE
+    irWakeArm();
+    set_sleep_mode(SLEEP_MODE_PWR_DOWN);
+#endif
+  } else if (idle && (suspended || (SLEEP_ENABLE && USB_DeviceState == DEVICE_STATE_Configured))) {
+    set_sleep_mode(SLEEP_MODE_IDLE);
+  } else {
+    idle = false;
+  }
+  if (idle) {
+    PROFILE_SLEEP_BEGIN();
+    sleep_enable();
+    sei();
+    sleep_cpu();
+    sleep_disable();
+    cli();
+    PROFILE_SLEEP_END();
+#if SUSPEND_ENABLE
+    if (down) {
+      irWakeDisarm();
+    }
+#endif
+  }
+  sei();
+#endif
+}
@@ -0,0 +1,32 @@
+#ifndef SCHED_H
+#define SCHED_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <avr/io.h>
+#include <util/atomic.h>
+#include "IrateConfig.h"
+
+// Work for the main loop, flagged by the ISRs (and by one main-loop stage for
+// another). Each stage only runs when its work is flagged, and when none is,
+// the CPU sleeps until the next interrupt (see SLEEP_ENABLE).
+#define WORK_IR    _BV(0)  // irPoll(): ring entries, or a held-back pulse is due
+#define WORK_USB   _BV(1)  // usbSendReceive(): a SOF, a jiggler step or an IR event
+#define WORK_TIMER _BV(2)  // timerPoll(): a millisecond tick (see timer.h)
+
+extern volatile uint8_t schedWork;
+
+// Flag work. This may be called from the ISRs or the main loop.
+static inline void schedPost(const uint8_t work) {
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+    schedWork |= work;
+  }
+}
+
+// Whether the given work is flagged, clearing the flag.
+bool schedTake(uint8_t work);
+
+// Called at the end of each main-loop iteration: sleep, if there's no work.
+void schedSleep(void);
+
+#endif
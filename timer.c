@@ -0,0 +1,147 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <util/atomic.h>
+#include "IrateConfig.h"
+#include "irproto.h"
+#include "profile.h"
+#include "sched.h"
+#include "timer.h"
+
+#define TICK_TICKS  IR_TICKS(1000)  // Timer1 ticks in a millisecond
+#define WHEEL_SLOTS 8               // a power of two
+#define NONE        0xFF
+
+_Static_assert(TIMER_COUNT <= 8, "too many timers");
+
+typedef struct {
+  uint16_t      expiry;    // the time it's due, in ms
+  uint16_t      period;    // or zero, for a one-shot timer
+  TimerCallback callback;
+  uint8_t       next;      // the next timer on its slot's list, or NONE
+} Timer;
+
+static Timer timers[TIMER_COUNT];
+static uint8_t wheel[WHEEL_SLOTS];    // the first timer on each slot's list
+static uint8_t running = 0;           // one bit per timer
+static uint8_t due = 0;               // taken off the wheel, not yet called
+static uint16_t ms = 0;               // the time, as far as timerPoll() has got
+static volatile uint8_t pending = 0;  // ticks timerPoll() has still to process
+static volatile bool sofTicks = false;
+
+static void wheelInsert(const uint8_t id) {
+  uint8_t* const head = &wheel[timers[id].expiry & (WHEEL_SLOTS - 1)];
+  timers[id].next = *head;
+  *head = id;
+  running |= _BV(id);
+}
+
+static void wheelRemove(const uint8_t id) {
+  uint8_t* at = &wheel[timers[id].expiry & (WHEEL_SLOTS - 1)];
+  while (*at != id) {
+    at = &timers[*at].next;
+  }
+  *at = timers[id].next;
+  running &= ~_BV(id);
+}
+
+void timerStart(const TimerId id, const uint16_t delay, const uint16_t period, const TimerCallback callback) {
+  if (running & _BV(id)) {
+    wheelRemove(id);
+  }
+  due &= ~_BV(id);
+  timers[id].expiry = ms + (delay ? delay : 1);
+  timers[id].period = period;
+  timers[id].callback = callback;
+  wheelInsert(id);
+}
+
+void timerStop(const TimerId id) {
+  if (running & _BV(id)) {
+    wheelRemove(id);
+  }
+  due &= ~_BV(id);
+}
+
+uint16_t timerNow(void) {
+  return ms;
+}
+
+void timerPoll(void) {
+  uint8_t ticks;
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+    ticks = pending;
+    pending = 0;
+  }
+  while (ticks--) {
+    // Take the timers which are due off the wheel before calling any of their
+    // callbacks, so the callbacks may start and stop timers themselves. One
+    // which a callback starts or stops meanwhile is no longer due (see
+    // timerStart()), so each is checked again just before it's called.
+    uint8_t* at = &wheel[++ms & (WHEEL_SLOTS - 1)];
+    while (*at != NONE) {
+      Timer* const timer = &timers[*at];
+      if (timer->expiry == ms) {
+        due |= _BV(*at);
+        running &= ~_BV(*at);
+        *at = timer->next;
+      } else {
+        at = &timer->next;
+      }
+    }
+    for (uint8_t id = 0; due; ++id) {
+      if (due & _BV(id)) {
+        due &= ~_BV(id);
+        if (timers[id].period) {
+          timers[id].expiry = ms + timers[id].period;
+          wheelInsert(id);
+        }
+        timers[id].callback(id);
+      }
+    }
+  }
+}
+
+static inline void tick(void) {
+  if (pending != 0xFF) {
+    ++pending;
+  }
+  schedPost(WORK_TIMER);
+}
+
+void timerSofTick(void) {
+  if (sofTicks) {
+    tick();
+  }
+}
+
+// Compare interrupt fires every millisecond, unless the SOF is the tick.
+ISR(TIMER1_COMPC_vect) {
+  PROFILE_ISR_BEGIN();
+  OCR1C += TICK_TICKS;
+  tick();
+  PROFILE_ISR_END(PROFILE_TICK);
+}
+
+void timerUseSof(const bool sof) {
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+    sofTicks = sof;
+    if (sof) {
+      TIMSK1 &= ~_BV(OCIE1C);
+    } else if (!(TIMSK1 & _BV(OCIE1C))) {
+      OCR1C = TCNT1 + TICK_TICKS;
+      TIFR1 = _BV(OCF1C);
+      TIMSK1 |= _BV(OCIE1C);
+    }
+  }
+}
+
+void timerInit(void) {
+  memset(wheel, NONE, sizeof(wheel));
+  running = 0;
+  pending = 0;
+  TIMSK1 &= ~_BV(OCIE1C);
+  timerUseSof(false);
+}
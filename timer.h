@@ -0,0 +1,62 @@
+#ifndef TIMER_H
+#define TIMER_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "IrateConfig.h"
+
+// Software timers, with a resolution of 1ms. Once configured, they are ticked
+// by the USB SOF; until then (and while disconnected), by Timer1's OCR1C
+// compare. While suspended, they stop (unless SUSPEND_ENABLE is off). Each
+// tick flags WORK_TIMER, and the callbacks of the timers which are due are
+// called from the main loop (by timerPoll()), so they may do anything the main
+// loop may. A timed feature then needs a TimerId here, but no ISR (or hardware
+// timer) of its own.
+//
+// The timers which are due are found with a timer wheel: a timer is kept on
+// the list of the slot its expiry time hashes to, so each tick only has to
+// look at one short list however many timers are running.
+
+typedef enum {
+  TIMER_JIGGLE,         // mouse.c: the jiggler's next step
+  TIMER_IDLE_KEYBOARD,  // usb.c: the idle-rate reports, in UsbReport order
+  TIMER_IDLE_MOUSE,
+#if USB_MEDIA_KEYS
+  TIMER_IDLE_CONSUMER,
+  TIMER_IDLE_SYSTEM,
+#endif
+#if KEY_REPEAT
+  TIMER_REPEAT,         // usb.c: the held button's next repeat (see KEY_REPEAT)
+#endif
+#if MACRO_ENABLE
+  TIMER_MACRO,          // usb.c: the macro's next step, after its delay
+#endif
+  TIMER_COUNT
+} TimerId;
+
+// Called with the timer which is due, so one callback may serve several
+typedef void (*TimerCallback)(TimerId id);
+
+// Set up the tick (Timer1 must be running already: see irInit()).
+void timerInit(void);
+
+// Start (or restart) a timer, to call the callback after delay ms (at least
+// one), and then every period ms (or just once, if period is 0).
+void timerStart(TimerId id, uint16_t delay, uint16_t period, TimerCallback callback);
+
+// Stop a timer, if it is running.
+void timerStop(TimerId id);
+
+// The time in ms (wrapping), as far as the timers have got.
+uint16_t timerNow(void);
+
+// Call the callbacks of the timers which are due. Called from the main loop
+// whenever WORK_TIMER is flagged.
+void timerPoll(void);
+
+// Choose the tick: the SOF (only call timerSofTick() from the SOF event
+// handler), or Timer1. This may be called from the USB event handlers.
+void timerUseSof(bool sof);
+void timerSofTick(void);
+
+#endif
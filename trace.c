@@ -0,0 +1,104 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <util/atomic.h>
+#include "IrateConfig.h"
+#include "ir.h"
+#include "irproto.h"
+#include "trace.h"
+
+#if TRACE_ENABLE
+
+#define AHEAD IR_TICKS(2000)  // how far ahead of TCNT1 a timestamp may be
+#define BANKS 2               // of the keyboard IN endpoint
+
+// The records of the reports in the keyboard IN endpoint's banks, oldest
+// first. A report which carries no event has a record with no report ID.
+static TraceRecord flight[BANKS];
+static uint8_t flying = 0;
+static uint8_t sequence = 0;
+static volatile uint8_t epoch = 0;  // Timer1 overflows
+
+// Overflow interrupt fires every 32.8ms, extending Timer1 for the trace clock.
+ISR(TIMER1_OVF_vect) {
+  ++epoch;
+}
+
+uint16_t traceTime(const uint16_t ticks) {
+  uint16_t now;
+  uint8_t overflows;
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+    now = TCNT1;
+    overflows = epoch;
+    if ((TIFR1 & _BV(TOV1)) && now < 0x8000) {
+      ++overflows;  // it has overflowed, but the ISR hasn't run yet
+    }
+  }
+  // A timestamp a little ahead may be in the next turn of Timer1; one behind
+  // may be in the last
+  const bool ahead = (uint16_t)(ticks - now) < AHEAD;
+  if (ahead && ticks < now) {
+    ++overflows;
+  } else if (!ahead && ticks > now) {
+    --overflows;
+  }
+  return ((uint16_t)overflows << (16 - TRACE_SHIFT)) | (ticks >> TRACE_SHIFT);
+}
+
+uint16_t traceNow(void) {
+  uint16_t ticks;
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+    ticks = TCNT1;
+  }
+  return traceTime(ticks);
+}
+
+// Called just after Endpoint_ClearIN(), so there's always a bank to account
+// for it.
+void traceSent(const IrEvent* const event) {
+  if (flying == BANKS) {
+    memmove(&flight[0], &flight[1], sizeof(flight) - sizeof(flight[0]));
+    --flying;
+  }
+  TraceRecord* const record = &flight[flying++];
+  if (!event) {
+    record->reportId = 0;
+    return;
+  }
+  record->reportId = TRACE_REPORT_ID;
+  record->sequence = sequence++;
+  record->type = event->type;
+  record->protocol = event->code.protocol;
+  record->command = event->code.command;
+  record->edge = event->traceEdge;
+  record->decided = event->traceDecided;
+  record->queued = event->traceQueued;
+  record->sent = traceNow();
+}
+
+bool traceCollected(const uint8_t busy, TraceRecord* const record) {
+  while (flying > busy) {
+    const bool traced = flight[0].reportId;
+    *record = flight[0];
+    memmove(&flight[0], &flight[1], sizeof(flight) - sizeof(flight[0]));
+    --flying;
+    if (traced) {
+      record->collected = traceNow();
+      return true;
+    }
+  }
+  return false;
+}
+
+void traceReset(void) {
+  flying = 0;
+}
+
+void traceInit(void) {
+  traceReset();
+  TIMSK1 |= _BV(TOIE1);
+}
+
+#endif
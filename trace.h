@@ -0,0 +1,71 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "IrateConfig.h"
+#include "ir.h"
+
+// Latency tracing. Each IR event which changes the keyboard report is stamped
+// at each stage on its way to the host, and once the host has collected the
+// report, the stamps are sent as an input report on the vendor interface's IN
+// endpoint (see host/irtrace.c). The stages are:
+//
+//   edge:      a press: the first edge of the frame it was decoded from (the
+//              first of the frames which confirmed it, if it needed more than
+//              one); a release: the last edge before it.
+//   decided:   the edge or timeout which completed the frame (or release).
+//   queued:    irPoll() queued the event for the USB side.
+//   sent:      the report carrying it was handed to the USB controller.
+//   collected: the host took the report from the endpoint, as far as the main
+//              loop can tell; it only looks every SOF, so up to 1ms late.
+//
+// They are all read from the same clock: Timer1, extended by counting its
+// overflows, in units of TRACE_TICKS Timer1 ticks. Being 16 bits, it wraps
+// every 524ms, so any stage longer than that (e.g if the host isn't polling)
+// comes out short. Records are dropped if the host isn't reading them as fast
+// as they come, which shows as a gap in their sequence numbers.
+//
+// With TRACE_ENABLE off, none of this is built in.
+
+#define TRACE_REPORT_ID 3   // input report on the vendor interface
+#define TRACE_SHIFT     4
+#define TRACE_TICKS     (1 << TRACE_SHIFT)  // 8us
+
+typedef struct {
+  uint8_t  reportId;   // TRACE_REPORT_ID
+  uint8_t  sequence;   // one more than the last record's
+  uint8_t  type;       // IrEventType
+  uint8_t  protocol;   // the event's IrCode, but for its address
+  uint8_t  command;
+  uint16_t edge;
+  uint16_t decided;
+  uint16_t queued;
+  uint16_t sent;
+  uint16_t collected;
+} __attribute__((packed)) TraceRecord;
+
+#if TRACE_ENABLE
+// Start counting Timer1's overflows (Timer1 must be running already: see
+// irInit()).
+void traceInit(void);
+
+// The trace clock now, and at a Timer1 time which is in the last 30ms (or at
+// most a few ms ahead).
+uint16_t traceNow(void);
+uint16_t traceTime(uint16_t ticks);
+
+// Forget the reports in the keyboard IN endpoint's banks (which have just
+// been reconfigured, and emptied).
+void traceReset(void);
+
+// A report has been handed to the keyboard IN endpoint, carrying the given
+// event, or none (an idle-rate report).
+void traceSent(const IrEvent* event);
+
+// Given the number of the keyboard IN endpoint's banks still waiting for the
+// host, take the record of a report which it has collected since, if any.
+bool traceCollected(uint8_t busy, TraceRecord* record);
+#endif
+
+#endif
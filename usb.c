@@ -1,56 +1,438 @@
+#include <avr/pgmspace.h>
 #include <LUFA/Drivers/USB/USB.h>
 #include "usb.h"
+#include "capture.h"
 #include "desc.h"
 #include "ir.h"
+#include "irproto.h"
+#include "keymap.h"
 #include "mouse.h"
+#include "profile.h"
+#include "sched.h"
+#include "timer.h"
+#include "trace.h"
 
-static bool usingReportProtocol = true;
-static uint16_t idleInit = 500;
-static uint16_t idleRemaining = 0;
-
-typedef enum {
-  BC_ON_OFF         = 0x5422,
-  BC_UP_ARROW       = 0x2426,
-  BC_MENU           = 0x4426,
-  BC_DOWN_ARROW     = 0x6426,
-  BC_ENTER          = 0x0426,
-  BC_PLAY_PAUSE     = 0x6626,
-  BC_PREVIOUS_TRACK = 0x0626,
-  BC_NEXT_TRACK     = 0x4626,
-  BC_VOLUME_UP      = 0x2422,
-  BC_SOUND          = 0x0622,
-  BC_VOLUME_DOWN    = 0x6422
-} ButtonCode;
-
-// Create keyboard report based on the detected state of the IR buttons. Several
-// buttons (e.g BC_VOLUME_*) are not reported because they are interpreted
-// directly by the soundbar (i.e the computer doesn't need to do anything).
+static bool reportProtocol[ifMouse + 1];  // of the keyboard and mouse interfaces
+static IrCode heldCode;              // the IR button held, as far as the host knows
+static bool heldKeys = false;        // ...and whether it sends any keys
+static uint8_t heldButtons = 0;      // ...or else any mouse buttons (MOUSE_*)
+static int8_t heldMoveX = 0;         // ...and pointer movement per mouse report
+static int8_t heldMoveY = 0;
+#if USB_MEDIA_KEYS
+static uint16_t heldUsage = 0;       // ...and any consumer or system usage
+static bool consumerDirty = false;   // the consumer report changed since it was sent
+static bool systemDirty = false;     // ...and the system control report
+#endif
+static bool keyboardDirty = false;   // the keyboard report changed since it was sent
+#if PROFILE_ENABLE || TRACE_ENABLE
+static IrEvent dirtyEvent;           // ...by this IR event
+#endif
+#if STATS_ENABLE
+static UsbStats stats;
+#endif
+#if USB_FAST_ALT
+static uint8_t altSetting[ifMouse + 1];  // of the keyboard and mouse interfaces
+#endif
+#if KEY_REPEAT
+static RepeatCurve repeatCurve;      // the held button's, if its keys repeat
+static uint16_t repeatInterval;      // ...the time from its next press to the repeat after
+static bool repeatDue = false;       // ...whether a repeat's release is due
+static bool repeatUp = false;        // ...and whether its keys are released for one
+#endif
+#if MACRO_ENABLE
+static const MacroStep* macroNext;   // the macro being sent's next step (in flash)
+static uint8_t macroLeft = 0;        // ...the number of steps still to send
+static bool macroDue = false;        // ...whether the next one's delay is over
+static uint8_t macroModifier = 0;    // ...and the keys it's holding
+static uint8_t macroKey = 0;
+#endif
+#if SUSPEND_ENABLE
+static volatile bool wakeSignalled = false;  // remote wakeup has been signalled since suspend
+#endif
+
+// Each input report's idle rate: how long it may go unsent when its data
+// doesn't change, after which it's sent again anyway (HID 1.11, 7.2.4). This
+// is the same in the boot and report protocols. Each report's timer is
+// TIMER_IDLE_KEYBOARD plus its UsbReport.
+typedef struct {
+  uint16_t rate;      // ms (a multiple of 4), or zero for indefinitely
+  uint16_t sentAt;    // timerNow() when it was last sent
+  bool     due;       // its idle period is up
+} Idle;
+
+static Idle idle[USB_NUM_REPORTS];
+
+// ...and which report it is, which doesn't change, so is kept in flash
+typedef struct {
+  uint8_t interface;
+  uint8_t reportId;   // or zero, when the interface has no report IDs
+} IdleReport;
+
+#if USB_MEDIA_KEYS
+static const IdleReport idleReports[USB_NUM_REPORTS] PROGMEM = {
+  [USB_REPORT_KEYBOARD] = {ifKeyboard, 0},
+  [USB_REPORT_MOUSE]    = {ifMouse,    MOUSE_REPORT_ID},
+  [USB_REPORT_CONSUMER] = {ifMouse,    CONSUMER_REPORT_ID},
+  [USB_REPORT_SYSTEM]   = {ifMouse,    SYSTEM_REPORT_ID}
+};
+#else
+static const IdleReport idleReports[USB_NUM_REPORTS] PROGMEM = {
+  [USB_REPORT_KEYBOARD] = {ifKeyboard, 0},
+  [USB_REPORT_MOUSE]    = {ifMouse,    0}
+};
+#endif
+
+// The boot keyboard's default is 500ms, and the others' is indefinite
+#define IDLE_DEFAULT(r) ((r) == USB_REPORT_KEYBOARD ? 500 : 0)
+
+// How much agreement each button-code needs from the frames after it, before
+// it is pressed (see IrateConfig.h and IrateKeymap.h).
+uint8_t irConfirmMode(const IrCode* const code) {
+  KeymapEntry entry;
+  return keymapLookup(code, &entry) ? entry.confirm : CONFIRM_UNKNOWN;
+}
+
+// Which remotes' frames to act on (see IRATE_ROUTES in IrateKeymap.h)
+bool irWanted(const IrCode* const code) {
+  return keymapRoute(code) != ROUTE_IGNORE;
+}
+
+// Whether the host has been sent the held IR button's keys (rather than the
+// release of a repeat, or nothing).
+static inline bool keysDown(void) {
+#if KEY_REPEAT
+  return heldKeys && !repeatUp;
+#else
+  return heldKeys;
+#endif
+}
+
+#if KEY_REPEAT
+// Timer callback, when the held button's next repeat is due.
+static void repeatExpired(const TimerId id) {
+  (void)id;
+  repeatDue = true;
+  schedPost(WORK_USB);
+}
+
+// Called when the keyboard report isn't dirty: make it so, if a repeat is due.
+// Its release goes as soon as there's a bank free, and its press straight
+// after, so each has a poll of its own; the next repeat is timed from there.
+static bool repeatStep(void) {
+  if (repeatUp) {
+    repeatUp = false;
+    timerStart(TIMER_REPEAT, repeatInterval, 0, repeatExpired);
+    repeatInterval = repeatInterval > repeatCurve.last + repeatCurve.step ?
+      repeatInterval - repeatCurve.step : repeatCurve.last;
+    return true;
+  }
+  if (repeatDue) {
+    repeatDue = false;
+    repeatUp = true;
+    return true;
+  }
+  return false;
+}
+#endif
+
+#if MACRO_ENABLE
+// Whether a macro is being sent: it has steps left, or keys to release. The
+// keyboard report is then the macro's, rather than the held button's.
+static inline bool macroRunning(void) {
+  return macroLeft || macroModifier || macroKey;
+}
+
+// Whether IR events must wait for the macro to finish (see MACRO_OVERFLOW)
+static inline bool macroBusy(void) {
+  return MACRO_OVERFLOW == MACRO_OVERFLOW_QUEUE && macroRunning();
+}
+
+// Timer callback, when the macro's next step is due.
+static void macroExpired(const TimerId id) {
+  (void)id;
+  macroDue = true;
+  schedPost(WORK_USB);
+}
+
+// Time the macro's next step; the release after the last is due at once.
+static void macroArm(void) {
+  const uint8_t delay = macroLeft ? pgm_read_byte(&macroNext->delay) : 0;
+  macroDue = !delay;
+  if (delay) {
+    timerStart(TIMER_MACRO, delay, 0, macroExpired);
+  }
+}
+
+// Make the keyboard report dirty with the macro's next step, if it's due. A
+// step which changes nothing (e.g a wait) just takes its delay.
+static bool macroStep(void) {
+  while (macroRunning() && macroDue) {
+    uint8_t modifier = 0;
+    uint8_t key = 0;
+    if (macroLeft) {
+      modifier = pgm_read_byte(&macroNext->modifier);
+      key = pgm_read_byte(&macroNext->key);
+      ++macroNext;
+      --macroLeft;
+    }
+    const bool changed = modifier != macroModifier || key != macroKey;
+    macroModifier = modifier;
+    macroKey = key;
+    macroArm();
+    if (changed) {
+      return true;
+    }
+  }
+  return false;
+}
+#else
+static inline bool macroBusy(void) {
+  return false;
+}
+#endif
+
+// Called when the keyboard report isn't dirty: whether it changes without an IR
+// event, with a macro's next step or a repeat.
+static bool keyboardStep(void) {
+#if MACRO_ENABLE
+  if (macroStep()) {
+    return true;
+  }
+#endif
+#if KEY_REPEAT
+  if (repeatStep()) {
+    return true;
+  }
+#endif
+  return false;
+}
+
+// Update the held IR button from a press or release event. The keyboard report
+// only depends on which button is held, if it sends any keys, so it's dirty
+// just when that changes; e.g a press of a button which sends nothing leaves
+// it alone. A button routed to the mouse sends no keys, but its buttons and
+// movement go into each mouse report while it's held. The consumer and system
+// control reports are likewise dirty just when their usages change, and only
+// in the report protocol. A button with a repeat curve starts repeating from
+// its press (see KEY_REPEAT), and any other event stops it. A button with a
+// macro sends no keys, but starts the macro, whose first step goes in the same
+// report; with MACRO_OVERFLOW_CANCEL, a press while one is being sent ends it.
+static void applyEvent(const IrEvent* const event) {
+  KeymapEntry entry;
+  IrCode code = event->code;
+  if (event->type != IR_EVENT_PRESS) {
+    code.protocol = IR_PROTO_NONE;
+  }
+  const bool found = code.protocol != IR_PROTO_NONE && keymapLookup(&code, &entry);
+  const uint8_t route = found ? keymapRoute(&code) : ROUTE_IGNORE;
+#if MACRO_ENABLE
+  Macro macro;
+  const bool macroed = route == ROUTE_KEYBOARD && keymapMacro(entry.macro, &macro);
+#else
+  const bool macroed = false;
+#endif
+  const bool keys = route == ROUTE_KEYBOARD && !macroed && (entry.modifier || entry.keys[0]);
+#if USB_MEDIA_KEYS
+  const uint16_t usage =
+    ((route == ROUTE_KEYBOARD || route == ROUTE_CONSUMER) && reportProtocol[ifMouse]) ? entry.consumer : 0;
+  const uint16_t system = usage & KEYMAP_SYSTEM;
+  const uint16_t wasSystem = heldUsage & KEYMAP_SYSTEM;
+  if ((system ? 0 : usage) != (wasSystem ? 0 : heldUsage)) {
+    consumerDirty = true;
+  }
+  if ((system ? usage : 0) != (wasSystem ? heldUsage : 0)) {
+    systemDirty = true;
+  }
+  heldUsage = usage;
+#endif
+  bool changed = keys != keysDown() || (keys && (
+    code.protocol != heldCode.protocol || code.address != heldCode.address ||
+    code.command != heldCode.command
+  ));
+  heldCode = code;
+  heldKeys = keys;
+#if MACRO_ENABLE
+  if (event->type == IR_EVENT_PRESS && macroRunning()) {
+    changed = changed || macroModifier || macroKey;
+    macroLeft = macroModifier = macroKey = 0;
+    timerStop(TIMER_MACRO);
+  }
+  if (macroed) {
+    macroNext = macro.steps;
+    macroLeft = macro.count;
+    macroArm();
+    changed = macroStep() || changed;
+  }
+#endif
+  if (changed) {
+    keyboardDirty = true;
+#if PROFILE_ENABLE || TRACE_ENABLE
+    dirtyEvent = *event;
+#endif
+  }
+#if KEY_REPEAT
+  repeatDue = repeatUp = false;
+  if (keys && keymapRepeat(entry.repeat, &repeatCurve)) {
+    repeatInterval = repeatCurve.first;
+    timerStart(TIMER_REPEAT, repeatCurve.delay, 0, repeatExpired);
+  } else {
+    timerStop(TIMER_REPEAT);
+  }
+#endif
+  const bool mouse = route == ROUTE_MOUSE;
+  heldButtons = mouse ? entry.modifier : 0;
+  heldMoveX = mouse ? (int8_t)entry.keys[0] : 0;
+  heldMoveY = mouse ? (int8_t)entry.keys[1] : 0;
+}
+
+// Timer callback, when a report's idle period is up.
+static void idleExpired(const TimerId id) {
+  idle[id - TIMER_IDLE_KEYBOARD].due = true;
+  schedPost(WORK_USB);
+}
+
+// Time the report's idle period, elapsed ms of which have gone already.
+static void idleArm(const uint8_t r, const uint16_t elapsed) {
+  const uint16_t rate = idle[r].rate;
+  const TimerId timer = TIMER_IDLE_KEYBOARD + r;
+  if (rate) {
+    timerStart(timer, elapsed < rate ? rate - elapsed : 1, 0, idleExpired);
+  } else {
+    timerStop(timer);
+  }
+}
+
+// Whether the report is the one (or one of those) a SET_IDLE or GET_IDLE
+// request names: report ID zero means all of the interface's reports.
+static bool idleMatches(const uint8_t r, const uint16_t interface, const uint8_t reportId) {
+  return
+    pgm_read_byte(&idleReports[r].interface) == interface &&
+    (reportId == 0 || pgm_read_byte(&idleReports[r].reportId) == reportId);
+}
+
+// A report has been sent (because it changed, or not): start its next period.
+static void reportSent(const uint8_t r, const bool changed) {
+#if STATS_ENABLE
+  uint16_t* const count = changed ? &stats.changed[r] : &stats.idle[r];
+  if (*count != 0xFFFF) {
+    ++*count;
+  }
+#else
+  (void)changed;
+#endif
+  idle[r].sentAt = timerNow();
+  idle[r].due = false;
+  idleArm(r, 0);
+}
+
+// HID_REQ_SetIdle, for the reports idleMatches(). A new rate applies as if it were set when the report was last sent, unless the
+// current period ends within 4ms, in which case it starts with the next one.
+// Returns false if there's no such report.
+static bool setIdle(const uint16_t interface, const uint8_t reportId, const uint16_t rate) {
+  bool found = false;
+  for (uint8_t r = 0; r < USB_NUM_REPORTS; ++r) {
+    Idle* const report = &idle[r];
+    if (idleMatches(r, interface, reportId)) {
+      const uint16_t elapsed = timerNow() - report->sentAt;
+      const bool ending = report->rate && elapsed < report->rate && report->rate - elapsed < 4;
+      report->rate = rate;
+      if (!ending) {
+        idleArm(r, elapsed);
+      }
+      found = true;
+    }
+  }
+  return found;
+}
+
+// HID_REQ_GetIdle: the rate, or -1 if there's no such report.
+static int16_t getIdle(const uint16_t interface, const uint8_t reportId) {
+  for (uint8_t r = 0; r < USB_NUM_REPORTS; ++r) {
+    if (idleMatches(r, interface, reportId)) {
+      return idle[r].rate;
+    }
+  }
+  return -1;
+}
+
+#if STATS_ENABLE
+void usbGetStats(UsbStats* const result) {
+  *result = stats;
+}
+#endif
+
+// Create keyboard report based on the detected state of the IR buttons, from
+// the keymap (see IrateKeymap.h).
 //
 static void createKeyboardReport(USB_KeyboardReport_Data_t* const reportData) {
-  const uint16_t state = irGetState();  // get current button-code
-  if (state == BC_PLAY_PAUSE) {
-    reportData->KeyCode[0] = HID_KEYBOARD_SC_SPACE;
-  } else if (state == BC_PREVIOUS_TRACK) {
-    reportData->Modifier = HID_KEYBOARD_MODIFIER_LEFTSHIFT;
-    reportData->KeyCode[0] = HID_KEYBOARD_SC_LEFT_ARROW;
-  } else if (state == BC_NEXT_TRACK) {
-    reportData->Modifier = HID_KEYBOARD_MODIFIER_LEFTSHIFT;
-    reportData->KeyCode[0] = HID_KEYBOARD_SC_RIGHT_ARROW;
-  } else if (state == BC_UP_ARROW) {
-    reportData->KeyCode[0] = HID_KEYBOARD_SC_UP_ARROW;
-  } else if (state == BC_DOWN_ARROW) {
-    reportData->KeyCode[0] = HID_KEYBOARD_SC_DOWN_ARROW;
-  } else if (state == BC_ENTER) {
-    reportData->KeyCode[0] = HID_KEYBOARD_SC_ENTER;
-  } else if (state == BC_MENU) {
-    reportData->Modifier = HID_KEYBOARD_MODIFIER_LEFTSHIFT;
-    reportData->KeyCode[0] = HID_KEYBOARD_SC_M;
+#if MACRO_ENABLE
+  if (macroRunning()) {
+    reportData->Modifier = macroModifier;
+    reportData->KeyCode[0] = macroKey;
+    return;
+  }
+#endif
+  KeymapEntry entry;
+  if (!keysDown() || !keymapLookup(&heldCode, &entry)) {
+    return;
   }
+  reportData->Modifier = entry.modifier;
+  memcpy(reportData->KeyCode, entry.keys, sizeof(reportData->KeyCode));
 }
 
+// Write the keyboard report for the held IR button (or the macro being sent)
+// straight into the endpoint's bank.
+static void writeKeyboardReport(void) {
+#if MACRO_ENABLE
+  if (macroRunning()) {
+    Endpoint_Write_8(macroModifier);
+    Endpoint_Write_8(0);  // reserved
+    Endpoint_Write_8(macroKey);
+    for (uint8_t i = 1; i < KEYMAP_KEYS; ++i) {
+      Endpoint_Write_8(0);
+    }
+    return;
+  }
+#endif
+  KeymapEntry entry;
+  const bool keys = keysDown() && keymapLookup(&heldCode, &entry);
+  Endpoint_Write_8(keys ? entry.modifier : 0);
+  Endpoint_Write_8(0);  // reserved
+  for (uint8_t i = 0; i < KEYMAP_KEYS; ++i) {
+    Endpoint_Write_8(keys ? entry.keys[i] : 0);
+  }
+}
+
+#if USB_MEDIA_KEYS
+// Create the consumer or system control report (with its report ID) for the
+// held IR button, returning its length.
+static uint8_t createMediaReport(const uint8_t r, uint8_t* const reportData) {
+  const bool system = heldUsage & KEYMAP_SYSTEM;
+  if (r == USB_REPORT_CONSUMER) {
+    const uint16_t usage = system ? 0 : heldUsage;
+    reportData[0] = CONSUMER_REPORT_ID;
+    reportData[1] = usage & 0xFF;
+    reportData[2] = usage >> 8;
+    return 3;
+  }
+  reportData[0] = SYSTEM_REPORT_ID;
+  reportData[1] = system ? (heldUsage & 0xFF) - 0x80 : 0;
+  return 2;
+}
+
+// Whether a media report is waiting to go out, so IR events must wait too
+static inline bool mediaDirty(void) {
+  return consumerDirty || systemDirty;
+}
+#else
+static inline bool mediaDirty(void) {
+  return false;
+}
+#endif
+
 // Create mouse report based on the state of the Minimus's single button, and a
 // timer which moves the mouse-pointer in a slow 16x16-pixel square, moving one
-// pixel every six seconds.
+// pixel every six seconds; plus the IR button held, if it's routed to the mouse.
 //
 static void createMouseReport(USB_MouseReport_Data_t* const reportData) {
   if (mouseIsReportDue()) {
@@ -70,48 +452,118 @@ static void createMouseReport(USB_MouseReport_Data_t* const reportData) {
   if (mouseIsButtonPressed()) {
     reportData->Button = (1<<0);
   }
+  reportData->Button |= heldButtons;
+  reportData->X += heldMoveX;
+  reportData->Y += heldMoveY;
 }
 
-// Called repeatedly from the main loop. This constructs the reports and decides
-// whether to send them or not.
+// Called from the main loop whenever WORK_USB is flagged: on every SOF, and
+// when there's a new IR event or jiggler step. This constructs the reports and
+// decides whether to send them or not.
 //
 void usbSendReceive(void) {
   if (USB_DeviceState == DEVICE_STATE_Configured) {
-    static USB_KeyboardReport_Data_t prevKeyboardReport = {0,};
     static uint8_t prevButtonState = 0;
-    USB_KeyboardReport_Data_t thisKeyboardReport = {0,};
-    USB_MouseReport_Data_t    thisMouseReport    = {0,};
-    const bool timeout = (idleInit != 0 && idleRemaining == 0);
+    USB_MouseReport_Data_t thisMouseReport = {0,};
 
-    // Maybe reset timer
-    if (timeout) {
-      idleRemaining = idleInit;
+#if TRACE_ENABLE
+    // Stream the trace record (see trace.h) of each keyboard report the host
+    // has collected since the last time. If the host isn't reading them, the
+    // vendor endpoint's banks fill up, and the records are dropped.
+    TraceRecord record;
+    Endpoint_SelectEndpoint(KEYBOARD_IN_EPADDR);
+    while (traceCollected(Endpoint_GetBusyBanks(), &record)) {
+      Endpoint_SelectEndpoint(VENDOR_IN_EPADDR);
+      if (Endpoint_IsReadWriteAllowed()) {
+        Endpoint_Write_Stream_LE(&record, sizeof(record), NULL);
+        Endpoint_ClearIN();
+      }
+      Endpoint_SelectEndpoint(KEYBOARD_IN_EPADDR);
     }
-    
-    // Construct keypress report, and figure out whether to send it
-    createKeyboardReport(&thisKeyboardReport);
-    const bool reportDiff = memcmp(
-      &prevKeyboardReport, &thisKeyboardReport,
-      sizeof(USB_KeyboardReport_Data_t)
-    );
+#endif
+
+    // Figure out whether to send a keypress report. IR events are only taken
+    // when a bank of the endpoint is free for a report, and only until one
+    // changes the report, so every press and every release is sent to the host
+    // exactly once, however long it is between polls. The endpoint is double-
+    // banked, so a press and its release can both be queued for consecutive
+    // polls. A macro's steps after the first, and a repeat's release and press
+    // (which no IR edge caused, so they aren't profiled or traced), go out when
+    // there are no events waiting; with MACRO_OVERFLOW_QUEUE, events wait for
+    // the macro instead.
     Endpoint_SelectEndpoint(KEYBOARD_IN_EPADDR);
-    if (Endpoint_IsReadWriteAllowed() && (timeout || reportDiff)) {
-      prevKeyboardReport = thisKeyboardReport;
-      Endpoint_Write_Stream_LE(&thisKeyboardReport, sizeof(thisKeyboardReport), NULL);
+    while (Endpoint_IsReadWriteAllowed()) {
+      IrEvent event;
+      while (!keyboardDirty && !mediaDirty() && !macroBusy() && irGetEvent(&event)) {
+        applyEvent(&event);
+      }
+      const bool edge = keyboardDirty;
+      if (!keyboardDirty && !mediaDirty() && keyboardStep()) {
+        keyboardDirty = true;
+      }
+      if (!keyboardDirty && !idle[USB_REPORT_KEYBOARD].due) {
+        break;
+      }
+      writeKeyboardReport();
       Endpoint_ClearIN();
+      if (edge) {
+        PROFILE_LATENCY(dirtyEvent.ticks);
+      }
+#if TRACE_ENABLE
+      traceSent(edge ? &dirtyEvent : NULL);
+#endif
+      reportSent(USB_REPORT_KEYBOARD, keyboardDirty);
+      keyboardDirty = false;
     }
 
-    // Construct mouse report, and figure out whether to send it
+    // Send the consumer and system control reports which have changed (or
+    // whose idle periods are up) on the mouse endpoint, ahead of the mouse
+    // report. In the boot protocol there are none.
     Endpoint_SelectEndpoint(MOUSE_IN_EPADDR);
+#if USB_MEDIA_KEYS
+    for (uint8_t r = USB_REPORT_CONSUMER; r <= USB_REPORT_SYSTEM; ++r) {
+      bool* const dirty = (r == USB_REPORT_CONSUMER) ? &consumerDirty : &systemDirty;
+      if (!reportProtocol[ifMouse]) {
+        *dirty = false;
+      } else if ((*dirty || idle[r].due) && Endpoint_IsReadWriteAllowed()) {
+        uint8_t reportData[3];
+        Endpoint_Write_Stream_LE(reportData, createMediaReport(r, reportData), NULL);
+        Endpoint_ClearIN();
+        reportSent(r, *dirty);
+        *dirty = false;
+      }
+    }
+#endif
+
+    // Construct mouse report, and figure out whether to send it. When it's
+    // sent for the idle rate, it has the button state but no movement.
     if (Endpoint_IsReadWriteAllowed()) {
       createMouseReport(&thisMouseReport);
-      if (thisMouseReport.X || thisMouseReport.Y || thisMouseReport.Button != prevButtonState) {
+      const bool reportDiff = thisMouseReport.X || thisMouseReport.Y || thisMouseReport.Button != prevButtonState;
+      if (reportDiff || idle[USB_REPORT_MOUSE].due) {
         prevButtonState = thisMouseReport.Button;
+#if USB_MEDIA_KEYS
+        if (reportProtocol[ifMouse]) {
+          Endpoint_Write_8(MOUSE_REPORT_ID);
+        }
+#endif
         Endpoint_Write_Stream_LE(&thisMouseReport, sizeof(thisMouseReport), NULL);
         Endpoint_ClearIN();
+        reportSent(USB_REPORT_MOUSE, reportDiff);
       }
     }
     
+#if CAPTURE_ENABLE
+    // Send the edges captured so far, if capture is on
+    const CapturePacket* const packet = capturePending();
+    Endpoint_SelectEndpoint(VENDOR_IN_EPADDR);
+    if (packet && Endpoint_IsReadWriteAllowed()) {
+      Endpoint_Write_Stream_LE(packet, sizeof(*packet), NULL);
+      Endpoint_ClearIN();
+      captureSent();
+    }
+#endif
+
     // Discard any LED report from the host
     Endpoint_SelectEndpoint(KEYBOARD_OUT_EPADDR);
     if (Endpoint_IsOUTReceived()) {
@@ -121,28 +573,131 @@ void usbSendReceive(void) {
       }
       Endpoint_ClearOUT();
     }
+#if SUSPEND_ENABLE
+  } else if (USB_DeviceState == DEVICE_STATE_Suspended) {
+    // A button decoded while the host sleeps wakes it, if it has allowed that.
+    // The event stays queued, to be sent once the host has resumed the bus.
+    if (!wakeSignalled && USB_Device_RemoteWakeupEnabled && irEventPending()) {
+      wakeSignalled = true;
+      USB_Device_SendRemoteWakeup();
+    }
+#endif
   }
 }
 
 void EVENT_USB_Device_Connect(void) {
-  usingReportProtocol = true;
+  reportProtocol[ifKeyboard] = reportProtocol[ifMouse] = true;
+  for (uint8_t r = 0; r < USB_NUM_REPORTS; ++r) {
+    idle[r].rate = IDLE_DEFAULT(r);
+    idle[r].due = false;
+  }
+#if STATS_ENABLE
+  memset(&stats, 0, sizeof(stats));
+#endif
 }
 
 void EVENT_USB_Device_ConfigurationChanged(void) {
-  Endpoint_ConfigureEndpoint(KEYBOARD_IN_EPADDR,  EP_TYPE_INTERRUPT, HID_EPSIZE, 1);
+  // The IN endpoints are double-banked, so a report can be queued while the
+  // last one is waiting for the host to poll
+  Endpoint_ConfigureEndpoint(KEYBOARD_IN_EPADDR,  EP_TYPE_INTERRUPT, HID_EPSIZE, 2);
   Endpoint_ConfigureEndpoint(KEYBOARD_OUT_EPADDR, EP_TYPE_INTERRUPT, HID_EPSIZE, 1);
-  Endpoint_ConfigureEndpoint(MOUSE_IN_EPADDR,     EP_TYPE_INTERRUPT, HID_EPSIZE, 1);
+  Endpoint_ConfigureEndpoint(MOUSE_IN_EPADDR,     EP_TYPE_INTERRUPT, HID_EPSIZE, 2);
+#if VENDOR_INTERFACE
+  Endpoint_ConfigureEndpoint(VENDOR_IN_EPADDR,    EP_TYPE_INTERRUPT, VENDOR_EPSIZE, 2);
+#endif
   USB_Device_EnableSOFEvents();
+  timerUseSof(true);
+#if TRACE_ENABLE
+  traceReset();
+#endif
+#if USB_FAST_ALT
+  memset(altSetting, 0, sizeof(altSetting));
+#endif
+  for (uint8_t r = 0; r < USB_NUM_REPORTS; ++r) {
+    idle[r].sentAt = timerNow();
+    idleArm(r, 0);
+  }
+}
+
+// Without SOFs, the timers are ticked by Timer1 instead
+void EVENT_USB_Device_Disconnect(void) {
+  timerUseSof(false);
+}
+
+void EVENT_USB_Device_Reset(void) {
+  timerUseSof(false);
 }
 
+#if SUSPEND_ENABLE
+// With no SOFs while suspended, the timers stop (and the CPU can power down)
+void EVENT_USB_Device_Suspend(void) {
+  timerUseSof(true);
+  wakeSignalled = false;
+}
+#else
+void EVENT_USB_Device_Suspend(void) {
+  timerUseSof(false);
+}
+#endif
+
+void EVENT_USB_Device_WakeUp(void) {
+  timerUseSof(USB_DeviceState == DEVICE_STATE_Configured);
+}
+
+#if USB_FAST_ALT
+// SET_INTERFACE and GET_INTERFACE, which select between the keyboard's and the
+// mouse's alternate settings (see USB_FAST_ALT). They only differ in how often
+// the host polls, so nothing changes here but the endpoints' data toggles.
+static void interfaceRequest(void) {
+  const uint16_t interface = USB_ControlRequest.wIndex;
+  if (interface > ifMouse) {
+    return;
+  }
+  if (
+    USB_ControlRequest.bRequest == REQ_SetInterface && USB_ControlRequest.wValue <= 1 &&
+    USB_ControlRequest.bmRequestType == (REQDIR_HOSTTODEVICE | REQTYPE_STANDARD | REQREC_INTERFACE))
+  {
+    altSetting[interface] = USB_ControlRequest.wValue;
+    if (interface == ifKeyboard) {
+      Endpoint_SelectEndpoint(KEYBOARD_IN_EPADDR);
+      Endpoint_ResetDataToggle();
+      Endpoint_SelectEndpoint(KEYBOARD_OUT_EPADDR);
+      Endpoint_ResetDataToggle();
+    } else {
+      Endpoint_SelectEndpoint(MOUSE_IN_EPADDR);
+      Endpoint_ResetDataToggle();
+    }
+    Endpoint_SelectEndpoint(ENDPOINT_CONTROLEP);
+    Endpoint_ClearSETUP();
+    Endpoint_ClearStatusStage();
+  } else if (
+    USB_ControlRequest.bRequest == REQ_GetInterface &&
+    USB_ControlRequest.bmRequestType == (REQDIR_DEVICETOHOST | REQTYPE_STANDARD | REQREC_INTERFACE))
+  {
+    Endpoint_ClearSETUP();
+    Endpoint_Write_8(altSetting[interface]);
+    Endpoint_ClearIN();
+    Endpoint_ClearStatusStage();
+  }
+}
+#endif
+
 void EVENT_USB_Device_ControlRequest(void) {
+#if USB_FAST_ALT
+  // Standard requests to an interface; their request codes overlap the HID
+  // class requests below
+  if ((USB_ControlRequest.bmRequestType & ~REQDIR_DEVICETOHOST) == (REQTYPE_STANDARD | REQREC_INTERFACE)) {
+    interfaceRequest();
+    return;
+  }
+#endif
   switch (USB_ControlRequest.bRequest) {
   case HID_REQ_GetReport:
     if (USB_ControlRequest.bmRequestType == (REQDIR_DEVICETOHOST | REQTYPE_CLASS | REQREC_INTERFACE))
     {
       switch (USB_ControlRequest.wIndex) {
         case ifKeyboard: {
-          USB_KeyboardReport_Data_t reportData;
+          USB_KeyboardReport_Data_t reportData = {0,};
           createKeyboardReport(&reportData);
           Endpoint_ClearSETUP();
           Endpoint_Write_Control_Stream_LE(&reportData, sizeof(reportData));
@@ -151,13 +706,66 @@ void EVENT_USB_Device_ControlRequest(void) {
         }
 
         case ifMouse: {
-          USB_MouseReport_Data_t reportData;
+#if USB_MEDIA_KEYS
+          // wValue's low byte is the report ID
+          const uint8_t reportId = USB_ControlRequest.wValue & 0xFF;
+          if (reportId == CONSUMER_REPORT_ID || reportId == SYSTEM_REPORT_ID) {
+            uint8_t reportData[3];
+            const uint8_t length =
+              createMediaReport(reportId == CONSUMER_REPORT_ID ? USB_REPORT_CONSUMER : USB_REPORT_SYSTEM, reportData);
+            Endpoint_ClearSETUP();
+            Endpoint_Write_Control_Stream_LE(reportData, length);
+            Endpoint_ClearOUT();
+            break;
+          }
+#endif
+          USB_MouseReport_Data_t reportData = {0,};
           createMouseReport(&reportData);
           Endpoint_ClearSETUP();
+#if USB_MEDIA_KEYS
+          if (reportProtocol[ifMouse]) {
+            Endpoint_Write_8(MOUSE_REPORT_ID);
+          }
+#endif
           Endpoint_Write_Control_Stream_LE(&reportData, sizeof(reportData));
           Endpoint_ClearOUT();
           break;
         }
+
+#if VENDOR_INTERFACE
+        case ifVendor:
+#if PROFILE_ENABLE
+          if (USB_ControlRequest.wValue == FEATURE_REPORT(PROFILE_REPORT_ID)) {
+            ProfileReport* const report = profileFreeze();
+            report->usb = stats;
+            for (uint8_t i = 0; i < IRPROTO_COUNT; ++i) {
+              irprotoTiming(i, &report->timing[i]);
+            }
+            Endpoint_ClearSETUP();
+            Endpoint_Write_Control_Stream_LE(report, sizeof(ProfileReport));
+            Endpoint_ClearOUT();
+          }
+#endif
+#if KEYMAP_CAPACITY
+          if (USB_ControlRequest.wValue == FEATURE_REPORT(KEYMAP_REPORT_ID)) {
+            KeymapReport reportData;
+            keymapGetReport(&reportData);
+            Endpoint_ClearSETUP();
+            Endpoint_Write_Control_Stream_LE(&reportData, sizeof(reportData));
+            Endpoint_ClearOUT();
+          }
+#endif
+#if CAPTURE_ENABLE
+          if (USB_ControlRequest.wValue == FEATURE_REPORT(CAPTURE_REPORT_ID)) {
+            CaptureControl reportData;
+            captureGetReport(&reportData);
+            Endpoint_ClearSETUP();
+            Endpoint_Write_Control_Stream_LE(&reportData, sizeof(reportData));
+            Endpoint_ClearOUT();
+          }
+#endif
+          break;
+#endif
       }
     }
     break;
@@ -165,7 +773,58 @@ void EVENT_USB_Device_ControlRequest(void) {
   case HID_REQ_SetReport:
     if (USB_ControlRequest.bmRequestType == (REQDIR_HOSTTODEVICE | REQTYPE_CLASS | REQREC_INTERFACE))
     {
+#if KEYMAP_CAPACITY
+      // A step of a keymap update. While the last one is still being written,
+      // the request is left unhandled, so LUFA stalls it.
+      if (USB_ControlRequest.wIndex == ifVendor && USB_ControlRequest.wValue == FEATURE_REPORT(KEYMAP_REPORT_ID)) {
+        KeymapReport reportData;
+        if (keymapBusy() || USB_ControlRequest.wLength != sizeof(reportData)) {
+          break;
+        }
+        Endpoint_ClearSETUP();
+        Endpoint_Read_Control_Stream_LE(&reportData, sizeof(reportData));
+        Endpoint_ClearIN();
+        keymapSetReport(&reportData);
+        break;
+      }
+#endif
+#if CAPTURE_ENABLE
+      // Switch raw edge capture on or off
+      if (USB_ControlRequest.wIndex == ifVendor && USB_ControlRequest.wValue == FEATURE_REPORT(CAPTURE_REPORT_ID)) {
+        CaptureControl reportData;
+        if (USB_ControlRequest.wLength != sizeof(reportData)) {
+          break;
+        }
+        Endpoint_ClearSETUP();
+        Endpoint_Read_Control_Stream_LE(&reportData, sizeof(reportData));
+        Endpoint_ClearIN();
+        captureSetReport(&reportData);
+        break;
+      }
+#endif
       Endpoint_ClearSETUP();
+#if PROFILE_ENABLE
+      // Setting the profile feature report (to anything) resets the stats
+      if (USB_ControlRequest.wIndex == ifVendor) {
+        uint16_t remaining = USB_ControlRequest.wLength;
+        while (remaining) {
+          while (!Endpoint_IsOUTReceived()) {
+            if (USB_DeviceState == DEVICE_STATE_Unattached) {
+              return;
+            }
+          }
+          const uint16_t length = Endpoint_BytesInEndpoint();
+          remaining = (length < remaining) ? remaining - length : 0;
+          Endpoint_ClearOUT();
+        }
+        if (USB_ControlRequest.wValue == FEATURE_REPORT(PROFILE_REPORT_ID)) {
+          profileReset();
+          memset(&stats, 0, sizeof(stats));
+        }
+        Endpoint_ClearStatusStage();
+        break;
+      }
+#endif
       while (!Endpoint_IsOUTReceived()) {
         if (USB_DeviceState == DEVICE_STATE_Unattached) {
           return;
@@ -178,44 +837,60 @@ void EVENT_USB_Device_ControlRequest(void) {
     }
     break;
     
+  // Only the keyboard and mouse have a boot protocol to switch to
   case HID_REQ_GetProtocol:
-    if (USB_ControlRequest.bmRequestType == (REQDIR_DEVICETOHOST | REQTYPE_CLASS | REQREC_INTERFACE)) {
+    if (
+      USB_ControlRequest.bmRequestType == (REQDIR_DEVICETOHOST | REQTYPE_CLASS | REQREC_INTERFACE) &&
+      USB_ControlRequest.wIndex <= ifMouse)
+    {
       Endpoint_ClearSETUP();
-      Endpoint_Write_8(usingReportProtocol);
+      Endpoint_Write_8(reportProtocol[USB_ControlRequest.wIndex]);
       Endpoint_ClearIN();
       Endpoint_ClearStatusStage();
     }
     break;
     
   case HID_REQ_SetProtocol:
-    if (USB_ControlRequest.bmRequestType == (REQDIR_HOSTTODEVICE | REQTYPE_CLASS | REQREC_INTERFACE)) {
+    if (
+      USB_ControlRequest.bmRequestType == (REQDIR_HOSTTODEVICE | REQTYPE_CLASS | REQREC_INTERFACE) &&
+      USB_ControlRequest.wIndex <= ifMouse)
+    {
       Endpoint_ClearSETUP();
       Endpoint_ClearStatusStage();
-      usingReportProtocol = (USB_ControlRequest.wValue != 0);
+      reportProtocol[USB_ControlRequest.wIndex] = (USB_ControlRequest.wValue != 0);
     }
     break;
     
   case HID_REQ_SetIdle:
+    // The duration is in the high byte of wValue (in 4ms units), and the report
+    // ID in the low byte. An unknown interface or report ID is stalled.
     if (USB_ControlRequest.bmRequestType == (REQDIR_HOSTTODEVICE | REQTYPE_CLASS | REQREC_INTERFACE)) {
-      Endpoint_ClearSETUP();
-      Endpoint_ClearStatusStage();
-      idleInit = ((USB_ControlRequest.wValue & 0xFF00) >> 6);  // idleInit = value*4
+      const uint16_t rate = ((USB_ControlRequest.wValue & 0xFF00) >> 6);  // rate = value*4
+      if (setIdle(USB_ControlRequest.wIndex, USB_ControlRequest.wValue & 0xFF, rate)) {
+        Endpoint_ClearSETUP();
+        Endpoint_ClearStatusStage();
+      }
     }
     break;
     
   case HID_REQ_GetIdle:
     if (USB_ControlRequest.bmRequestType == (REQDIR_DEVICETOHOST | REQTYPE_CLASS | REQREC_INTERFACE)) {
-      Endpoint_ClearSETUP();
-      Endpoint_Write_8(idleInit >> 2);  // send idleInit/4
-      Endpoint_ClearIN();
-      Endpoint_ClearStatusStage();
+      const int16_t rate = getIdle(USB_ControlRequest.wIndex, USB_ControlRequest.wValue & 0xFF);
+      if (rate >= 0) {
+        Endpoint_ClearSETUP();
+        Endpoint_Write_8(rate >> 2);  // send rate/4
+        Endpoint_ClearIN();
+        Endpoint_ClearStatusStage();
+      }
     }
     break;
   }
 }
 
+// Called from LUFA's USB_GEN_vect ISR
 void EVENT_USB_Device_StartOfFrame(void) {
-  if (idleRemaining) {
-    idleRemaining--;
-  }
+  PROFILE_ISR_BEGIN();
+  timerSofTick();
+  schedPost(WORK_USB);
+  PROFILE_ISR_END(PROFILE_SOF);
 }
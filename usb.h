@@ -1,6 +1,28 @@
 #ifndef USB_H
 #define USB_H
 
+#include <stdint.h>
+#include "IrateConfig.h"
+
+// The input reports, each with its own idle rate (see HID_REQ_SetIdle)
+typedef enum {
+  USB_REPORT_KEYBOARD,
+  USB_REPORT_MOUSE,
+#if USB_MEDIA_KEYS
+  USB_REPORT_CONSUMER,
+  USB_REPORT_SYSTEM,
+#endif
+  USB_NUM_REPORTS
+} UsbReport;
+
+// Input reports sent, by why they were sent (STATS_ENABLE). The counts
+// saturate at 0xFFFF.
+typedef struct {
+  uint16_t changed[USB_NUM_REPORTS];  // the data changed
+  uint16_t idle[USB_NUM_REPORTS];     // the idle period was up
+} UsbStats;
+
 void usbSendReceive(void);
+void usbGetStats(UsbStats* stats);
 
 #endif